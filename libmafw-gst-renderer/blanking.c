@@ -35,10 +35,15 @@
 /* In seconds */
 #define VIDEO_BLANKING_TIMER_INTERVAL	45
 
+/* The display is shared by all the renderers of the process, so the
+ * state below is refcounted: blanking stays prohibited while at least one
+ * of them prohibits it. */
+G_LOCK_DEFINE_STATIC(blanking);
 static guint blanking_timeout_id = 0;
 static osso_context_t *osso_ctx = NULL;
+static guint init_count = 0;
 static gboolean can_control_blanking = TRUE;
-static gboolean is_blanking_prohibited = FALSE;
+static guint prohibit_count = 0;
 
 static void remove_blanking_timeout(void)
 {
@@ -48,27 +53,22 @@ static void remove_blanking_timeout(void)
 	}
 }
 
-/*
- * Re-enables screen blanking.
- */
-void blanking_allow(void)
-{
-        is_blanking_prohibited = FALSE;
-        remove_blanking_timeout();
-}
-
 static gboolean no_blanking_timeout(void)
 {
+	gboolean ret;
+
+	G_LOCK(blanking);
 	/* Stop trying if it fails. */
-	return osso_display_blanking_pause(osso_ctx) == OSSO_OK;
+	ret = osso_display_blanking_pause(osso_ctx) == OSSO_OK;
+	if (!ret)
+		blanking_timeout_id = 0;
+	G_UNLOCK(blanking);
+
+	return ret;
 }
 
-/*
- * Adds a timeout to periodically disable screen blanking.
- */
-void blanking_prohibit(void)
+static void start_blanking_timeout(void)
 {
-        is_blanking_prohibited = TRUE;
 	if ((!osso_ctx) || (!can_control_blanking))
 		return;
 	osso_display_state_on(osso_ctx);
@@ -81,39 +81,78 @@ void blanking_prohibit(void)
 	}
 }
 
+/*
+ * Releases one blanking prohibition.  Screen blanking is re-enabled when no
+ * renderer prohibits it anymore.
+ */
+void blanking_allow(void)
+{
+	G_LOCK(blanking);
+	if (prohibit_count > 0 && --prohibit_count == 0)
+		remove_blanking_timeout();
+	G_UNLOCK(blanking);
+}
+
+/*
+ * Takes one blanking prohibition.  The first one adds a timeout to
+ * periodically disable screen blanking.
+ */
+void blanking_prohibit(void)
+{
+	G_LOCK(blanking);
+	if (prohibit_count++ == 0)
+		start_blanking_timeout();
+	G_UNLOCK(blanking);
+}
+
 void blanking_init(void)
 {
+	G_LOCK(blanking);
 	/* It's enough to initialize it once for a process. */
-	if (osso_ctx)
+	if (init_count++ > 0) {
+		G_UNLOCK(blanking);
 		return;
+	}
 	osso_ctx = osso_initialize(PACKAGE, VERSION, 0, NULL);
 	if (!osso_ctx)
 		g_warning("osso_initialize failed, screen may go black");
-        is_blanking_prohibited = FALSE;
+        prohibit_count = 0;
+	G_UNLOCK(blanking);
+
         /* Default policy is to allow user to control blanking */
         blanking_control(TRUE);
 }
 
 void blanking_deinit(void)
 {
-	if (!osso_ctx)
+	G_LOCK(blanking);
+	if (init_count == 0 || --init_count > 0) {
+		G_UNLOCK(blanking);
 		return;
+	}
+	G_UNLOCK(blanking);
+
 	blanking_control(FALSE);
-	osso_deinitialize(osso_ctx);
-	osso_ctx = NULL;
+
+	G_LOCK(blanking);
+	if (osso_ctx) {
+		osso_deinitialize(osso_ctx);
+		osso_ctx = NULL;
+	}
+	G_UNLOCK(blanking);
 }
 
 void blanking_control(gboolean activate)
 {
+	G_LOCK(blanking);
         can_control_blanking = activate;
         if (!can_control_blanking) {
                 remove_blanking_timeout();
-        } else {
+        } else if (prohibit_count > 0) {
                 /* Restore the last state */
-                if (is_blanking_prohibited) {
-                        blanking_prohibit();
-                } else {
-                        blanking_allow();
-                }
+                start_blanking_timeout();
+        } else {
+                remove_blanking_timeout();
         }
+	G_UNLOCK(blanking);
 }
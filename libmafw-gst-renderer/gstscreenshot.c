@@ -28,6 +28,15 @@
 
 #include "gstscreenshot.h"
 
+struct _BvwFrameConv {
+	GstElement *pipeline;
+	GstElement *src;
+	GstElement *sink;
+	GstElement *filter1;
+	GstElement *filter2;
+	GstBus *bus;
+};
+
 typedef struct {
 	GstSample *result;
 	GstElement *src;
@@ -150,117 +159,151 @@ static gboolean async_bus_handler(GstBus *bus, GstMessage *msg,
 	return keep_watch;
 }
 
-/* takes ownership of the input sample */
-gboolean
-bvw_frame_conv_convert(GstSample *sample, GstCaps *to_caps, gboolean xv,
-		       BvwFrameConvCb cb, gpointer cb_data)
+static gboolean build_pipeline(BvwFrameConv *conv, gboolean xv)
 {
-	static GstElement *src = NULL, *sink = NULL, *pipeline = NULL,
-		*filter1 = NULL, *filter2 = NULL, *download = NULL;
-	static GstBus *bus;
+	GstElement *csp, *vscale, *download = NULL;
 	GError *error = NULL;
-	GstScreenshotData *gsd;
 
-	g_return_val_if_fail(gst_sample_get_caps(sample) != NULL, FALSE);
-	g_return_val_if_fail(cb != NULL, FALSE);
+	conv->pipeline = gst_pipeline_new("screenshot-pipeline");
+	if(conv->pipeline == NULL) {
+		g_warning("Could not take screenshot: "
+			  "no pipeline (unknown error)");
+		return FALSE;
+	}
 
-	if (pipeline == NULL) {
-		GstElement *csp, *vscale;
+	/* videoscale is here to correct for the
+	 * pixel-aspect-ratio for us */
+	GST_DEBUG("creating elements");
+	if(!create_element("fakesrc", &conv->src, &error) ||
+	   !create_element("videoconvert", &csp, &error) ||
+	   !create_element("videoscale", &vscale, &error) ||
+	   !create_element("capsfilter", &conv->filter1, &error) ||
+	   !create_element("capsfilter", &conv->filter2, &error) ||
+	   !(xv || create_element("gldownload",  &download, &error)) ||
+	   !create_element("fakesink", &conv->sink, &error)) {
+		g_warning("Could not take screenshot: %s",
+			  error->message);
+		g_error_free(error);
+		return FALSE;
+	}
 
-		pipeline = gst_pipeline_new("screenshot-pipeline");
-		if(pipeline == NULL) {
-			g_warning("Could not take screenshot: "
-				  "no pipeline (unknown error)");
-			return FALSE;
-		}
+	GST_DEBUG("adding elements");
+	gst_bin_add_many(GST_BIN(conv->pipeline), conv->src, conv->filter1,
+			 csp, conv->filter2, vscale, conv->sink, NULL);
 
-		/* videoscale is here to correct for the
-		 * pixel-aspect-ratio for us */
-		GST_DEBUG("creating elements");
-		if(!create_element("fakesrc", &src, &error) ||
-		   !create_element("videoconvert", &csp, &error) ||
-		   !create_element("videoscale", &vscale, &error) ||
-		   !create_element("capsfilter", &filter1, &error) ||
-		   !create_element("capsfilter", &filter2, &error) ||
-		   !(xv || create_element("gldownload",  &download, &error)) ||
-		   !create_element("fakesink", &sink, &error)) {
-			g_warning("Could not take screenshot: %s",
-				  error->message);
-			g_error_free(error);
-			return FALSE;
-		}
+	if (!xv)
+		gst_bin_add(GST_BIN(conv->pipeline), download);
 
-		GST_DEBUG("adding elements");
-		gst_bin_add_many(GST_BIN(pipeline), src, filter1, csp, filter2,
-				 vscale, sink, NULL);
+	g_object_set(conv->sink, "signal-handoffs", TRUE, NULL);
 
-		if (!xv)
-			gst_bin_add(GST_BIN(pipeline), download);
+	/* set to 'fixed' sizetype */
+	g_object_set(conv->src, "sizetype", 2, "num-buffers", 1,
+		     "signal-handoffs", TRUE, NULL);
 
-		g_object_set(sink, "signal-handoffs", TRUE, NULL);
+	GST_DEBUG("linking src->filter1");
+	if(!gst_element_link_pads(conv->src, "src", conv->filter1, "sink"))
+		return FALSE;
 
-		/* set to 'fixed' sizetype */
-		g_object_set(src, "sizetype", 2, "num-buffers", 1,
-			     "signal-handoffs", TRUE, NULL);
+	if (xv) {
+		GST_DEBUG("linking filter1->csp");
+		if(!gst_element_link_pads(conv->filter1, "src", csp, "sink"))
+			return FALSE;
+	} else {
+		GST_DEBUG("linking filter1->download");
+		if(!gst_element_link_pads(conv->filter1, "src", download,
+					  "sink"))
+			return FALSE;
 
-		GST_DEBUG("linking src->filter1");
-		if(!gst_element_link_pads(src, "src", filter1, "sink"))
+		GST_DEBUG("linking download->csp");
+		if(!gst_element_link_pads(download, "src", csp, "sink"))
 			return FALSE;
+	}
 
-		if (xv) {
-			GST_DEBUG("linking filter1->csp");
-			if(!gst_element_link_pads(filter1, "src", csp, "sink"))
-				return FALSE;
-		} else {
-			GST_DEBUG("linking filter1->download");
-			if(!gst_element_link_pads(filter1, "src", download, "sink"))
-				return FALSE;
+	GST_DEBUG("linking csp->vscale");
+	if(!gst_element_link_pads(csp, "src", vscale, "sink"))
+		return FALSE;
 
-			GST_DEBUG("linking download->csp");
-			if(!gst_element_link_pads(download, "src", csp, "sink"))
-				return FALSE;
-		}
+	GST_DEBUG("linking vscale->capsfilter");
+	if(!gst_element_link_pads(vscale, "src", conv->filter2, "sink"))
+		return FALSE;
 
-		GST_DEBUG("linking csp->vscale");
-		if(!gst_element_link_pads(csp, "src", vscale, "sink"))
-			return FALSE;
+	GST_DEBUG("linking capsfilter->sink");
+	if(!gst_element_link_pads(conv->filter2, "src", conv->sink, "sink"))
+		return FALSE;
 
-		GST_DEBUG("linking vscale->capsfilter");
-		if(!gst_element_link_pads(vscale, "src", filter2, "sink"))
-			return FALSE;
+	conv->bus = gst_element_get_bus(conv->pipeline);
 
-		GST_DEBUG("linking capsfilter->sink");
-		if(!gst_element_link_pads(filter2, "src", sink, "sink"))
-			return FALSE;
+	return TRUE;
+}
 
-		bus = gst_element_get_bus(pipeline);
+/*
+ * Creates a frame converter.  Each converter owns its conversion pipeline,
+ * so several renderers in one process do not share it.
+ */
+BvwFrameConv *bvw_frame_conv_new(gboolean xv)
+{
+	BvwFrameConv *conv;
+
+	conv = g_new0(BvwFrameConv, 1);
+	if (!build_pipeline(conv, xv)) {
+		bvw_frame_conv_free(conv);
+		return NULL;
 	}
 
-	g_object_set(filter1, "caps", gst_sample_get_caps(sample), NULL);
+	return conv;
+}
+
+void bvw_frame_conv_free(BvwFrameConv *conv)
+{
+	if (conv == NULL)
+		return;
+
+	if (conv->bus != NULL)
+		gst_object_unref(conv->bus);
+	if (conv->pipeline != NULL) {
+		gst_element_set_state(conv->pipeline, GST_STATE_NULL);
+		gst_object_unref(conv->pipeline);
+	}
+	g_free(conv);
+}
+
+/* takes ownership of the input sample */
+gboolean
+bvw_frame_conv_convert(BvwFrameConv *conv, GstSample *sample,
+		       GstCaps *to_caps, BvwFrameConvCb cb, gpointer cb_data)
+{
+	GstScreenshotData *gsd;
+
+	g_return_val_if_fail(conv != NULL, FALSE);
+	g_return_val_if_fail(gst_sample_get_caps(sample) != NULL, FALSE);
+	g_return_val_if_fail(cb != NULL, FALSE);
+
+	g_object_set(conv->filter1, "caps", gst_sample_get_caps(sample), NULL);
 
-	g_object_set(filter2, "caps", to_caps, NULL);
+	g_object_set(conv->filter2, "caps", to_caps, NULL);
 	gst_caps_unref(to_caps);
 
 	gsd = g_new0(GstScreenshotData, 1);
 
-	gsd->src = src;
-	gsd->sink = sink;
-	gsd->pipeline = pipeline;
+	gsd->src = conv->src;
+	gsd->sink = conv->sink;
+	gsd->pipeline = conv->pipeline;
 	gsd->cb = cb;
 	gsd->cb_data = cb_data;
 
-	g_signal_connect(sink, "handoff", G_CALLBACK(save_result), gsd);
+	g_signal_connect(conv->sink, "handoff", G_CALLBACK(save_result), gsd);
 
-	g_signal_connect(src, "handoff", G_CALLBACK(feed_fakesrc), sample);
+	g_signal_connect(conv->src, "handoff", G_CALLBACK(feed_fakesrc),
+			 sample);
 
-	gst_bus_add_watch(bus, async_bus_handler, gsd);
+	gst_bus_add_watch(conv->bus, async_bus_handler, gsd);
 
 	/* set to 'fixed' sizetype */
-	g_object_set(src, "sizemax",
+	g_object_set(conv->src, "sizemax",
 		     gst_buffer_get_size(gst_sample_get_buffer(sample)), NULL);
 
 	GST_DEBUG("running conversion pipeline");
-	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	gst_element_set_state(conv->pipeline, GST_STATE_PLAYING);
 
 	return TRUE;
 }
@@ -26,10 +26,15 @@
 
 G_BEGIN_DECLS
 
+typedef struct _BvwFrameConv BvwFrameConv;
+
 typedef void (*BvwFrameConvCb)(GstSample *result, gpointer user_data);
 
-gboolean bvw_frame_conv_convert (GstSample *sample, GstCaps *to, gboolean xv,
-				 BvwFrameConvCb cb, gpointer cb_data);
+BvwFrameConv *bvw_frame_conv_new (gboolean xv);
+void bvw_frame_conv_free (BvwFrameConv *conv);
+gboolean bvw_frame_conv_convert (BvwFrameConv *conv, GstSample *sample,
+				 GstCaps *to, BvwFrameConvCb cb,
+				 gpointer cb_data);
 
 G_END_DECLS
 
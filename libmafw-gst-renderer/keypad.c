@@ -30,15 +30,21 @@
 
 #define KEYPAD_TIMER_INTERVAL 50
 
+/* Shared by all the renderers of the process: keypad locking stays
+ * prohibited while at least one of them prohibits it. */
+G_LOCK_DEFINE_STATIC(keypad);
 static guint toutid;
+static guint prohibit_count;
 
 void keypadlocking_allow(void)
 {
-	if (toutid)
+	G_LOCK(keypad);
+	if (prohibit_count > 0 && --prohibit_count == 0 && toutid)
 	{
 		g_source_remove(toutid);
 		toutid = 0;
 	}
+	G_UNLOCK(keypad);
 }
 
 static gboolean no_keylock_timeout(gpointer udata)
@@ -69,6 +75,8 @@ static gboolean no_keylock_timeout(gpointer udata)
 
 void keypadlocking_prohibit(void)
 {
+	G_LOCK(keypad);
+	prohibit_count++;
 	if (!toutid)
 	{
 		toutid = g_timeout_add_seconds(KEYPAD_TIMER_INTERVAL,
@@ -76,4 +84,5 @@ void keypadlocking_prohibit(void)
                                               NULL);
 		no_keylock_timeout(NULL);
 	}
+	G_UNLOCK(keypad);
 }
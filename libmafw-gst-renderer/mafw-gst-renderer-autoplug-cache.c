@@ -0,0 +1,382 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "mafw-gst-renderer-autoplug-cache.h"
+#include "mafw-gst-renderer-media-cache.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-autoplug-cache"
+
+/* Container caps and elements plugged, in the media cache */
+#define AUTOPLUG_KEY_CAPS "autoplug-caps"
+#define AUTOPLUG_KEY_CHAIN "autoplug-chain"
+/* Elements remembered per URI */
+#define MAFW_GST_RENDERER_AUTOPLUG_CACHE_MAX_CHAIN 8
+
+#define SESSION_KEY "mafw-autoplug-session"
+
+/*
+ * The autoplugging of one media, attached to the pipeline playing it.
+ *
+ * ref:       References, from the pipeline and the signal handlers
+ * lock:      Protects the fields below, filled from streaming threads
+ * uri:       The media
+ * local:     @uri is a local file, whose @size and @mtime are known
+ * caps:      Container caps found by typefind
+ * chain:     Demuxers, parsers and decoders plugged, in order
+ * cached:    What the previous play found, NULL if nothing
+ * cached_chain: Elements of @cached
+ */
+typedef struct {
+	gint ref;
+	GMutex lock;
+	gchar *uri;
+	gboolean local;
+	gint64 size;
+	gint64 mtime;
+	gchar *caps;
+	GPtrArray *chain;
+	GstCaps *cached;
+	gchar **cached_chain;
+} MafwGstRendererAutoplugSession;
+
+static MafwGstRendererAutoplugSession *_session_ref(
+	MafwGstRendererAutoplugSession *session)
+{
+	g_atomic_int_inc(&session->ref);
+	return session;
+}
+
+static void _session_unref(gpointer data)
+{
+	MafwGstRendererAutoplugSession *session = data;
+
+	if (!g_atomic_int_dec_and_test(&session->ref))
+		return;
+
+	g_mutex_clear(&session->lock);
+	g_free(session->uri);
+	g_free(session->caps);
+	g_ptr_array_free(session->chain, TRUE);
+	if (session->cached != NULL)
+		gst_caps_unref(session->cached);
+	g_strfreev(session->cached_chain);
+	g_free(session);
+}
+
+static MafwGstRendererAutoplugSession *_get_session(GstElement *pipeline)
+{
+	if (pipeline == NULL)
+		return NULL;
+	return g_object_get_data(G_OBJECT(pipeline), SESSION_KEY);
+}
+
+/*
+ * Reads what the previous play of the session media found.  Local files
+ * must not have changed since.
+ */
+static void _lookup(MafwGstRendererAutoplugSession *session)
+{
+	const gchar *uri = session->uri;
+	GKeyFile *cache;
+	gchar *caps;
+
+	cache = mafw_gst_renderer_media_cache_lock(uri, session->size,
+						   session->mtime);
+	caps = g_key_file_get_string(cache, uri, AUTOPLUG_KEY_CAPS, NULL);
+	session->cached_chain = g_key_file_get_string_list(
+		cache, uri, AUTOPLUG_KEY_CHAIN, NULL, NULL);
+	mafw_gst_renderer_media_cache_unlock(FALSE);
+
+	if (caps != NULL)
+		session->cached = gst_caps_from_string(caps);
+	g_free(caps);
+}
+
+/*
+ * Puts the elements plugged last time first, decodebin tries them before
+ * the others.  Only factories that fit the caps at hand are in
+ * @factories, so a stream that changed falls back to the usual order.
+ */
+static GValueArray *_autoplug_sort_cb(GstElement *uridecodebin, GstPad *pad,
+				      GstCaps *caps, GValueArray *factories,
+				      MafwGstRendererAutoplugSession *session)
+{
+	GValueArray *sorted;
+	gboolean *used;
+	guint i, j;
+
+	if (session->cached_chain == NULL || factories->n_values < 2)
+		return NULL;
+
+	sorted = g_value_array_new(factories->n_values);
+	used = g_new0(gboolean, factories->n_values);
+	for (i = 0; session->cached_chain[i] != NULL; i++) {
+		for (j = 0; j < factories->n_values; j++) {
+			GstObject *factory = g_value_get_object(
+				g_value_array_get_nth(factories, j));
+
+			if (!used[j] &&
+			    !strcmp(GST_OBJECT_NAME(factory),
+				    session->cached_chain[i])) {
+				g_value_array_append(
+					sorted,
+					g_value_array_get_nth(factories, j));
+				used[j] = TRUE;
+			}
+		}
+	}
+	if (sorted->n_values == 0) {
+		g_free(used);
+		g_value_array_free(sorted);
+		return NULL;
+	}
+	for (j = 0; j < factories->n_values; j++) {
+		if (!used[j])
+			g_value_array_append(
+				sorted, g_value_array_get_nth(factories, j));
+	}
+	g_free(used);
+
+	return sorted;
+}
+
+static void _have_type_cb(GstElement *typefind, guint probability,
+			  GstCaps *caps,
+			  MafwGstRendererAutoplugSession *session)
+{
+	g_mutex_lock(&session->lock);
+	g_free(session->caps);
+	session->caps = gst_caps_to_string(caps);
+	g_mutex_unlock(&session->lock);
+}
+
+/*
+ * A local file that has not changed has the container it had: tell
+ * typefind, which then does not read and probe the file.
+ */
+static void _setup_decodebin(MafwGstRendererAutoplugSession *session,
+			     GstElement *decodebin)
+{
+	GstElement *typefind;
+
+	typefind = gst_bin_get_by_name(GST_BIN(decodebin), "typefind");
+	if (typefind == NULL)
+		return;
+
+	if (session->local && session->cached != NULL) {
+		g_debug("%s is %" GST_PTR_FORMAT, session->uri,
+			session->cached);
+		g_object_set(typefind, "force-caps", session->cached, NULL);
+	}
+	g_signal_connect_data(typefind, "have-type",
+			      G_CALLBACK(_have_type_cb), _session_ref(session),
+			      (GClosureNotify) _session_unref, 0);
+	gst_object_unref(typefind);
+}
+
+/**
+ * mafw_gst_renderer_autoplug_cache_attach:
+ * @pipeline: a playbin about to play @uri.
+ * @uri: the media.
+ *
+ * Looks up how @uri was autoplugged last time, for
+ * mafw_gst_renderer_autoplug_cache_watch() to plug the same elements.
+ */
+void mafw_gst_renderer_autoplug_cache_attach(GstElement *pipeline,
+					     const gchar *uri)
+{
+	MafwGstRendererAutoplugSession *session;
+	gchar *filename;
+	GStatBuf st;
+
+	g_return_if_fail(GST_IS_ELEMENT(pipeline));
+
+	g_object_set_data(G_OBJECT(pipeline), SESSION_KEY, NULL);
+	if (uri == NULL)
+		return;
+
+	session = g_new0(MafwGstRendererAutoplugSession, 1);
+	session->ref = 1;
+	g_mutex_init(&session->lock);
+	session->uri = g_strdup(uri);
+	session->chain = g_ptr_array_new_with_free_func(g_free);
+
+	filename = g_filename_from_uri(uri, NULL, NULL);
+	if (filename != NULL && g_stat(filename, &st) == 0) {
+		session->local = TRUE;
+		session->size = st.st_size;
+		session->mtime = st.st_mtime;
+	}
+	g_free(filename);
+
+	_lookup(session);
+	g_object_set_data_full(G_OBJECT(pipeline), SESSION_KEY, session,
+			       _session_unref);
+}
+
+/**
+ * mafw_gst_renderer_autoplug_cache_watch:
+ * @pipeline: the playbin.
+ * @element: an element just created in @pipeline.
+ *
+ * Hooks into autoplugging if @element is a decodebin, and records it if
+ * it is a demuxer, parser or decoder.
+ */
+void mafw_gst_renderer_autoplug_cache_watch(GstElement *pipeline,
+					    GstElement *element)
+{
+	MafwGstRendererAutoplugSession *session;
+	GstElementFactory *factory;
+	const gchar *name;
+
+	session = _get_session(pipeline);
+	factory = gst_element_get_factory(element);
+	if (session == NULL || factory == NULL)
+		return;
+
+	name = GST_OBJECT_NAME(factory);
+	if (!strcmp(name, "uridecodebin")) {
+		g_signal_connect_data(element, "autoplug-sort",
+				      G_CALLBACK(_autoplug_sort_cb),
+				      _session_ref(session),
+				      (GClosureNotify) _session_unref, 0);
+	} else if (!strcmp(name, "decodebin")) {
+		_setup_decodebin(session, element);
+	} else if (gst_element_factory_list_is_type(
+			   factory, GST_ELEMENT_FACTORY_TYPE_DEMUXER |
+			   GST_ELEMENT_FACTORY_TYPE_PARSER |
+			   GST_ELEMENT_FACTORY_TYPE_DECODER)) {
+		g_mutex_lock(&session->lock);
+		if (session->chain->len <
+		    MAFW_GST_RENDERER_AUTOPLUG_CACHE_MAX_CHAIN)
+			g_ptr_array_add(session->chain, g_strdup(name));
+		g_mutex_unlock(&session->lock);
+	}
+}
+
+static gboolean _same_chain(gchar **a, gchar **b)
+{
+	gint i;
+
+	if (a == NULL || b == NULL)
+		return a == b;
+	for (i = 0; a[i] != NULL && b[i] != NULL; i++) {
+		if (strcmp(a[i], b[i]))
+			return FALSE;
+	}
+	return a[i] == b[i];
+}
+
+/**
+ * mafw_gst_renderer_autoplug_cache_commit:
+ * @pipeline: a playbin that prerolled.
+ *
+ * Remembers how the media of @pipeline was autoplugged, if that differs
+ * from last time.
+ */
+void mafw_gst_renderer_autoplug_cache_commit(GstElement *pipeline)
+{
+	MafwGstRendererAutoplugSession *session;
+	GKeyFile *cache;
+	const gchar *uri;
+	gchar *caps, **chain;
+	gboolean changed;
+
+	session = _get_session(pipeline);
+	if (session == NULL)
+		return;
+
+	g_mutex_lock(&session->lock);
+	if (session->caps == NULL || session->chain->len == 0) {
+		g_mutex_unlock(&session->lock);
+		return;
+	}
+	g_ptr_array_add(session->chain, NULL);
+	chain = g_strdupv((gchar **) session->chain->pdata);
+	g_ptr_array_remove_index(session->chain, session->chain->len - 1);
+	caps = g_strdup(session->caps);
+	g_mutex_unlock(&session->lock);
+
+	uri = session->uri;
+	cache = mafw_gst_renderer_media_cache_lock(uri, session->size,
+						   session->mtime);
+	changed = !_same_chain(chain, session->cached_chain);
+	if (!changed) {
+		gchar *cached_caps;
+
+		cached_caps = g_key_file_get_string(cache, uri,
+						    AUTOPLUG_KEY_CAPS, NULL);
+		changed = g_strcmp0(caps, cached_caps) != 0;
+		g_free(cached_caps);
+	}
+	if (changed) {
+		g_key_file_set_string(cache, uri, AUTOPLUG_KEY_CAPS, caps);
+		g_key_file_set_string_list(cache, uri, AUTOPLUG_KEY_CHAIN,
+					   (const gchar * const *) chain,
+					   g_strv_length(chain));
+	}
+	mafw_gst_renderer_media_cache_unlock(changed);
+
+	g_strfreev(chain);
+	g_free(caps);
+}
+
+/**
+ * mafw_gst_renderer_autoplug_cache_forget:
+ * @pipeline: a playbin that failed.
+ *
+ * Drops what is remembered about the media of @pipeline, in case that is
+ * what made it fail.
+ */
+void mafw_gst_renderer_autoplug_cache_forget(GstElement *pipeline)
+{
+	MafwGstRendererAutoplugSession *session;
+	GKeyFile *cache;
+	gboolean removed;
+
+	session = _get_session(pipeline);
+	if (session == NULL || session->cached_chain == NULL)
+		return;
+
+	g_debug("forgetting how %s was plugged", session->uri);
+	cache = mafw_gst_renderer_media_cache_lock(session->uri, session->size,
+						   session->mtime);
+	removed = g_key_file_remove_key(cache, session->uri,
+					AUTOPLUG_KEY_CAPS, NULL);
+	removed = g_key_file_remove_key(cache, session->uri,
+					AUTOPLUG_KEY_CHAIN, NULL) || removed;
+	mafw_gst_renderer_media_cache_unlock(removed);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
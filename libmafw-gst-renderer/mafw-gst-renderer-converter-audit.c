@@ -0,0 +1,215 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "mafw-gst-renderer-converter-audit.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-converter-audit"
+
+#define CONVERTER_STATS_KEY "mafw-converter-stats"
+
+/*
+ * lock:        The streaming thread writes the times, the report reads them
+ * track:       "audio" or "video"
+ * entered:     When the buffer being converted entered the element
+ * busy_usecs:  Time spent converting so far
+ * first:       When the first buffer entered the element
+ * last:        When the last buffer left the element
+ */
+typedef struct {
+	GMutex lock;
+	const gchar *track;
+	gint64 entered;
+	gint64 busy_usecs;
+	gint64 first;
+	gint64 last;
+} ConverterStats;
+
+static GstPadProbeReturn _sink_probe_cb(GstPad *pad, GstPadProbeInfo *info,
+					gpointer data)
+{
+	ConverterStats *stats = data;
+
+	g_mutex_lock(&stats->lock);
+	stats->entered = g_get_monotonic_time();
+	if (stats->first == 0)
+		stats->first = stats->entered;
+	g_mutex_unlock(&stats->lock);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn _src_probe_cb(GstPad *pad, GstPadProbeInfo *info,
+				       gpointer data)
+{
+	ConverterStats *stats = data;
+
+	g_mutex_lock(&stats->lock);
+	stats->last = g_get_monotonic_time();
+	if (stats->entered != 0) {
+		stats->busy_usecs += stats->last - stats->entered;
+		stats->entered = 0;
+	}
+	g_mutex_unlock(&stats->lock);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void _stats_free(gpointer data)
+{
+	ConverterStats *stats = data;
+
+	g_mutex_clear(&stats->lock);
+	g_free(stats);
+}
+
+static void _add_probe(GstElement *element, const gchar *name,
+		       GstPadProbeCallback callback, ConverterStats *stats)
+{
+	GstPad *pad;
+
+	pad = gst_element_get_static_pad(element, name);
+	if (pad != NULL) {
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback,
+				  stats, NULL);
+		gst_object_unref(pad);
+	}
+}
+
+/**
+ * mafw_gst_renderer_converter_audit_attach:
+ * @element: an element just created for playback.
+ *
+ * If @element is a format converter (videoconvert, videoscale,
+ * audioconvert, audioresample...), starts measuring the time it spends
+ * converting.
+ *
+ * Returns: %TRUE if @element is being audited.
+ */
+gboolean mafw_gst_renderer_converter_audit_attach(GstElement *element)
+{
+	GstElementFactory *factory;
+	const gchar *klass;
+	ConverterStats *stats;
+
+	g_return_val_if_fail(GST_IS_ELEMENT(element), FALSE);
+
+	factory = gst_element_get_factory(element);
+	if (factory == NULL)
+		return FALSE;
+	klass = gst_element_factory_get_metadata(factory,
+						 GST_ELEMENT_METADATA_KLASS);
+	if (klass == NULL || strstr(klass, "Converter") == NULL)
+		return FALSE;
+
+	stats = g_new0(ConverterStats, 1);
+	g_mutex_init(&stats->lock);
+	stats->track = strstr(klass, "Video") ? "video" : "audio";
+	g_object_set_data_full(G_OBJECT(element), CONVERTER_STATS_KEY, stats,
+			       _stats_free);
+	_add_probe(element, "sink", _sink_probe_cb, stats);
+	_add_probe(element, "src", _src_probe_cb, stats);
+
+	return TRUE;
+}
+
+static void _report_element(GstElement *element, GString *report)
+{
+	ConverterStats *stats;
+	gboolean passthrough;
+	gdouble cost;
+
+	stats = g_object_get_data(G_OBJECT(element), CONVERTER_STATS_KEY);
+	if (stats == NULL)
+		return;
+
+	passthrough = GST_IS_BASE_TRANSFORM(element) &&
+		gst_base_transform_is_passthrough(GST_BASE_TRANSFORM(element));
+
+	/* Milliseconds of work per second of playback */
+	cost = 0.0;
+	g_mutex_lock(&stats->lock);
+	if (stats->last > stats->first) {
+		cost = (gdouble)stats->busy_usecs * 1000.0 /
+			(stats->last - stats->first);
+	}
+	g_mutex_unlock(&stats->lock);
+
+	if (report->len > 0)
+		g_string_append(report, "; ");
+	g_string_append_printf(report, "%s %s: %s, %.2f ms/s",
+			       stats->track, GST_OBJECT_NAME(element),
+			       passthrough ? "passthrough" : "active", cost);
+}
+
+/**
+ * mafw_gst_renderer_converter_audit_report:
+ * @pipeline: the playback pipeline.
+ *
+ * Returns: a newly allocated description of the converters in @pipeline,
+ * per track: whether they are converting and what it costs, in
+ * milliseconds per second.  %NULL if there are no converters.
+ */
+gchar *mafw_gst_renderer_converter_audit_report(GstElement *pipeline)
+{
+	GstIterator *it;
+	GValue item = G_VALUE_INIT;
+	GString *report;
+	gboolean done = FALSE;
+
+	g_return_val_if_fail(GST_IS_BIN(pipeline), NULL);
+
+	report = g_string_new(NULL);
+	it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+	while (!done) {
+		switch (gst_iterator_next(it, &item)) {
+		case GST_ITERATOR_OK:
+			_report_element(g_value_get_object(&item), report);
+			g_value_reset(&item);
+			break;
+		case GST_ITERATOR_RESYNC:
+			g_string_truncate(report, 0);
+			gst_iterator_resync(it);
+			break;
+		default:
+			done = TRUE;
+			break;
+		}
+	}
+	g_value_unset(&item);
+	gst_iterator_free(it);
+
+	return g_string_free(report, report->len == 0);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
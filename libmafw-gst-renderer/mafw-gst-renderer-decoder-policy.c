@@ -0,0 +1,195 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "mafw-gst-renderer-decoder-policy.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-decoder-policy"
+
+/* Policy configuration, relative to the user configuration directory.
+ * The groups are content types ("file", "stream"), with the keys
+ * max-threads (0 means from the free cores) and thread-type (the value
+ * of the decoder's thread-type property, e.g. "frame" or "slice"). */
+#define MAFW_GST_RENDERER_DECODER_POLICY_FILE \
+	"mafw-gst-renderer/decoders.conf"
+
+typedef enum {
+	CONTENT_FILE,
+	CONTENT_STREAM,
+	_LAST_CONTENT
+} ContentType;
+
+typedef struct {
+	gint max_threads;
+	gchar *thread_type;
+} DecoderPolicy;
+
+static const gchar *content_groups[_LAST_CONTENT] = { "file", "stream" };
+
+/*
+ * Frame threading gives the best throughput on local files.  Streams get
+ * slice threading, which does not hold frames back and so keeps the
+ * buffering estimates right.
+ */
+static DecoderPolicy policies[_LAST_CONTENT] = {
+	{ 0, (gchar *) "frame" },
+	{ 0, (gchar *) "slice" },
+};
+
+static gpointer _load_policies(gpointer data)
+{
+	GKeyFile *keyfile;
+	gchar *path;
+	gint i;
+
+	keyfile = g_key_file_new();
+	path = g_build_filename(g_get_user_config_dir(),
+				MAFW_GST_RENDERER_DECODER_POLICY_FILE, NULL);
+
+	if (g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE, NULL)) {
+		for (i = 0; i < _LAST_CONTENT; i++) {
+			const gchar *group = content_groups[i];
+			GError *error = NULL;
+			gint threads;
+
+			threads = g_key_file_get_integer(keyfile, group,
+							 "max-threads",
+							 &error);
+			if (error == NULL)
+				policies[i].max_threads = MAX(threads, 0);
+			else
+				g_error_free(error);
+
+			if (g_key_file_has_key(keyfile, group, "thread-type",
+					       NULL)) {
+				policies[i].thread_type =
+					g_key_file_get_string(keyfile, group,
+							      "thread-type",
+							      NULL);
+			}
+		}
+		g_debug("decoder policy loaded from %s", path);
+	}
+
+	g_free(path);
+	g_key_file_free(keyfile);
+
+	return NULL;
+}
+
+/*
+ * Cores not kept busy by others, according to the load average.
+ */
+static gint _available_cores(void)
+{
+	gint cores;
+	gdouble load = 0.0;
+	gchar *contents;
+
+	cores = g_get_num_processors();
+	if (g_file_get_contents("/proc/loadavg", &contents, NULL, NULL)) {
+		load = g_ascii_strtod(contents, NULL);
+		g_free(contents);
+	}
+
+	return CLAMP(cores - (gint)(load + 0.5), 1, cores);
+}
+
+/**
+ * mafw_gst_renderer_decoder_policy_apply:
+ * @element: an element just created for playback.
+ * @is_stream: whether the media being played is a stream.
+ * @applied: where to return what has been set.
+ *
+ * Configures the threading of @element, if it is a video decoder that
+ * supports it.  The number of threads follows the free cores unless
+ * the policy file sets it.
+ *
+ * Returns: %TRUE if @element has been configured.  Then @applied is set
+ * to a new "mafw-decoder-policy" structure with the decoder name and the
+ * chosen max-threads and thread-type.
+ */
+gboolean mafw_gst_renderer_decoder_policy_apply(GstElement *element,
+						gboolean is_stream,
+						GstStructure **applied)
+{
+	static GOnce once = G_ONCE_INIT;
+	GstElementFactory *factory;
+	GObjectClass *klass;
+	DecoderPolicy *policy;
+	gboolean has_threads, has_type;
+	gint threads;
+
+	g_return_val_if_fail(GST_IS_ELEMENT(element), FALSE);
+
+	factory = gst_element_get_factory(element);
+	if (factory == NULL ||
+	    !gst_element_factory_list_is_type(
+		    factory,
+		    GST_ELEMENT_FACTORY_TYPE_DECODER |
+		    GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO))
+		return FALSE;
+
+	klass = G_OBJECT_GET_CLASS(element);
+	has_threads = g_object_class_find_property(klass, "max-threads") != NULL;
+	has_type = g_object_class_find_property(klass, "thread-type") != NULL;
+	if (!has_threads && !has_type)
+		return FALSE;
+
+	g_once(&once, _load_policies, NULL);
+	policy = &policies[is_stream ? CONTENT_STREAM : CONTENT_FILE];
+
+	threads = policy->max_threads > 0 ?
+		policy->max_threads : _available_cores();
+	if (has_threads)
+		g_object_set(element, "max-threads", threads, NULL);
+	if (has_type && policy->thread_type != NULL)
+		gst_util_set_object_arg(G_OBJECT(element), "thread-type",
+					policy->thread_type);
+
+	g_debug("%s: %d threads, %s threading", GST_OBJECT_NAME(factory),
+		threads, policy->thread_type ? policy->thread_type : "default");
+
+	if (applied != NULL) {
+		*applied = gst_structure_new(
+			"mafw-decoder-policy",
+			"decoder", G_TYPE_STRING, GST_OBJECT_NAME(factory),
+			"max-threads", G_TYPE_INT, threads,
+			"thread-type", G_TYPE_STRING,
+			has_type && policy->thread_type ?
+			policy->thread_type : "default",
+			NULL);
+	}
+
+	return TRUE;
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
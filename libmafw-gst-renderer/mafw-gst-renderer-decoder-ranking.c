@@ -0,0 +1,587 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "mafw-gst-renderer-decoder-ranking.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-decoder-ranking"
+
+/* The mode is enabled with the self-tune key of the [ranking] group of
+ * the decoder configuration, in the user configuration directory. */
+#define MAFW_GST_RENDERER_DECODER_RANKING_CONFIG \
+	"mafw-gst-renderer/decoders.conf"
+/* Measured decoding times, in the user cache directory.  The groups are
+ * codecs, the keys decoders and the values the microseconds they took to
+ * decode the sample. */
+#define MAFW_GST_RENDERER_DECODER_RANKING_DIR "mafw-gst-renderer"
+#define MAFW_GST_RENDERER_DECODER_RANKING_FILE "decoder-ranking"
+
+/* Buffers recorded from the media to time the decoders with */
+#define MAFW_GST_RENDERER_DECODER_RANKING_SAMPLE_BUFFERS 60
+/* Decoders taking longer than this for the sample are given up */
+#define MAFW_GST_RENDERER_DECODER_RANKING_TIMEOUT (5 * GST_SECOND)
+/* Runs per decoder, the fastest one counts */
+#define MAFW_GST_RENDERER_DECODER_RANKING_RUNS 2
+
+/*
+ * codec:    Key the results of @caps are stored with
+ * caps:     Caps of @buffers
+ * buffers:  The beginning of the encoded stream
+ * complete: @buffers holds enough of the stream
+ */
+typedef struct {
+	gchar *codec;
+	GstCaps *caps;
+	GQueue *buffers;
+	gboolean complete;
+} Sample;
+
+G_LOCK_DEFINE_STATIC(ranking);
+static gboolean enabled;
+static gchar *results_path;
+static GKeyFile *results;
+/* Codecs measured or being sampled */
+static GHashTable *known_codecs;
+/* Fastest decoder per codec */
+static GHashTable *fastest;
+static GThreadPool *measurer;
+
+static void _sample_free(Sample *sample)
+{
+	g_free(sample->codec);
+	if (sample->caps != NULL)
+		gst_caps_unref(sample->caps);
+	g_queue_free_full(sample->buffers, (GDestroyNotify) gst_buffer_unref);
+	g_free(sample);
+}
+
+static gboolean _append_codec_field(GQuark field, const GValue *value,
+				    gpointer data)
+{
+	const gchar *name = g_quark_to_string(field);
+
+	/* Fields telling codecs sharing a media type apart */
+	if (G_VALUE_HOLDS_INT(value) &&
+	    (g_str_has_suffix(name, "version") || !strcmp(name, "layer"))) {
+		g_string_append_printf(data, ",%s=%d", name,
+				       g_value_get_int(value));
+	}
+	return TRUE;
+}
+
+static gchar *_codec_key(GstCaps *caps)
+{
+	GstStructure *structure;
+	GString *key;
+
+	structure = gst_caps_get_structure(caps, 0);
+	key = g_string_new(gst_structure_get_name(structure));
+	gst_structure_foreach(structure, _append_codec_field, key);
+
+	return g_string_free(key, FALSE);
+}
+
+/*
+ * Remembers the fastest decoder measured for @codec, for
+ * mafw_gst_renderer_decoder_ranking_sort().  Decoders that failed, or
+ * that are no longer installed, do not count.  Called with the lock
+ * held.
+ */
+static void _update_fastest(const gchar *codec)
+{
+	gchar **decoders;
+	gchar *best = NULL;
+	gint best_usecs = 0;
+	gint i;
+
+	decoders = g_key_file_get_keys(results, codec, NULL, NULL);
+	if (decoders == NULL)
+		return;
+
+	for (i = 0; decoders[i] != NULL; i++) {
+		GstElementFactory *factory;
+		gint usecs;
+
+		usecs = g_key_file_get_integer(results, codec, decoders[i],
+					       NULL);
+		if (usecs <= 0 || (best != NULL && usecs >= best_usecs))
+			continue;
+		factory = gst_element_factory_find(decoders[i]);
+		if (factory == NULL)
+			continue;
+		gst_object_unref(factory);
+		best = decoders[i];
+		best_usecs = usecs;
+	}
+
+	if (best != NULL) {
+		g_debug("%s: preferring %s (%d us)", codec, best, best_usecs);
+		g_hash_table_replace(fastest, g_strdup(codec),
+				     g_strdup(best));
+	} else {
+		g_hash_table_remove(fastest, codec);
+	}
+	g_strfreev(decoders);
+}
+
+/*
+ * Creates a parser for @caps, to convert the sample into the stream format
+ * a decoder takes.  NULL if there is none.
+ */
+static GstElement *_make_parser(GstCaps *caps)
+{
+	GList *parsers, *candidates;
+	GstElement *parser = NULL;
+
+	parsers = gst_element_factory_list_get_elements(
+		GST_ELEMENT_FACTORY_TYPE_PARSER, GST_RANK_MARGINAL);
+	candidates = gst_element_factory_list_filter(parsers, caps,
+						     GST_PAD_SINK, FALSE);
+	if (candidates != NULL)
+		parser = gst_element_factory_create(candidates->data, NULL);
+	gst_plugin_feature_list_free(candidates);
+	gst_plugin_feature_list_free(parsers);
+
+	return parser;
+}
+
+static GstPadProbeReturn _count_probe_cb(GstPad *pad, GstPadProbeInfo *info,
+					 gpointer data)
+{
+	gint *decoded = data;
+
+	(*decoded)++;
+	return GST_PAD_PROBE_OK;
+}
+
+/*
+ * Decodes @sample with @factory as fast as possible.  The sample was
+ * recorded after the parser of the playing pipeline, so it is framed the
+ * way that decoder wanted; a parser converts it for decoders wanting
+ * another stream format.  Returns the microseconds it took, or -1 if
+ * the decoder could not do it or decoded nothing.
+ */
+static gint64 _measure(GstElementFactory *factory, Sample *sample)
+{
+	GstElement *pipeline, *src, *parser = NULL, *decoder, *sink;
+	GstBus *bus;
+	GstMessage *msg;
+	GstPad *pad;
+	GList *l;
+	gint64 started, elapsed = -1;
+	gint decoded = 0;
+	GstFlowReturn ret;
+
+	pipeline = gst_pipeline_new(NULL);
+	src = gst_element_factory_make("appsrc", NULL);
+	decoder = gst_element_factory_create(factory, NULL);
+	sink = gst_element_factory_make("fakesink", NULL);
+	if (src == NULL || decoder == NULL || sink == NULL) {
+		if (src != NULL)
+			gst_object_unref(src);
+		if (decoder != NULL)
+			gst_object_unref(decoder);
+		if (sink != NULL)
+			gst_object_unref(sink);
+		gst_object_unref(pipeline);
+		return -1;
+	}
+
+	g_object_set(src, "caps", sample->caps, "format", GST_FORMAT_TIME,
+		     NULL);
+	g_object_set(sink, "sync", FALSE, NULL);
+	gst_bin_add_many(GST_BIN(pipeline), src, decoder, sink, NULL);
+	if (!gst_element_link(decoder, sink)) {
+		gst_object_unref(pipeline);
+		return -1;
+	}
+	if (!gst_element_link(src, decoder)) {
+		parser = _make_parser(sample->caps);
+		if (parser == NULL) {
+			gst_object_unref(pipeline);
+			return -1;
+		}
+		gst_bin_add(GST_BIN(pipeline), parser);
+		if (!gst_element_link_many(src, parser, decoder, NULL)) {
+			gst_object_unref(pipeline);
+			return -1;
+		}
+	}
+
+	pad = gst_element_get_static_pad(sink, "sink");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, _count_probe_cb,
+			  &decoded, NULL);
+	gst_object_unref(pad);
+
+	/* Queued in appsrc, so that only decoding is timed */
+	for (l = sample->buffers->head; l != NULL; l = l->next) {
+		g_signal_emit_by_name(src, "push-buffer", l->data, &ret);
+	}
+	g_signal_emit_by_name(src, "end-of-stream", &ret);
+
+	bus = gst_element_get_bus(pipeline);
+	started = g_get_monotonic_time();
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	msg = gst_bus_timed_pop_filtered(
+		bus, MAFW_GST_RENDERER_DECODER_RANKING_TIMEOUT,
+		GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	if (msg != NULL) {
+		if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+			elapsed = g_get_monotonic_time() - started;
+		gst_message_unref(msg);
+	}
+
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(bus);
+	gst_object_unref(pipeline);
+
+	if (decoded == 0)
+		return -1;
+	return elapsed;
+}
+
+/*
+ * Runs in the measuring thread: times every software decoder that can
+ * handle the sample and ranks them.
+ */
+static void _measure_sample(gpointer data, gpointer user_data)
+{
+	Sample *sample = data;
+	GList *decoders, *candidates, *l;
+	GstCaps *codec_caps;
+	gchar *contents;
+	gsize length;
+
+	/* Decoders of the codec, whatever stream format they want */
+	codec_caps = gst_caps_from_string(sample->codec);
+	decoders = gst_element_factory_list_get_elements(
+		GST_ELEMENT_FACTORY_TYPE_DECODER, GST_RANK_MARGINAL);
+	candidates = gst_element_factory_list_filter(
+		decoders, codec_caps != NULL ? codec_caps : sample->caps,
+		GST_PAD_SINK, FALSE);
+	gst_plugin_feature_list_free(decoders);
+	if (codec_caps != NULL)
+		gst_caps_unref(codec_caps);
+
+	for (l = candidates; l != NULL; l = l->next) {
+		GstElementFactory *factory = l->data;
+		const gchar *klass;
+		gint64 usecs = -1;
+		gint run;
+
+		klass = gst_element_factory_get_metadata(
+			factory, GST_ELEMENT_METADATA_KLASS);
+		if (klass != NULL && strstr(klass, "Hardware") != NULL)
+			continue;
+
+		for (run = 0; run < MAFW_GST_RENDERER_DECODER_RANKING_RUNS;
+		     run++) {
+			gint64 elapsed = _measure(factory, sample);
+
+			if (elapsed < 0) {
+				usecs = -1;
+				break;
+			}
+			if (usecs < 0 || elapsed < usecs)
+				usecs = elapsed;
+		}
+		g_debug("%s: %s took %" G_GINT64_FORMAT " us", sample->codec,
+			GST_OBJECT_NAME(factory), usecs);
+
+		if (usecs > 0) {
+			G_LOCK(ranking);
+			g_key_file_set_integer(results, sample->codec,
+					       GST_OBJECT_NAME(factory),
+					       (gint) MIN(usecs, G_MAXINT));
+			G_UNLOCK(ranking);
+		}
+	}
+	gst_plugin_feature_list_free(candidates);
+
+	G_LOCK(ranking);
+	_update_fastest(sample->codec);
+	contents = g_key_file_to_data(results, &length, NULL);
+	G_UNLOCK(ranking);
+
+	if (!g_file_set_contents(results_path, contents, length, NULL))
+		g_warning("could not save %s", results_path);
+	g_free(contents);
+
+	_sample_free(sample);
+}
+
+static GstPadProbeReturn _sample_probe_cb(GstPad *pad, GstPadProbeInfo *info,
+					  gpointer data)
+{
+	Sample *sample = data;
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+		if (sample->caps == NULL)
+			return GST_PAD_PROBE_OK;
+
+		g_queue_push_tail(sample->buffers,
+				  gst_buffer_ref(GST_PAD_PROBE_INFO_BUFFER(info)));
+		if (g_queue_get_length(sample->buffers) <
+		    MAFW_GST_RENDERER_DECODER_RANKING_SAMPLE_BUFFERS)
+			return GST_PAD_PROBE_OK;
+
+		sample->complete = TRUE;
+		return GST_PAD_PROBE_REMOVE;
+	}
+
+	if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_CAPS) {
+		GstCaps *caps;
+		gboolean known;
+
+		/* Caps changing in the middle of the sample */
+		if (sample->caps != NULL)
+			return GST_PAD_PROBE_REMOVE;
+
+		gst_event_parse_caps(GST_PAD_PROBE_INFO_EVENT(info), &caps);
+		sample->codec = _codec_key(caps);
+
+		G_LOCK(ranking);
+		known = g_hash_table_contains(known_codecs, sample->codec);
+		if (!known) {
+			g_hash_table_add(known_codecs,
+					 g_strdup(sample->codec));
+		}
+		G_UNLOCK(ranking);
+
+		if (known)
+			return GST_PAD_PROBE_REMOVE;
+		sample->caps = gst_caps_ref(caps);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void _sample_probe_removed(gpointer data)
+{
+	Sample *sample = data;
+
+	if (sample->complete) {
+		g_thread_pool_push(measurer, sample, NULL);
+		return;
+	}
+
+	/* The stream ended before the sample was complete, try again
+	 * next time */
+	if (sample->caps != NULL) {
+		G_LOCK(ranking);
+		g_hash_table_remove(known_codecs, sample->codec);
+		G_UNLOCK(ranking);
+	}
+	_sample_free(sample);
+}
+
+static gpointer _init(gpointer data)
+{
+	GKeyFile *config;
+	gchar *path, **codecs;
+	gint i;
+
+	config = g_key_file_new();
+	path = g_build_filename(g_get_user_config_dir(),
+				MAFW_GST_RENDERER_DECODER_RANKING_CONFIG, NULL);
+	if (g_key_file_load_from_file(config, path, G_KEY_FILE_NONE, NULL)) {
+		enabled = g_key_file_get_boolean(config, "ranking",
+						 "self-tune", NULL);
+	}
+	g_free(path);
+	g_key_file_free(config);
+
+	if (!enabled)
+		return NULL;
+
+	path = g_build_filename(g_get_user_cache_dir(),
+				MAFW_GST_RENDERER_DECODER_RANKING_DIR, NULL);
+	g_mkdir_with_parents(path, 0700);
+	results_path = g_build_filename(path,
+					MAFW_GST_RENDERER_DECODER_RANKING_FILE,
+					NULL);
+	g_free(path);
+
+	results = g_key_file_new();
+	g_key_file_load_from_file(results, results_path, G_KEY_FILE_NONE,
+				  NULL);
+	known_codecs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					     NULL);
+	fastest = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					g_free);
+
+	codecs = g_key_file_get_groups(results, NULL);
+	for (i = 0; codecs[i] != NULL; i++) {
+		g_hash_table_add(known_codecs, g_strdup(codecs[i]));
+		_update_fastest(codecs[i]);
+	}
+	g_strfreev(codecs);
+
+	/* One at a time, measuring is not meant to compete with playback */
+	measurer = g_thread_pool_new(_measure_sample, NULL, 1, FALSE, NULL);
+
+	return NULL;
+}
+
+/**
+ * mafw_gst_renderer_decoder_ranking_init:
+ *
+ * Loads the decoder timings measured so far, if self-tuning is enabled.
+ * Must be called before building pipelines for the ranking to apply to
+ * them.
+ */
+void mafw_gst_renderer_decoder_ranking_init(void)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	g_once(&once, _init, NULL);
+}
+
+/**
+ * mafw_gst_renderer_decoder_ranking_sort:
+ * @caps: the caps decodebin is plugging an element for.
+ * @factories: the factories it is about to try, in order.
+ *
+ * Moves the fastest decoder measured for the codec of @caps ahead of the
+ * other decoders measured for it.  Parsers and the like keep their place,
+ * and the registry ranks are left alone.
+ *
+ * Returns: the new order, or %NULL to keep @factories as they are.
+ */
+GValueArray *mafw_gst_renderer_decoder_ranking_sort(GstCaps *caps,
+						    GValueArray *factories)
+{
+	GValueArray *sorted;
+	const gchar *best;
+	gchar *codec;
+	gint first = -1, best_index = -1;
+	guint i;
+
+	g_return_val_if_fail(GST_IS_CAPS(caps), NULL);
+
+	if (results == NULL || gst_caps_is_empty(caps) ||
+	    gst_caps_is_any(caps) || factories->n_values < 2)
+		return NULL;
+
+	codec = _codec_key(caps);
+	G_LOCK(ranking);
+	best = g_hash_table_lookup(fastest, codec);
+	for (i = 0; best != NULL && i < factories->n_values; i++) {
+		GstObject *factory = g_value_get_object(
+			g_value_array_get_nth(factories, i));
+
+		if (!g_key_file_has_key(results, codec,
+					GST_OBJECT_NAME(factory), NULL))
+			continue;
+		if (first < 0)
+			first = i;
+		if (!strcmp(GST_OBJECT_NAME(factory), best))
+			best_index = i;
+	}
+	G_UNLOCK(ranking);
+	g_free(codec);
+
+	if (best_index <= first)
+		return NULL;
+
+	sorted = g_value_array_new(factories->n_values);
+	for (i = 0; i < factories->n_values; i++) {
+		if (i == first)
+			g_value_array_append(
+				sorted,
+				g_value_array_get_nth(factories, best_index));
+		if (i != best_index)
+			g_value_array_append(
+				sorted, g_value_array_get_nth(factories, i));
+	}
+
+	return sorted;
+}
+
+/*
+ * Runs after the handlers of the autoplug cache, which know what the
+ * media itself was decoded with last time.
+ */
+static GValueArray *_autoplug_sort_cb(GstElement *uridecodebin, GstPad *pad,
+				      GstCaps *caps, GValueArray *factories,
+				      gpointer data)
+{
+	return mafw_gst_renderer_decoder_ranking_sort(caps, factories);
+}
+
+/**
+ * mafw_gst_renderer_decoder_ranking_watch:
+ * @element: an element just created for playback.
+ *
+ * Makes uridecodebin prefer the fastest decoders measured.  If @element
+ * is a decoder for a codec that has not been measured yet, records the
+ * beginning of the stream it gets.  All the software decoders for that
+ * codec are then timed on it in the background, and the fastest one is
+ * preferred from then on.
+ */
+void mafw_gst_renderer_decoder_ranking_watch(GstElement *element)
+{
+	GstElementFactory *factory;
+	GstPad *pad;
+	Sample *sample;
+
+	g_return_if_fail(GST_IS_ELEMENT(element));
+
+	if (!enabled)
+		return;
+
+	factory = gst_element_get_factory(element);
+	if (factory == NULL)
+		return;
+	if (!strcmp(GST_OBJECT_NAME(factory), "uridecodebin")) {
+		g_signal_connect_after(element, "autoplug-sort",
+				       G_CALLBACK(_autoplug_sort_cb), NULL);
+		return;
+	}
+	if (!gst_element_factory_list_is_type(
+		    factory, GST_ELEMENT_FACTORY_TYPE_DECODER))
+		return;
+
+	pad = gst_element_get_static_pad(element, "sink");
+	if (pad == NULL)
+		return;
+
+	sample = g_new0(Sample, 1);
+	sample->buffers = g_queue_new();
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER |
+			  GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+			  _sample_probe_cb, sample, _sample_probe_removed);
+	gst_object_unref(pad);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
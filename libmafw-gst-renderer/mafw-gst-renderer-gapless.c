@@ -0,0 +1,427 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "mafw-gst-renderer-gapless.h"
+#include "mafw-gst-renderer-media-cache.h"
+#include "mafw-gst-renderer-utils.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-gapless"
+
+/* Trims found so far, in nanoseconds, in the media cache */
+#define GAPLESS_KEY_START "gapless-start"
+#define GAPLESS_KEY_STOP "gapless-stop"
+
+/* Samples MP3 decoders output before the first encoded one */
+#define MP3_DECODER_DELAY 529
+/* Bytes read to find the first MP3 frame */
+#define MP3_HEADER_SIZE 4096
+
+struct _MafwGstRendererGaplessProbe {
+	gint ref;
+	GMutex lock;
+	gchar *uri;
+	gchar *filename;
+	gint64 size;
+	gint64 mtime;
+	MafwGstRendererGaplessFunc func;
+	gpointer data;
+	GDestroyNotify destroy;
+};
+
+G_LOCK_DEFINE_STATIC(gapless);
+/* Probes the files in the background, one at a time */
+static GThreadPool *prober;
+
+/*
+ * LAME (and FFmpeg) put the encoder delay and padding in the Xing/Info
+ * frame, the first one of the file.
+ */
+static gboolean _probe_mp3(FILE *file, gint64 *start, gint64 *stop)
+{
+	static const gint rates[] = { 44100, 48000, 32000 };
+	guchar buf[MP3_HEADER_SIZE];
+	const guchar *h, *p;
+	gsize len, i;
+	gint version, rate_index, rate, spf, side_info;
+	guint32 flags, frames = 0;
+	guint delay, padding;
+	guint64 skip;
+
+	/* Skip the ID3v2 tag */
+	len = fread(buf, 1, 10, file);
+	if (len == 10 && !memcmp(buf, "ID3", 3)) {
+		glong size = (buf[6] << 21) | (buf[7] << 14) |
+			(buf[8] << 7) | buf[9];
+
+		size += (buf[5] & 0x10) ? 20 : 10;
+		if (fseek(file, size, SEEK_SET) != 0)
+			return FALSE;
+	} else if (fseek(file, 0, SEEK_SET) != 0) {
+		return FALSE;
+	}
+
+	len = fread(buf, 1, sizeof(buf), file);
+	for (i = 0; i + 4 <= len; i++) {
+		if (buf[i] == 0xff && (buf[i + 1] & 0xe0) == 0xe0)
+			break;
+	}
+	if (i + 4 > len)
+		return FALSE;
+
+	h = buf + i;
+	version = (h[1] >> 3) & 3;	/* 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5 */
+	rate_index = (h[2] >> 2) & 3;
+	if (version == 1 || ((h[1] >> 1) & 3) != 1 || rate_index == 3)
+		return FALSE;
+	rate = rates[rate_index] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+	spf = version == 3 ? 1152 : 576;
+	if (version == 3)
+		side_info = ((h[3] >> 6) == 3) ? 17 : 32;
+	else
+		side_info = ((h[3] >> 6) == 3) ? 9 : 17;
+
+	p = h + 4 + side_info;
+	if (p + 8 > buf + len ||
+	    (memcmp(p, "Xing", 4) && memcmp(p, "Info", 4)))
+		return FALSE;
+
+	flags = GST_READ_UINT32_BE(p + 4);
+	p += 8;
+	if (flags & 1) {
+		frames = GST_READ_UINT32_BE(p);
+		p += 4;
+	}
+	if (flags & 2)
+		p += 4;
+	if (flags & 4)
+		p += 100;
+	if (flags & 8)
+		p += 4;
+	if (p + 24 > buf + len ||
+	    (memcmp(p, "LAME", 4) && memcmp(p, "Lavc", 4) &&
+	     memcmp(p, "Lavf", 4)))
+		return FALSE;
+
+	delay = (p[21] << 4) | (p[22] >> 4);
+	padding = ((p[22] & 0x0f) << 8) | p[23];
+
+	/* Decoders unaware of it decode the Info frame as one frame of
+	 * silence */
+	skip = spf + delay + MP3_DECODER_DELAY;
+	*start = gst_util_uint64_scale_int(skip, GST_SECOND, rate);
+	*stop = -1;
+	if (frames > 0 && (guint64) frames * spf > delay + padding) {
+		*stop = gst_util_uint64_scale_int(
+			spf + (guint64) frames * spf - padding +
+			MP3_DECODER_DELAY, GST_SECOND, rate);
+	}
+
+	return TRUE;
+}
+
+/*
+ * iTunes puts the encoder delay and padding in an iTunSMPB comment:
+ * " 00000000 <delay> <padding> <samples> ..." in hexadecimal.
+ */
+static gboolean _probe_mp4(FILE *file, gint64 *start, gint64 *stop)
+{
+	guchar *moov;
+	const guchar *trak, *mdia, *mdhd, *smpb, *data;
+	gsize moov_size = 0, size = 0, mdia_size = 0, mdhd_size = 0;
+	gsize edts_size = 0;
+	guint32 timescale = 0;
+	gchar *comment, **fields;
+	gboolean ret = FALSE;
+
+	moov = mp4_read_moov(file, &moov_size);
+	if (moov == NULL)
+		return FALSE;
+
+	/* Time scale of the sound track, the trims are counted in its
+	 * samples */
+	trak = mp4_find_track(moov, moov_size, "soun", &size);
+	if (trak == NULL)
+		goto out;
+	/* The demuxer applies edit lists itself */
+	if (mp4_find_atom(trak, size, "edts", &edts_size) != NULL)
+		goto out;
+	mdia = mp4_find_atom(trak, size, "mdia", &mdia_size);
+	if (mdia == NULL)
+		goto out;
+	mdhd = mp4_find_atom(mdia, mdia_size, "mdhd", &mdhd_size);
+	if (mdhd != NULL && mdhd_size >= 24)
+		timescale = GST_READ_UINT32_BE(mdhd +
+					       (mdhd[0] == 1 ? 20 : 12));
+	if (timescale == 0)
+		goto out;
+
+	smpb = (const guchar *)
+		g_strstr_len((const gchar *) moov, moov_size, "iTunSMPB");
+	if (smpb == NULL)
+		goto out;
+	data = (const guchar *)
+		g_strstr_len((const gchar *) smpb,
+			     moov + moov_size - smpb, "data");
+	if (data == NULL || data - 4 < moov || data + 12 > moov + moov_size)
+		goto out;
+	size = GST_READ_UINT32_BE(data - 4);
+	if (size < 16 || data - 4 + size > moov + moov_size)
+		goto out;
+
+	comment = g_strndup((const gchar *) data + 12, size - 16);
+	fields = g_strsplit_set(g_strstrip(comment), " ", -1);
+	if (g_strv_length(fields) >= 4) {
+		guint64 delay = g_ascii_strtoull(fields[1], NULL, 16);
+		guint64 samples = g_ascii_strtoull(fields[3], NULL, 16);
+
+		*start = gst_util_uint64_scale_int(delay, GST_SECOND,
+						   timescale);
+		*stop = samples > 0 ?
+			(gint64) gst_util_uint64_scale_int(delay + samples,
+							   GST_SECOND,
+							   timescale) : -1;
+		ret = TRUE;
+	}
+	g_strfreev(fields);
+	g_free(comment);
+
+out:
+	g_free(moov);
+	return ret;
+}
+
+/*
+ * MP3 parsers from GStreamer 1.22 on trim the LAME delay and padding
+ * themselves.
+ */
+static gboolean _parser_trims_mp3(void)
+{
+	GstPluginFeature *parser;
+	gboolean trims;
+
+	parser = gst_registry_lookup_feature(gst_registry_get(),
+					     "mpegaudioparse");
+	if (parser == NULL)
+		return FALSE;
+	trims = gst_plugin_feature_check_version(parser, 1, 22, 0);
+	gst_object_unref(parser);
+
+	return trims;
+}
+
+static gboolean _probe(const gchar *filename, gint64 *start, gint64 *stop)
+{
+	FILE *file;
+	gchar *lower;
+	gboolean found = FALSE;
+
+	file = g_fopen(filename, "rb");
+	if (file == NULL)
+		return FALSE;
+
+	lower = g_ascii_strdown(filename, -1);
+	if (g_str_has_suffix(lower, ".mp3")) {
+		if (!_parser_trims_mp3())
+			found = _probe_mp3(file, start, stop);
+	} else if (g_str_has_suffix(lower, ".m4a") ||
+		   g_str_has_suffix(lower, ".mp4") ||
+		   g_str_has_suffix(lower, ".aac")) {
+		found = _probe_mp4(file, start, stop);
+	}
+	g_free(lower);
+	fclose(file);
+
+	return found;
+}
+
+static void _probe_unref(MafwGstRendererGaplessProbe *probe)
+{
+	if (!g_atomic_int_dec_and_test(&probe->ref))
+		return;
+	g_mutex_clear(&probe->lock);
+	g_free(probe->uri);
+	g_free(probe->filename);
+	g_free(probe);
+}
+
+/*
+ * Runs in the prober thread: reads the file, caches what it found and
+ * hands it to whoever is still waiting for it.
+ */
+static void _probe_thread(gpointer data, gpointer user_data)
+{
+	MafwGstRendererGaplessProbe *probe = data;
+	GKeyFile *cache;
+	gint64 start, stop;
+
+	if (!_probe(probe->filename, &start, &stop)) {
+		start = 0;
+		stop = -1;
+	}
+	if (start > 0 || stop >= 0) {
+		g_debug("%s: music from %" GST_TIME_FORMAT " to %"
+			GST_TIME_FORMAT, probe->uri, GST_TIME_ARGS(start),
+			GST_TIME_ARGS(stop));
+	}
+
+	cache = mafw_gst_renderer_media_cache_lock(probe->uri, probe->size,
+						   probe->mtime);
+	g_key_file_set_int64(cache, probe->uri, GAPLESS_KEY_START, start);
+	g_key_file_set_int64(cache, probe->uri, GAPLESS_KEY_STOP, stop);
+	mafw_gst_renderer_media_cache_unlock(TRUE);
+
+	g_mutex_lock(&probe->lock);
+	if (probe->func != NULL)
+		probe->func(start, stop, probe->data);
+	probe->func = NULL;
+	probe->data = NULL;
+	probe->destroy = NULL;
+	g_mutex_unlock(&probe->lock);
+
+	_probe_unref(probe);
+}
+
+/**
+ * mafw_gst_renderer_gapless_lookup:
+ * @uri: a media URI.
+ * @start: where to return the position the music starts at.
+ * @stop: where to return the position the music ends at, -1 if unknown.
+ * @func: called with the trims if @uri has not been looked into yet.
+ * @data: user data for @func, which takes it over.
+ * @destroy: frees @data if @func is not called.
+ *
+ * Finds the encoder delay and padding of @uri, which are silence added
+ * by the encoder and have to be cut for albums to play without gaps.
+ * Only local MP3 files with a LAME header and AAC files with iTunes
+ * gapless information are looked into.  The results are cached.
+ *
+ * Files are read in a thread of their own, never in the caller's: if the
+ * trims of @uri are not cached, @start and @stop are left with no trims
+ * and @func gets them later, in that thread, unless the returned probe is
+ * cancelled first.
+ *
+ * Returns: the probe to cancel with mafw_gst_renderer_gapless_cancel()
+ * once @func is not wanted any more, %NULL if @start and @stop already
+ * hold the trims.
+ */
+MafwGstRendererGaplessProbe *mafw_gst_renderer_gapless_lookup(
+	const gchar *uri, gint64 *start, gint64 *stop,
+	MafwGstRendererGaplessFunc func, gpointer data, GDestroyNotify destroy)
+{
+	MafwGstRendererGaplessProbe *probe = NULL;
+	GKeyFile *cache;
+	gchar *filename;
+	GStatBuf st;
+	gboolean cached;
+
+	g_return_val_if_fail(start != NULL && stop != NULL, NULL);
+
+	*start = 0;
+	*stop = -1;
+	if (uri == NULL || !g_str_has_prefix(uri, "file://"))
+		goto out;
+	filename = g_filename_from_uri(uri, NULL, NULL);
+	if (filename == NULL || g_stat(filename, &st) != 0) {
+		g_free(filename);
+		goto out;
+	}
+
+	cache = mafw_gst_renderer_media_cache_lock(uri, st.st_size,
+						   st.st_mtime);
+	cached = g_key_file_has_key(cache, uri, GAPLESS_KEY_START, NULL);
+	if (cached) {
+		*start = g_key_file_get_int64(cache, uri, GAPLESS_KEY_START,
+					      NULL);
+		*stop = g_key_file_get_int64(cache, uri, GAPLESS_KEY_STOP,
+					     NULL);
+	}
+	mafw_gst_renderer_media_cache_unlock(FALSE);
+	if (cached) {
+		g_free(filename);
+		goto out;
+	}
+
+	probe = g_new0(MafwGstRendererGaplessProbe, 1);
+	/* One for the prober, one for the caller */
+	probe->ref = 2;
+	g_mutex_init(&probe->lock);
+	probe->uri = g_strdup(uri);
+	probe->filename = filename;
+	probe->size = st.st_size;
+	probe->mtime = st.st_mtime;
+	probe->func = func;
+	probe->data = data;
+	probe->destroy = destroy;
+	G_LOCK(gapless);
+	if (prober == NULL)
+		prober = g_thread_pool_new(_probe_thread, NULL, 1, FALSE,
+					   NULL);
+	g_thread_pool_push(prober, probe, NULL);
+	G_UNLOCK(gapless);
+
+out:
+	if (probe == NULL && destroy != NULL)
+		destroy(data);
+	return probe;
+}
+
+/**
+ * mafw_gst_renderer_gapless_cancel:
+ * @probe: a probe mafw_gst_renderer_gapless_lookup() returned.
+ *
+ * Makes sure the callback of @probe is not called any more, waiting for
+ * it if it is running, and frees @probe.  The file is still looked into,
+ * for the next time.
+ */
+void mafw_gst_renderer_gapless_cancel(MafwGstRendererGaplessProbe *probe)
+{
+	gpointer data;
+	GDestroyNotify destroy;
+
+	g_return_if_fail(probe != NULL);
+
+	g_mutex_lock(&probe->lock);
+	data = probe->data;
+	destroy = probe->destroy;
+	probe->func = NULL;
+	probe->data = NULL;
+	probe->destroy = NULL;
+	g_mutex_unlock(&probe->lock);
+
+	if (destroy != NULL)
+		destroy(data);
+	_probe_unref(probe);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
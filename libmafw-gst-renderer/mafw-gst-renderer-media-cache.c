@@ -0,0 +1,167 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mafw-gst-renderer-media-cache.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-media-cache"
+
+/* What was found out about each media, in the user cache directory.  The
+ * groups are URIs, with the size and modification time of local files and
+ * the keys of the modules that looked into them. */
+#define MAFW_GST_RENDERER_MEDIA_CACHE_DIR "mafw-gst-renderer"
+#define MAFW_GST_RENDERER_MEDIA_CACHE_FILE "media"
+#define MAFW_GST_RENDERER_MEDIA_CACHE_MAX_ENTRIES 2000
+
+/* What each module used to keep on its own */
+static const gchar *old_files[] = { "gapless", "autoplug", NULL };
+
+G_LOCK_DEFINE_STATIC(media_cache);
+static GKeyFile *cache;
+static gchar *cache_path;
+/* The media the cache is locked for */
+static gchar *locked_uri;
+static gint64 locked_size;
+static gint64 locked_mtime;
+/* Writes the cache in the background, one save at a time */
+static GThreadPool *saver;
+static gboolean save_queued;
+
+static gpointer _load_cache(gpointer data)
+{
+	gchar *dir, *path;
+	gint i;
+
+	dir = g_build_filename(g_get_user_cache_dir(),
+			       MAFW_GST_RENDERER_MEDIA_CACHE_DIR, NULL);
+	g_mkdir_with_parents(dir, 0700);
+	cache_path = g_build_filename(dir, MAFW_GST_RENDERER_MEDIA_CACHE_FILE,
+				      NULL);
+	for (i = 0; old_files[i] != NULL; i++) {
+		path = g_build_filename(dir, old_files[i], NULL);
+		g_unlink(path);
+		g_free(path);
+	}
+	g_free(dir);
+
+	cache = g_key_file_new();
+	g_key_file_load_from_file(cache, cache_path, G_KEY_FILE_NONE, NULL);
+
+	return NULL;
+}
+
+/*
+ * Runs in the saver thread.  Changes made while the file is written are
+ * saved by the next run.
+ */
+static void _save(gpointer data, gpointer user_data)
+{
+	gchar *contents;
+	gsize length;
+
+	G_LOCK(media_cache);
+	contents = g_key_file_to_data(cache, &length, NULL);
+	save_queued = FALSE;
+	G_UNLOCK(media_cache);
+
+	if (!g_file_set_contents(cache_path, contents, length, NULL))
+		g_warning("could not save %s", cache_path);
+	g_free(contents);
+}
+
+/**
+ * mafw_gst_renderer_media_cache_lock:
+ * @uri: a media URI.
+ * @size: size of the file @uri is, 0 if it is not a local file.
+ * @mtime: modification time of the file, 0 if it is not a local file.
+ *
+ * Locks the media cache, for the caller to read and write the keys of
+ * group @uri.  What was cached about a file that changed since is
+ * dropped first.  Unlock with mafw_gst_renderer_media_cache_unlock().
+ *
+ * Returns: the cache.
+ */
+GKeyFile *mafw_gst_renderer_media_cache_lock(const gchar *uri, gint64 size,
+					     gint64 mtime)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	g_return_val_if_fail(uri != NULL, NULL);
+
+	g_once(&once, _load_cache, NULL);
+
+	G_LOCK(media_cache);
+	if (g_key_file_has_group(cache, uri) &&
+	    (g_key_file_get_int64(cache, uri, "size", NULL) != size ||
+	     g_key_file_get_int64(cache, uri, "mtime", NULL) != mtime))
+		g_key_file_remove_group(cache, uri, NULL);
+	locked_uri = g_strdup(uri);
+	locked_size = size;
+	locked_mtime = mtime;
+
+	return cache;
+}
+
+/**
+ * mafw_gst_renderer_media_cache_unlock:
+ * @changed: whether the caller changed the cache.
+ *
+ * Unlocks the media cache.  If it was changed, it is written in the
+ * background, never by the caller.
+ */
+void mafw_gst_renderer_media_cache_unlock(gboolean changed)
+{
+	if (changed && g_key_file_has_group(cache, locked_uri)) {
+		gchar **uris;
+		gsize count;
+
+		g_key_file_set_int64(cache, locked_uri, "size", locked_size);
+		g_key_file_set_int64(cache, locked_uri, "mtime", locked_mtime);
+
+		/* The oldest media go first */
+		uris = g_key_file_get_groups(cache, &count);
+		if (count > MAFW_GST_RENDERER_MEDIA_CACHE_MAX_ENTRIES &&
+		    g_strcmp0(uris[0], locked_uri))
+			g_key_file_remove_group(cache, uris[0], NULL);
+		g_strfreev(uris);
+	}
+	if (changed && !save_queued) {
+		if (saver == NULL)
+			saver = g_thread_pool_new(_save, NULL, 1, FALSE, NULL);
+		save_queued = TRUE;
+		g_thread_pool_push(saver, GINT_TO_POINTER(1), NULL);
+	}
+	g_free(locked_uri);
+	locked_uri = NULL;
+	G_UNLOCK(media_cache);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -0,0 +1,742 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <gst/base/gstbaseparse.h>
+
+#include "mafw-gst-renderer-seek-index.h"
+#include "mafw-gst-renderer-utils.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-seek-index"
+
+/* One index file per media in the user cache directory, named after the
+ * hash of its URI */
+#define MAFW_GST_RENDERER_SEEK_INDEX_DIR "mafw-gst-renderer"
+#define MAFW_GST_RENDERER_SEEK_INDEX_SUBDIR "seek-index"
+#define MAFW_GST_RENDERER_SEEK_INDEX_MAX_ENTRIES 2000
+#define MAFW_GST_RENDERER_SEEK_INDEX_MAGIC "MSIX"
+#define MAFW_GST_RENDERER_SEEK_INDEX_VERSION 1
+
+/* Milliseconds between two entries of an MP3 index */
+#define MP3_INDEX_INTERVAL 1000
+/* Larger MP3 files are not scanned */
+#define MP3_MAX_SIZE (256 * 1024 * 1024)
+/* Keyframes further apart make a video worth indexing, and seeks that
+ * far from a keyframe decode up to the position */
+#define MP4_SPARSE_KEYFRAMES (2 * GST_SECOND)
+
+#define INDEX_KEY "mafw-seek-index"
+
+typedef enum {
+	SEEK_INDEX_NONE,	/* The demuxer seeks well on its own */
+	SEEK_INDEX_MP3,		/* VBR MP3 without a table of contents */
+	SEEK_INDEX_MP4,		/* Video with sparse keyframes */
+} SeekIndexKind;
+
+/*
+ * Header of an index file, followed by @n entries.
+ *
+ * size:      Size of the file indexed
+ * mtime:     Its modification time
+ * duration:  Exact duration in nanoseconds, -1 if the demuxer knows it
+ * kind:      SeekIndexKind
+ */
+typedef struct {
+	gchar magic[4];
+	guint32 version;
+	gint64 size;
+	gint64 mtime;
+	gint64 duration;
+	guint32 kind;
+	guint32 n;
+} SeekIndexHeader;
+
+/*
+ * time:      Milliseconds from the start of the media
+ * offset:    Bytes from the first audio frame, MP3 only
+ */
+typedef struct {
+	guint32 time;
+	guint32 offset;
+} SeekIndexEntry;
+
+/*
+ * The index of one media, attached to the pipeline playing it.
+ *
+ * ref:       References, from the pipeline and the parser fed from it
+ * kind:      SeekIndexKind
+ * duration:  Exact duration, -1 if unknown
+ * entries:   Keyframes (MP4), or frames a second apart (MP3)
+ */
+typedef struct {
+	gint ref;
+	SeekIndexKind kind;
+	gint64 duration;
+	GArray *entries;
+} MafwGstRendererSeekIndex;
+
+G_LOCK_DEFINE_STATIC(seek_index);
+static GThreadPool *scanner;
+/* URIs queued for scanning */
+static GHashTable *pending;
+
+static const guint mp3_rates[] = { 44100, 48000, 32000 };
+static const guint16 mp3_bitrates[2][15] = {
+	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+};
+
+static MafwGstRendererSeekIndex *_index_new(void)
+{
+	MafwGstRendererSeekIndex *index;
+
+	index = g_new0(MafwGstRendererSeekIndex, 1);
+	index->ref = 1;
+	index->kind = SEEK_INDEX_NONE;
+	index->duration = -1;
+	index->entries = g_array_new(FALSE, FALSE, sizeof(SeekIndexEntry));
+
+	return index;
+}
+
+static MafwGstRendererSeekIndex *_index_ref(MafwGstRendererSeekIndex *index)
+{
+	g_atomic_int_inc(&index->ref);
+	return index;
+}
+
+static void _index_unref(gpointer data)
+{
+	MafwGstRendererSeekIndex *index = data;
+
+	if (!g_atomic_int_dec_and_test(&index->ref))
+		return;
+
+	g_array_free(index->entries, TRUE);
+	g_free(index);
+}
+
+static MafwGstRendererSeekIndex *_get_index(GstElement *pipeline)
+{
+	if (pipeline == NULL)
+		return NULL;
+	return g_object_get_data(G_OBJECT(pipeline), INDEX_KEY);
+}
+
+static gchar *_index_path(const gchar *uri)
+{
+	gchar *hash, *path;
+
+	hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri, -1);
+	path = g_build_filename(g_get_user_cache_dir(),
+				MAFW_GST_RENDERER_SEEK_INDEX_DIR,
+				MAFW_GST_RENDERER_SEEK_INDEX_SUBDIR, hash, NULL);
+	g_free(hash);
+
+	return path;
+}
+
+static gboolean _indexable(const gchar *filename)
+{
+	gchar *lower;
+	gboolean indexable;
+
+	lower = g_ascii_strdown(filename, -1);
+	indexable = g_str_has_suffix(lower, ".mp3") ||
+		g_str_has_suffix(lower, ".mp4") ||
+		g_str_has_suffix(lower, ".m4v") ||
+		g_str_has_suffix(lower, ".mov");
+	g_free(lower);
+
+	return indexable;
+}
+
+/*
+ * Returns the length of the MPEG audio layer III frame at @p, 0 if
+ * there is none.
+ */
+static guint _mp3_frame(const guchar *p, guint *rate, guint *samples,
+			guint *bitrate)
+{
+	gint version, bitrate_index, rate_index;
+
+	if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+		return 0;
+	version = (p[1] >> 3) & 3;	/* 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5 */
+	bitrate_index = p[2] >> 4;
+	rate_index = (p[2] >> 2) & 3;
+	if (version == 1 || ((p[1] >> 1) & 3) != 1 || bitrate_index == 0 ||
+	    bitrate_index == 15 || rate_index == 3)
+		return 0;
+
+	*rate = mp3_rates[rate_index] >>
+		(version == 3 ? 0 : version == 2 ? 1 : 2);
+	*bitrate = mp3_bitrates[version == 3 ? 0 : 1][bitrate_index] * 1000;
+	*samples = version == 3 ? 1152 : 576;
+
+	return (version == 3 ? 144 : 72) * *bitrate / *rate +
+		((p[2] >> 1) & 1);
+}
+
+/*
+ * The parser seeks VBR files well with the table of contents of a Xing
+ * or VBRI header, and CBR files (flagged by an Info header) on its own.
+ */
+static gboolean _mp3_seeks_well(const guchar *p, gsize size)
+{
+	gint version = (p[1] >> 3) & 3;
+	gboolean mono = (p[3] >> 6) == 3;
+	gsize side_info;
+	const guchar *tag;
+
+	if (version == 3)
+		side_info = mono ? 17 : 32;
+	else
+		side_info = mono ? 9 : 17;
+	tag = p + 4 + side_info;
+
+	if (size >= 4 + side_info + 8) {
+		if (!memcmp(tag, "Info", 4))
+			return TRUE;
+		if (!memcmp(tag, "Xing", 4) &&
+		    (GST_READ_UINT32_BE(tag + 4) & 4))
+			return TRUE;
+	}
+	return size >= 4 + 32 + 4 && !memcmp(p + 4 + 32, "VBRI", 4);
+}
+
+/*
+ * Walks all the frames of a VBR MP3 file, to count its samples and
+ * index a frame every MP3_INDEX_INTERVAL.
+ */
+static gboolean _scan_mp3(const guchar *data, gsize size,
+			  MafwGstRendererSeekIndex *index)
+{
+	gsize pos = 0, start;
+	guint rate = 0, first_bitrate = 0;
+	guint64 samples_total = 0, next = 0;
+	gboolean vbr = FALSE;
+
+	/* The tag demuxer strips the ID3v2 tag before the parser */
+	if (size >= 10 && !memcmp(data, "ID3", 3)) {
+		pos = ((data[6] & 0x7f) << 21) | ((data[7] & 0x7f) << 14) |
+			((data[8] & 0x7f) << 7) | (data[9] & 0x7f);
+		pos += (data[5] & 0x10) ? 20 : 10;
+	}
+	start = pos;
+
+	while (pos + 4 <= size) {
+		guint frame_rate, samples, bitrate, len;
+		guint64 time;
+
+		len = _mp3_frame(data + pos, &frame_rate, &samples, &bitrate);
+		if (len == 0 || (rate != 0 && frame_rate != rate)) {
+			/* Junk between the frames, or tags after them */
+			pos++;
+			continue;
+		}
+		if (pos + len > size)
+			break;
+
+		if (rate == 0) {
+			if (_mp3_seeks_well(data + pos, size - pos))
+				return FALSE;
+			rate = frame_rate;
+			first_bitrate = bitrate;
+		} else if (bitrate != first_bitrate) {
+			vbr = TRUE;
+		}
+
+		time = samples_total * 1000 / rate;
+		if (time >= next) {
+			SeekIndexEntry entry = { time, pos - start };
+
+			g_array_append_val(index->entries, entry);
+			next = time + MP3_INDEX_INTERVAL;
+		}
+		samples_total += samples;
+		pos += len;
+	}
+	if (!vbr)
+		return FALSE;
+
+	index->duration = gst_util_uint64_scale_int(samples_total, GST_SECOND,
+						    rate);
+	return TRUE;
+}
+
+/*
+ * Reads the decoding times of the keyframes of the video track, from
+ * its sync sample (stss) and time to sample (stts) tables.
+ */
+static gboolean _scan_mp4(FILE *file, MafwGstRendererSeekIndex *index)
+{
+	guchar *moov;
+	const guchar *trak, *mdia, *mdhd, *minf, *stbl, *stss, *stts;
+	gsize moov_size = 0, trak_size = 0, mdia_size = 0, mdhd_size = 0;
+	gsize minf_size = 0, stbl_size = 0, stss_size = 0, stts_size = 0;
+	guint32 timescale, n_sync, n_runs, run = 0, run_done = 0, i;
+	guint64 sample = 1, dts = 0, previous = 0;
+	gboolean sparse = FALSE;
+
+	moov = mp4_read_moov(file, &moov_size);
+	if (moov == NULL)
+		return FALSE;
+
+	trak = mp4_find_track(moov, moov_size, "vide", &trak_size);
+	if (trak == NULL)
+		goto out;
+	mdia = mp4_find_atom(trak, trak_size, "mdia", &mdia_size);
+	if (mdia == NULL)
+		goto out;
+	mdhd = mp4_find_atom(mdia, mdia_size, "mdhd", &mdhd_size);
+	if (mdhd == NULL || mdhd_size < 24)
+		goto out;
+	minf = mp4_find_atom(mdia, mdia_size, "minf", &minf_size);
+	if (minf == NULL)
+		goto out;
+	timescale = GST_READ_UINT32_BE(mdhd + (mdhd[0] == 1 ? 20 : 12));
+	if (timescale == 0)
+		goto out;
+	stbl = mp4_find_atom(minf, minf_size, "stbl", &stbl_size);
+	if (stbl == NULL)
+		goto out;
+
+	/* Without a sync sample table every frame is a keyframe */
+	stss = mp4_find_atom(stbl, stbl_size, "stss", &stss_size);
+	if (stss == NULL || stss_size < 8)
+		goto out;
+	stts = mp4_find_atom(stbl, stbl_size, "stts", &stts_size);
+	if (stts == NULL || stts_size < 8)
+		goto out;
+	n_sync = GST_READ_UINT32_BE(stss + 4);
+	n_runs = GST_READ_UINT32_BE(stts + 4);
+	if (stss_size < 8 + (guint64) n_sync * 4 ||
+	    stts_size < 8 + (guint64) n_runs * 8)
+		goto out;
+
+	for (i = 0; i < n_sync; i++) {
+		guint32 keyframe = GST_READ_UINT32_BE(stss + 8 + i * 4);
+		SeekIndexEntry entry;
+
+		/* Add up the durations of the samples before it */
+		while (sample < keyframe && run < n_runs) {
+			guint32 count = GST_READ_UINT32_BE(stts + 8 + run * 8);
+			guint32 delta = GST_READ_UINT32_BE(stts + 12 + run * 8);
+			guint64 step = MIN(count - run_done,
+					   keyframe - sample);
+
+			dts += step * delta;
+			sample += step;
+			run_done += step;
+			if (run_done >= count) {
+				run++;
+				run_done = 0;
+			}
+		}
+		if (sample < keyframe)
+			break;
+
+		entry.time = gst_util_uint64_scale_int(dts, 1000, timescale);
+		entry.offset = 0;
+		if (i > 0 && (entry.time - previous) * GST_MSECOND >
+		    MP4_SPARSE_KEYFRAMES)
+			sparse = TRUE;
+		previous = entry.time;
+		g_array_append_val(index->entries, entry);
+	}
+
+out:
+	g_free(moov);
+	return sparse;
+}
+
+/*
+ * Removes the index written the longest ago when there are too many.
+ */
+static void _prune(const gchar *dirname)
+{
+	GDir *dir;
+	const gchar *name;
+	gchar *oldest = NULL;
+	time_t oldest_mtime = 0;
+	guint count = 0;
+
+	dir = g_dir_open(dirname, 0, NULL);
+	if (dir == NULL)
+		return;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		gchar *path = g_build_filename(dirname, name, NULL);
+		GStatBuf st;
+
+		count++;
+		if (g_stat(path, &st) == 0 &&
+		    (oldest == NULL || st.st_mtime < oldest_mtime)) {
+			g_free(oldest);
+			oldest = path;
+			oldest_mtime = st.st_mtime;
+		} else {
+			g_free(path);
+		}
+	}
+	g_dir_close(dir);
+
+	if (count > MAFW_GST_RENDERER_SEEK_INDEX_MAX_ENTRIES && oldest != NULL)
+		g_unlink(oldest);
+	g_free(oldest);
+}
+
+static void _store(const gchar *uri, const GStatBuf *st,
+		   const MafwGstRendererSeekIndex *index)
+{
+	SeekIndexHeader header;
+	GByteArray *contents;
+	gchar *path, *dir;
+	GError *error = NULL;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAFW_GST_RENDERER_SEEK_INDEX_MAGIC, 4);
+	header.version = MAFW_GST_RENDERER_SEEK_INDEX_VERSION;
+	header.size = st->st_size;
+	header.mtime = st->st_mtime;
+	header.duration = index->duration;
+	header.kind = index->kind;
+	header.n = index->entries->len;
+
+	contents = g_byte_array_new();
+	g_byte_array_append(contents, (const guint8 *) &header,
+			    sizeof(header));
+	g_byte_array_append(contents, (const guint8 *) index->entries->data,
+			    index->entries->len * sizeof(SeekIndexEntry));
+
+	path = _index_path(uri);
+	dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0700);
+	if (!g_file_set_contents(path, (const gchar *) contents->data,
+				 contents->len, &error)) {
+		g_warning("could not save %s: %s", path, error->message);
+		g_error_free(error);
+	}
+	_prune(dir);
+
+	g_free(dir);
+	g_free(path);
+	g_byte_array_free(contents, TRUE);
+}
+
+/*
+ * Reads the index of @uri, if it was scanned since it last changed.
+ * Media that need no index have none.
+ */
+static gboolean _load(const gchar *uri, const GStatBuf *st,
+		      MafwGstRendererSeekIndex **index)
+{
+	SeekIndexHeader header;
+	gchar *path, *contents;
+	gsize length;
+	gboolean scanned = FALSE;
+
+	*index = NULL;
+	path = _index_path(uri);
+	if (!g_file_get_contents(path, &contents, &length, NULL)) {
+		g_free(path);
+		return FALSE;
+	}
+
+	if (length < sizeof(header))
+		goto out;
+	memcpy(&header, contents, sizeof(header));
+	if (memcmp(header.magic, MAFW_GST_RENDERER_SEEK_INDEX_MAGIC, 4) ||
+	    header.version != MAFW_GST_RENDERER_SEEK_INDEX_VERSION ||
+	    header.size != st->st_size || header.mtime != st->st_mtime ||
+	    length != sizeof(header) + header.n * sizeof(SeekIndexEntry))
+		goto out;
+
+	scanned = TRUE;
+	if (header.kind != SEEK_INDEX_NONE) {
+		*index = _index_new();
+		(*index)->kind = header.kind;
+		(*index)->duration = header.duration;
+		g_array_append_vals((*index)->entries,
+				    contents + sizeof(header), header.n);
+	}
+
+out:
+	g_free(contents);
+	g_free(path);
+	return scanned;
+}
+
+/*
+ * Runs in the scanner thread, at the lowest priority: indexes the media
+ * for its next plays.
+ */
+static void _scan(gpointer data, gpointer user_data)
+{
+	gchar *uri = data;
+	gchar *filename, *lower;
+	MafwGstRendererSeekIndex *index;
+	GStatBuf st;
+
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+	filename = g_filename_from_uri(uri, NULL, NULL);
+	if (filename == NULL || g_stat(filename, &st) != 0)
+		goto out;
+
+	index = _index_new();
+	lower = g_ascii_strdown(filename, -1);
+	if (g_str_has_suffix(lower, ".mp3")) {
+		GMappedFile *mapped = NULL;
+
+		if (st.st_size <= MP3_MAX_SIZE)
+			mapped = g_mapped_file_new(filename, FALSE, NULL);
+		if (mapped != NULL) {
+			if (_scan_mp3((const guchar *)
+				      g_mapped_file_get_contents(mapped),
+				      g_mapped_file_get_length(mapped),
+				      index))
+				index->kind = SEEK_INDEX_MP3;
+			g_mapped_file_unref(mapped);
+		}
+	} else {
+		FILE *file = g_fopen(filename, "rb");
+
+		if (file != NULL) {
+			if (_scan_mp4(file, index))
+				index->kind = SEEK_INDEX_MP4;
+			fclose(file);
+		}
+	}
+	g_free(lower);
+
+	if (index->kind == SEEK_INDEX_NONE) {
+		g_array_set_size(index->entries, 0);
+		index->duration = -1;
+	}
+	g_debug("indexed %s: %u entries, duration %" GST_TIME_FORMAT, uri,
+		index->entries->len, GST_TIME_ARGS(index->duration));
+	_store(uri, &st, index);
+	_index_unref(index);
+
+out:
+	G_LOCK(seek_index);
+	g_hash_table_remove(pending, uri);
+	G_UNLOCK(seek_index);
+	g_free(filename);
+	g_free(uri);
+}
+
+static void _queue_scan(const gchar *uri)
+{
+	G_LOCK(seek_index);
+	if (scanner == NULL) {
+		scanner = g_thread_pool_new(_scan, NULL, 1, FALSE, NULL);
+		pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, NULL);
+	}
+	if (!g_hash_table_contains(pending, uri)) {
+		g_hash_table_add(pending, g_strdup(uri));
+		g_thread_pool_push(scanner, g_strdup(uri), NULL);
+	}
+	G_UNLOCK(seek_index);
+}
+
+/*
+ * Gives the parser the whole index as soon as it has one.
+ */
+static GstPadProbeReturn _feed_parser_cb(GstPad *pad, GstPadProbeInfo *info,
+					 gpointer data)
+{
+	MafwGstRendererSeekIndex *index = data;
+	GstBaseParse *parse = GST_BASE_PARSE(GST_PAD_PARENT(pad));
+	guint i;
+
+	for (i = 0; i < index->entries->len; i++) {
+		SeekIndexEntry *entry = &g_array_index(index->entries,
+						       SeekIndexEntry, i);
+
+		gst_base_parse_add_index_entry(parse, entry->offset,
+					       entry->time * GST_MSECOND,
+					       TRUE, TRUE);
+	}
+	gst_base_parse_set_duration(parse, GST_FORMAT_TIME, index->duration,
+				    0);
+	g_debug("gave %u index entries to %s", index->entries->len,
+		GST_ELEMENT_NAME(parse));
+
+	return GST_PAD_PROBE_REMOVE;
+}
+
+/**
+ * mafw_gst_renderer_seek_index_attach:
+ * @pipeline: a playbin about to play @uri.
+ * @uri: the media.
+ *
+ * Looks up the seek index of @uri, or has it built in the background
+ * for the next plays if it is a local file never scanned.  Only VBR MP3
+ * files without a table of contents, and MP4 videos with keyframes more
+ * than two seconds apart get one.
+ */
+void mafw_gst_renderer_seek_index_attach(GstElement *pipeline,
+					 const gchar *uri)
+{
+	MafwGstRendererSeekIndex *index;
+	gchar *filename;
+	GStatBuf st;
+
+	g_return_if_fail(GST_IS_ELEMENT(pipeline));
+
+	g_object_set_data(G_OBJECT(pipeline), INDEX_KEY, NULL);
+	if (uri == NULL || !g_str_has_prefix(uri, "file://"))
+		return;
+	filename = g_filename_from_uri(uri, NULL, NULL);
+	if (filename == NULL || g_stat(filename, &st) != 0 ||
+	    !_indexable(filename)) {
+		g_free(filename);
+		return;
+	}
+	g_free(filename);
+
+	if (!_load(uri, &st, &index)) {
+		_queue_scan(uri);
+	} else if (index != NULL) {
+		g_debug("%s: %u index entries, duration %" GST_TIME_FORMAT,
+			uri, index->entries->len,
+			GST_TIME_ARGS(index->duration));
+		g_object_set_data_full(G_OBJECT(pipeline), INDEX_KEY, index,
+				       _index_unref);
+	}
+}
+
+/**
+ * mafw_gst_renderer_seek_index_watch:
+ * @pipeline: the playbin.
+ * @element: an element just created in @pipeline.
+ *
+ * Hands the MP3 index to @element if it is the parser, which then seeks
+ * from the indexed frame closest to the position instead of estimating
+ * its offset from the average bitrate.
+ */
+void mafw_gst_renderer_seek_index_watch(GstElement *pipeline,
+					GstElement *element)
+{
+	MafwGstRendererSeekIndex *index;
+	GstPad *pad;
+
+	index = _get_index(pipeline);
+	if (index == NULL || index->kind != SEEK_INDEX_MP3 ||
+	    !GST_IS_BASE_PARSE(element))
+		return;
+
+	/* Its own index is only created when it starts */
+	pad = gst_element_get_static_pad(element, "sink");
+	if (pad == NULL)
+		return;
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, _feed_parser_cb,
+			  _index_ref(index), _index_unref);
+	gst_object_unref(pad);
+}
+
+/**
+ * mafw_gst_renderer_seek_index_get_duration:
+ * @pipeline: the playbin.
+ *
+ * Returns: the exact duration of the media playing, counted by its
+ * index, or -1 if the demuxer has to be asked.
+ */
+gint64 mafw_gst_renderer_seek_index_get_duration(GstElement *pipeline)
+{
+	MafwGstRendererSeekIndex *index = _get_index(pipeline);
+
+	return index != NULL ? index->duration : -1;
+}
+
+/**
+ * mafw_gst_renderer_seek_index_adjust:
+ * @pipeline: the playbin.
+ * @position: the position to seek to, in nanoseconds.
+ *
+ * Chooses how to seek to @position.  Indexed MP3 files are seeked to
+ * accurately, since the parser only has to skip the frames after the
+ * closest index entry.  Seeks in indexed videos go to the nearest
+ * keyframe if it is close enough, and decode up to @position otherwise,
+ * instead of ending up seconds away from it.
+ *
+ * Returns: the flags of the seek, @position is moved to the keyframe.
+ */
+GstSeekFlags mafw_gst_renderer_seek_index_adjust(GstElement *pipeline,
+						 gint64 *position)
+{
+	MafwGstRendererSeekIndex *index = _get_index(pipeline);
+	SeekIndexEntry *entries;
+	guint low, high;
+	gint64 before, after, nearest;
+
+	g_return_val_if_fail(position != NULL, GST_SEEK_FLAG_FLUSH);
+
+	if (index == NULL)
+		return GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+	if (index->kind == SEEK_INDEX_MP3 || index->entries->len == 0)
+		return GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+
+	/* Last keyframe at or before the position */
+	entries = (SeekIndexEntry *) index->entries->data;
+	low = 0;
+	high = index->entries->len;
+	while (high - low > 1) {
+		guint middle = (low + high) / 2;
+
+		if (entries[middle].time * GST_MSECOND <= *position)
+			low = middle;
+		else
+			high = middle;
+	}
+	before = entries[low].time * GST_MSECOND;
+	after = low + 1 < index->entries->len ?
+		entries[low + 1].time * GST_MSECOND : G_MAXINT64;
+	nearest = ABS(*position - before) <= after - *position ?
+		before : after;
+
+	if (ABS(*position - nearest) > MP4_SPARSE_KEYFRAMES)
+		return GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+
+	*position = nearest;
+	return GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+		GST_SEEK_FLAG_SNAP_NEAREST;
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -0,0 +1,44 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifndef MAFW_GST_RENDERER_SEEK_INDEX_H
+#define MAFW_GST_RENDERER_SEEK_INDEX_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+void mafw_gst_renderer_seek_index_attach(GstElement *pipeline,
+					 const gchar *uri);
+void mafw_gst_renderer_seek_index_watch(GstElement *pipeline,
+					GstElement *element);
+gint64 mafw_gst_renderer_seek_index_get_duration(GstElement *pipeline);
+GstSeekFlags mafw_gst_renderer_seek_index_adjust(GstElement *pipeline,
+						 gint64 *position);
+
+G_END_DECLS
+#endif
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
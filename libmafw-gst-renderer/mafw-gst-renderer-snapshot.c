@@ -0,0 +1,354 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mafw-gst-renderer-snapshot.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-snapshot"
+
+#define MAFW_GST_RENDERER_SNAPSHOT_DIR "mafw-gst-renderer"
+#define MAFW_GST_RENDERER_SNAPSHOT_FILE "snapshot-%s"
+/* [snapshot] restore = paused | ready | none */
+#define MAFW_GST_RENDERER_SNAPSHOT_CONFIG "mafw-gst-renderer/snapshot.conf"
+
+#define SNAPSHOT_GROUP "snapshot"
+#define SNAPSHOT_KEY_STATE "state"
+#define SNAPSHOT_KEY_OBJECT_ID "object-id"
+#define SNAPSHOT_KEY_URI "uri"
+#define SNAPSHOT_KEY_POSITION "position"
+#define SNAPSHOT_KEY_PLAYLIST_INDEX "playlist-index"
+#define SNAPSHOT_KEY_STANDALONE "standalone"
+#define SNAPSHOT_KEY_AUDIO_STREAM "audio-stream"
+#define SNAPSHOT_KEY_TEXT_STREAM "text-stream"
+/* Set while the snapshot is being restored, cleared by the next save */
+#define SNAPSHOT_KEY_RESTORING "restoring"
+
+/*
+ * What is left to write for a renderer.
+ *
+ * keyfile:   Snapshot saved last, NULL to keep the one on disk
+ * restoring: The snapshot is being restored
+ */
+typedef struct {
+	GKeyFile *keyfile;
+	gboolean restoring;
+} Pending;
+
+G_LOCK_DEFINE_STATIC(snapshot);
+/* Writes the snapshots in the background, one at a time and in order */
+static GThreadPool *saver;
+/* Pending per renderer UUID, one save queued for each */
+static GHashTable *pending;
+
+static gchar *_get_path(const gchar *uuid)
+{
+	gchar *file, *path;
+
+	/* One file per renderer, several can share the process */
+	file = g_strdup_printf(MAFW_GST_RENDERER_SNAPSHOT_FILE, uuid);
+	path = g_build_filename(g_get_user_cache_dir(),
+				MAFW_GST_RENDERER_SNAPSHOT_DIR, file, NULL);
+	g_free(file);
+
+	return path;
+}
+
+static void _pending_free(Pending *p)
+{
+	if (p->keyfile != NULL)
+		g_key_file_free(p->keyfile);
+	g_free(p);
+}
+
+/*
+ * Runs in the saver thread, for the renderer @data is the UUID of.  What
+ * was saved while the file is written is written by the next run.
+ */
+static void _save(gpointer data, gpointer user_data)
+{
+	gchar *uuid = data;
+	Pending *p;
+	gpointer key;
+	gchar *dir, *path, *contents;
+	gsize length;
+	GError *error = NULL;
+
+	G_LOCK(snapshot);
+	g_hash_table_lookup_extended(pending, uuid, &key, (gpointer *) &p);
+	g_hash_table_steal(pending, uuid);
+	G_UNLOCK(snapshot);
+	g_free(key);
+
+	path = _get_path(uuid);
+	if (p->keyfile == NULL) {
+		p->keyfile = g_key_file_new();
+		if (!g_key_file_load_from_file(p->keyfile, path,
+					       G_KEY_FILE_NONE, NULL))
+			goto out;
+	}
+	if (p->restoring)
+		g_key_file_set_boolean(p->keyfile, SNAPSHOT_GROUP,
+				       SNAPSHOT_KEY_RESTORING, TRUE);
+
+	dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+	contents = g_key_file_to_data(p->keyfile, &length, NULL);
+	if (!g_file_set_contents(path, contents, length, &error)) {
+		g_warning("Could not save snapshot: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(contents);
+
+out:
+	g_free(path);
+	g_free(uuid);
+	_pending_free(p);
+}
+
+/* Called with the lock held */
+static Pending *_get_pending(const gchar *uuid)
+{
+	Pending *p;
+
+	if (saver == NULL) {
+		saver = g_thread_pool_new(_save, NULL, 1, FALSE, NULL);
+		pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free,
+						(GDestroyNotify) _pending_free);
+	}
+
+	p = g_hash_table_lookup(pending, uuid);
+	if (p == NULL) {
+		p = g_new0(Pending, 1);
+		g_hash_table_insert(pending, g_strdup(uuid), p);
+		g_thread_pool_push(saver, g_strdup(uuid), NULL);
+	}
+
+	return p;
+}
+
+/**
+ * mafw_gst_renderer_snapshot_load:
+ * @uuid: UUID of the renderer.
+ *
+ * Reads the playback context the previous instance of the renderer left
+ * behind.  A snapshot that was being restored when the process went away
+ * is dropped instead: restoring it again might crash again.
+ *
+ * Returns: the snapshot, to be freed with
+ * mafw_gst_renderer_snapshot_free(), or NULL if there is none.
+ */
+MafwGstRendererSnapshot *mafw_gst_renderer_snapshot_load(const gchar *uuid)
+{
+	MafwGstRendererSnapshot *snapshot = NULL;
+	GKeyFile *keyfile;
+	gchar *path;
+
+	g_return_val_if_fail(uuid != NULL, NULL);
+
+	path = _get_path(uuid);
+	keyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE, NULL) ||
+	    !g_key_file_has_group(keyfile, SNAPSHOT_GROUP))
+		goto out;
+	if (g_key_file_get_boolean(keyfile, SNAPSHOT_GROUP,
+				   SNAPSHOT_KEY_RESTORING, NULL)) {
+		g_warning("dropping the snapshot the previous instance was "
+			  "restoring");
+		g_unlink(path);
+		goto out;
+	}
+
+	snapshot = g_new0(MafwGstRendererSnapshot, 1);
+	snapshot->state = g_key_file_get_integer(keyfile, SNAPSHOT_GROUP,
+						 SNAPSHOT_KEY_STATE, NULL);
+	snapshot->object_id = g_key_file_get_string(keyfile, SNAPSHOT_GROUP,
+						    SNAPSHOT_KEY_OBJECT_ID,
+						    NULL);
+	snapshot->uri = g_key_file_get_string(keyfile, SNAPSHOT_GROUP,
+					      SNAPSHOT_KEY_URI, NULL);
+	snapshot->position = g_key_file_get_integer(keyfile, SNAPSHOT_GROUP,
+						    SNAPSHOT_KEY_POSITION,
+						    NULL);
+	snapshot->playlist_index =
+		g_key_file_get_integer(keyfile, SNAPSHOT_GROUP,
+				       SNAPSHOT_KEY_PLAYLIST_INDEX, NULL);
+	snapshot->standalone =
+		g_key_file_get_boolean(keyfile, SNAPSHOT_GROUP,
+				       SNAPSHOT_KEY_STANDALONE, NULL);
+	snapshot->audio_stream =
+		g_key_file_get_integer(keyfile, SNAPSHOT_GROUP,
+				       SNAPSHOT_KEY_AUDIO_STREAM, NULL);
+	snapshot->text_stream =
+		g_key_file_get_integer(keyfile, SNAPSHOT_GROUP,
+				       SNAPSHOT_KEY_TEXT_STREAM, NULL);
+
+	/* Garbage from an older or broken file */
+	if ((guint) snapshot->state >= _LastMafwPlayState ||
+	    (snapshot->object_id != NULL && *snapshot->object_id == '\0')) {
+		mafw_gst_renderer_snapshot_free(snapshot);
+		snapshot = NULL;
+	}
+
+out:
+	g_key_file_free(keyfile);
+	g_free(path);
+	return snapshot;
+}
+
+/**
+ * mafw_gst_renderer_snapshot_save:
+ * @uuid: UUID of the renderer.
+ * @snapshot: its playback context.
+ *
+ * Writes @snapshot to disk, so that it survives a crash or a restart of
+ * the process.  It is written in the background, never by the caller,
+ * and snapshots saved faster than they are written replace each other.
+ */
+void mafw_gst_renderer_snapshot_save(const gchar *uuid,
+				     const MafwGstRendererSnapshot *snapshot)
+{
+	GKeyFile *keyfile;
+	Pending *p;
+
+	g_return_if_fail(uuid != NULL && snapshot != NULL);
+
+	keyfile = g_key_file_new();
+	g_key_file_set_integer(keyfile, SNAPSHOT_GROUP, SNAPSHOT_KEY_STATE,
+			       snapshot->state);
+	if (snapshot->object_id != NULL)
+		g_key_file_set_string(keyfile, SNAPSHOT_GROUP,
+				      SNAPSHOT_KEY_OBJECT_ID,
+				      snapshot->object_id);
+	if (snapshot->uri != NULL)
+		g_key_file_set_string(keyfile, SNAPSHOT_GROUP,
+				      SNAPSHOT_KEY_URI, snapshot->uri);
+	g_key_file_set_integer(keyfile, SNAPSHOT_GROUP, SNAPSHOT_KEY_POSITION,
+			       snapshot->position);
+	g_key_file_set_integer(keyfile, SNAPSHOT_GROUP,
+			       SNAPSHOT_KEY_PLAYLIST_INDEX,
+			       snapshot->playlist_index);
+	g_key_file_set_boolean(keyfile, SNAPSHOT_GROUP,
+			       SNAPSHOT_KEY_STANDALONE, snapshot->standalone);
+	g_key_file_set_integer(keyfile, SNAPSHOT_GROUP,
+			       SNAPSHOT_KEY_AUDIO_STREAM,
+			       snapshot->audio_stream);
+	g_key_file_set_integer(keyfile, SNAPSHOT_GROUP,
+			       SNAPSHOT_KEY_TEXT_STREAM, snapshot->text_stream);
+
+	G_LOCK(snapshot);
+	p = _get_pending(uuid);
+	if (p->keyfile != NULL)
+		g_key_file_free(p->keyfile);
+	p->keyfile = keyfile;
+	p->restoring = FALSE;
+	G_UNLOCK(snapshot);
+}
+
+/**
+ * mafw_gst_renderer_snapshot_mark_restoring:
+ * @uuid: UUID of the renderer.
+ *
+ * Marks the snapshot of the renderer as being restored, until the next
+ * mafw_gst_renderer_snapshot_save().  If the process does not get that
+ * far, the next one does not restore it.  Like saves, the mark is
+ * written in the background, after the saves made before it.
+ */
+void mafw_gst_renderer_snapshot_mark_restoring(const gchar *uuid)
+{
+	g_return_if_fail(uuid != NULL);
+
+	G_LOCK(snapshot);
+	_get_pending(uuid)->restoring = TRUE;
+	G_UNLOCK(snapshot);
+}
+
+void mafw_gst_renderer_snapshot_free(MafwGstRendererSnapshot *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+
+	g_free(snapshot->object_id);
+	g_free(snapshot->uri);
+	g_free(snapshot);
+}
+
+static gpointer _read_restore(gpointer data)
+{
+	MafwGstRendererSnapshotRestore restore =
+		MAFW_GST_RENDERER_SNAPSHOT_RESTORE_PAUSED;
+	GKeyFile *config;
+	gchar *path, *value = NULL;
+
+	config = g_key_file_new();
+	path = g_build_filename(g_get_user_config_dir(),
+				MAFW_GST_RENDERER_SNAPSHOT_CONFIG, NULL);
+	if (g_key_file_load_from_file(config, path, G_KEY_FILE_NONE, NULL))
+		value = g_key_file_get_string(config, SNAPSHOT_GROUP,
+					      "restore", NULL);
+	if (value != NULL) {
+		g_strstrip(value);
+		if (!strcmp(value, "none"))
+			restore = MAFW_GST_RENDERER_SNAPSHOT_RESTORE_NONE;
+		else if (!strcmp(value, "ready"))
+			restore = MAFW_GST_RENDERER_SNAPSHOT_RESTORE_READY;
+		else if (strcmp(value, "paused"))
+			g_warning("unknown snapshot restore mode '%s'", value);
+	}
+
+	g_free(value);
+	g_free(path);
+	g_key_file_free(config);
+
+	return GINT_TO_POINTER(restore);
+}
+
+/**
+ * mafw_gst_renderer_snapshot_get_restore:
+ *
+ * Tells how the renderer resumes at startup.  By default the media of the
+ * snapshot is prerolled paused at its position, "ready" keeps the pipeline
+ * in READY until playback is resumed, and "none" starts afresh.  The
+ * configuration is read once per process.
+ *
+ * Returns: the configured #MafwGstRendererSnapshotRestore.
+ */
+MafwGstRendererSnapshotRestore mafw_gst_renderer_snapshot_get_restore(void)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	g_once(&once, _read_restore, NULL);
+
+	return GPOINTER_TO_INT(once.retval);
+}
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -0,0 +1,70 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_GST_RENDERER_SNAPSHOT_H
+#define MAFW_GST_RENDERER_SNAPSHOT_H
+
+#include <glib.h>
+#include <libmafw/mafw-renderer.h>
+
+typedef enum {
+	MAFW_GST_RENDERER_SNAPSHOT_RESTORE_NONE,
+	MAFW_GST_RENDERER_SNAPSHOT_RESTORE_READY,
+	MAFW_GST_RENDERER_SNAPSHOT_RESTORE_PAUSED,
+} MafwGstRendererSnapshotRestore;
+
+/*
+ * state:          Renderer state when it was taken
+ * object_id:      Media selected, NULL if none
+ * uri:            URI it resolved to, NULL if not resolved yet
+ * position:       Position in the media, in seconds
+ * playlist_index: Index of the media in the assigned playlist, -1 if it
+ *                 was not played from one
+ * standalone:     The media was played with play_object()
+ * audio_stream:   Audio stream selected, -1 for the default one
+ * text_stream:    Subtitle stream selected, -1 for the default one
+ */
+typedef struct {
+	MafwPlayState state;
+	gchar *object_id;
+	gchar *uri;
+	gint position;
+	gint playlist_index;
+	gboolean standalone;
+	gint audio_stream;
+	gint text_stream;
+} MafwGstRendererSnapshot;
+
+G_BEGIN_DECLS
+
+MafwGstRendererSnapshot *mafw_gst_renderer_snapshot_load(const gchar *uuid);
+void mafw_gst_renderer_snapshot_save(const gchar *uuid,
+				     const MafwGstRendererSnapshot *snapshot);
+void mafw_gst_renderer_snapshot_mark_restoring(const gchar *uuid);
+void mafw_gst_renderer_snapshot_free(MafwGstRendererSnapshot *snapshot);
+MafwGstRendererSnapshotRestore mafw_gst_renderer_snapshot_get_restore(void);
+
+G_END_DECLS
+#endif
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
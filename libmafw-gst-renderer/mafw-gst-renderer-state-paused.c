@@ -182,7 +182,8 @@ static void _do_play_object(MafwGstRendererState *self, const gchar *object_id,
 
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
 
-	self->renderer->worker->stay_paused = FALSE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 FALSE);
 	prev_mode = mafw_gst_renderer_get_playback_mode(self->renderer);
 	mafw_gst_renderer_state_do_play_object(self, object_id, error);
 	cur_mode = mafw_gst_renderer_get_playback_mode(self->renderer);
@@ -198,7 +199,8 @@ static void _do_stop(MafwGstRendererState *self, GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
 
-	self->renderer->worker->stay_paused = FALSE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 FALSE);
 	/* Stop playback */
         mafw_gst_renderer_state_do_stop(self, error);
 }
@@ -208,7 +210,8 @@ static void _do_resume(MafwGstRendererState *self, GError **error)
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
 
         MafwGstRenderer *renderer = MAFW_GST_RENDERER_STATE(self)->renderer;
-	self->renderer->worker->stay_paused = FALSE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 FALSE);
         mafw_gst_renderer_worker_resume(renderer->worker);
 
         /* Transition will be done after receiving notify_play */
@@ -219,7 +222,8 @@ static void _do_set_position(MafwGstRendererState *self,
 			     GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
-	self->renderer->worker->stay_paused = TRUE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 TRUE);
 	mafw_gst_renderer_state_do_set_position(self, mode, seconds, error);
 }
 
@@ -238,14 +242,16 @@ static void _do_get_position(MafwGstRendererState *self,
 static void _do_next(MafwGstRendererState *self, GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
-	self->renderer->worker->stay_paused = TRUE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 TRUE);
 	mafw_gst_renderer_state_do_next(self, error);
 }
 
 static void _do_previous(MafwGstRendererState *self, GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
-	self->renderer->worker->stay_paused = TRUE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 TRUE);
 	mafw_gst_renderer_state_do_prev(self, error);
 }
 
@@ -253,7 +259,8 @@ static void _do_goto_index(MafwGstRendererState *self, guint index,
 			   GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PAUSED(self));
-	self->renderer->worker->stay_paused = TRUE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 TRUE);
 	mafw_gst_renderer_state_do_goto_index(self, index, error);
 }
 
@@ -315,7 +322,8 @@ static void _playlist_contents_changed(MafwGstRendererState *self,
 	   played if that's been suggested with renderer->resume_playlist */
 	mode = mafw_gst_renderer_get_playback_mode(self->renderer);
 	if (clip_changed && mode == MAFW_GST_RENDERER_MODE_PLAYLIST) {
-		self->renderer->worker->stay_paused = TRUE;
+		mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+							 TRUE);
 		mafw_gst_renderer_state_do_play(self, error);
 	}
 }
@@ -320,6 +320,13 @@ static void _notify_eos(MafwGstRendererState *self, GError **error)
                 mafw_gst_renderer_update_stats(renderer);
         }
 
+	/* The client moved on already, within the navigation delay: play
+	 * what it selected instead of moving to the next one as well */
+	if (renderer->navigation_id != 0) {
+		mafw_gst_renderer_flush_navigation(renderer, error);
+		return;
+	}
+
 	/* Notice: playback has already stopped, so calling
 	 * mafw_gst_renderer_stop or mafw_gst_renderer_state_stop
 	 * here is an error.
@@ -344,12 +351,10 @@ static void _notify_eos(MafwGstRendererState *self, GError **error)
 	} 
     else 
     {
-        gboolean is_stream  = uri_is_stream(self->renderer->worker->media.location);
-        if (is_stream 
-            && self->renderer->error_policy == MAFW_RENDERER_ERROR_POLICY_STOP 
-            && self->renderer->worker->media.length_nanos == -1 
-            && self->renderer->worker->media.seekable == SEEKABILITY_NO_SEEKABLE
-            && self->renderer->worker->media.has_visual_content == FALSE)
+        if (self->renderer->error_policy == MAFW_RENDERER_ERROR_POLICY_STOP 
+            && mafw_gst_renderer_worker_is_endless(self->renderer->worker)
+            && !g_atomic_int_get(
+		    &self->renderer->worker->media.has_visual_content))
         {
             /* Endless Radio stream. Stream has no length, it is not seekable or it is not video. */
 			mafw_gst_renderer_worker_stop(self->renderer->worker);
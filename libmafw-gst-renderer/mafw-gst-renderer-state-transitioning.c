@@ -196,15 +196,18 @@ static void _do_pause(MafwGstRendererState *self, GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_TRANSITIONING(self));
 	g_debug("Got pause while transitioning");
-	self->renderer->worker->stay_paused = TRUE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 TRUE);
 }
 
 static void _do_resume(MafwGstRendererState *self, GError **error)
 {
         g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_TRANSITIONING(self));
-	if (self->renderer->worker->stay_paused) {
+	if (mafw_gst_renderer_worker_get_stay_paused(
+		    self->renderer->worker)) {
 		g_debug("Got resume while transitioning/paused");
-		self->renderer->worker->stay_paused = FALSE;
+		mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+							 FALSE);
 	} else {
 		g_set_error(error, MAFW_RENDERER_ERROR,
 			    MAFW_RENDERER_ERROR_CANNOT_PLAY,
@@ -326,13 +329,20 @@ static void _notify_metadata(MafwGstRendererState *self,
                 }
 
                 /* Play the available uri(s) */
+		mafw_gst_renderer_setup_playback(renderer);
+		mafw_gst_renderer_worker_set_source_info(
+			renderer->worker, renderer->media->duration,
+			renderer->media->seekability);
                 if (nuris == 1) {
-			mafw_gst_renderer_worker_play(renderer->worker, uri, NULL);
+			mafw_gst_renderer_worker_play_at(
+				renderer->worker, uri, NULL,
+				renderer->start_position);
 		} else {
                         mafw_gst_renderer_worker_play_alternatives(
                                 renderer->worker, uris);
                         g_free(uris);
                 }
+		renderer->start_position = 0;
         }
 }
 
@@ -362,7 +372,8 @@ static void _notify_pause(MafwGstRendererState *self, GError **error)
 	g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_TRANSITIONING(self));
 
 	MafwGstRenderer *renderer = MAFW_GST_RENDERER_STATE(self)->renderer;
-	self->renderer->worker->stay_paused = FALSE;
+	mafw_gst_renderer_worker_set_stay_paused(self->renderer->worker,
+						 FALSE);
         mafw_gst_renderer_set_state(renderer, Paused);
 }
 
@@ -553,6 +553,10 @@ void mafw_gst_renderer_state_do_stop(MafwGstRendererState *self, GError **error)
 		renderer->update_playcount_id = 0;
 	}
 
+	/* Drop playback requested by a previous navigation */
+	mafw_gst_renderer_cancel_navigation(renderer);
+	renderer->start_position = 0;
+
 	/* Set new state */
 	mafw_gst_renderer_set_state(renderer, Stopped);
 
@@ -597,7 +601,7 @@ void mafw_gst_renderer_state_do_next (MafwGstRendererState *self, GError **error
 			/* We issued the comand in playlist mode, or
 			  in standalone mode but with resume_playlist
 			  set, so let's play the new item */
-			mafw_gst_renderer_state_play(self, error);
+			mafw_gst_renderer_schedule_navigation_play(renderer);
 
 		} else {
 			/* We issued the command in standalone mode and we
@@ -617,7 +621,7 @@ void mafw_gst_renderer_state_do_next (MafwGstRendererState *self, GError **error
 		/* Normal mode */
 		mafw_playlist_iterator_reset(renderer->iterator, NULL);
 		mafw_gst_renderer_set_media_playlist(renderer);
-		mafw_gst_renderer_state_play(self, error);
+		mafw_gst_renderer_schedule_navigation_play(renderer);
 		break;
 	case MAFW_GST_RENDERER_MOVE_RESULT_ERROR:
 		break;
@@ -651,7 +655,7 @@ void mafw_gst_renderer_state_do_prev(MafwGstRendererState *self, GError **error)
 			/* We issued the comand in playlist mode, or
 			  in standalone mode but with resume_playlist
 			  set, so let's play the new item */
-			mafw_gst_renderer_state_play(self, error);
+			mafw_gst_renderer_schedule_navigation_play(renderer);
 
 		} else {
 			/* We issued the command in standalone mode and we
@@ -671,7 +675,7 @@ void mafw_gst_renderer_state_do_prev(MafwGstRendererState *self, GError **error)
 		/* Normal mode */
 		mafw_playlist_iterator_move_to_last(renderer->iterator, NULL);
 		mafw_gst_renderer_set_media_playlist(renderer);
-		mafw_gst_renderer_state_play(self, error);
+		mafw_gst_renderer_schedule_navigation_play(renderer);
 		break;
 	case MAFW_GST_RENDERER_MOVE_RESULT_ERROR:
 		break;
@@ -713,7 +717,7 @@ void mafw_gst_renderer_state_do_goto_index(MafwGstRendererState *self,
 			/* We issued the comand in playlist mode, or
 			  in standalone mode but with resume_playlist
 			  set, so let's play the new item */
-			mafw_gst_renderer_state_play(self, error);
+			mafw_gst_renderer_schedule_navigation_play(renderer);
 
 		} else {
 			/* We issued the command in standalone mode and we
@@ -0,0 +1,633 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-gst-renderer-stats-journal.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-stats-journal"
+
+/* Seconds to wait for more updates before writing them to the sources */
+#define MAFW_GST_RENDERER_STATS_JOURNAL_FLUSH_DELAY 30
+/* Number of pending objects that forces a flush right away */
+#define MAFW_GST_RENDERER_STATS_JOURNAL_MAX_PENDING 32
+/* Failed writes after which the updates of an object are given up */
+#define MAFW_GST_RENDERER_STATS_JOURNAL_MAX_FAILURES 5
+
+#define MAFW_GST_RENDERER_STATS_JOURNAL_DIR "mafw-gst-renderer"
+#define MAFW_GST_RENDERER_STATS_JOURNAL_FILE "stats-journal-%s"
+
+#define JOURNAL_KEY_OBJECT_ID "object-id"
+#define JOURNAL_KEY_PLAY_COUNT "play-count"
+#define JOURNAL_KEY_LAST_PLAYED "last-played"
+#define JOURNAL_KEY_DURATION "duration"
+
+/*
+ * play_count:  plays not yet added to the source's play count
+ * last_played: most recent play time, -1 if none pending
+ * duration:    most recent duration, -1 if none pending
+ * writing:     a write of the entry to its source is on its way
+ * failures:    writes of the entry that failed in a row
+ */
+typedef struct {
+	gint play_count;
+	gint64 last_played;
+	gint duration;
+	gboolean writing;
+	gint failures;
+} JournalEntry;
+
+/*
+ * refcount: the journal and every write on its way hold a reference
+ * registry: registry used to find the sources of the objects
+ * entries:  pending updates, object ID -> JournalEntry
+ * flush_id: source ID of the flush timeout
+ * writing:  writes on their way
+ * dirty:    @entries changed since they were last persisted
+ * path:     file the pending updates are persisted to
+ */
+struct _MafwGstRendererStatsJournal {
+	gint refcount;
+	MafwRegistry *registry;
+	GHashTable *entries;
+	guint flush_id;
+	gint writing;
+	gboolean dirty;
+	gchar *path;
+};
+
+/*
+ * A write of an entry to its source.  The entry stays in the journal until
+ * the source took it: @written is what is being written, to be taken off
+ * the entry then.
+ */
+typedef struct {
+	MafwGstRendererStatsJournal *journal;
+	gchar *object_id;
+	JournalEntry written;
+	GHashTable *metadata;
+} WriteClosure;
+
+static JournalEntry *_entry_new(void)
+{
+	JournalEntry *entry;
+
+	entry = g_new0(JournalEntry, 1);
+	entry->play_count = 0;
+	entry->last_played = -1;
+	entry->duration = -1;
+
+	return entry;
+}
+
+static JournalEntry *_get_entry(MafwGstRendererStatsJournal *journal,
+				const gchar *object_id)
+{
+	JournalEntry *entry;
+
+	entry = g_hash_table_lookup(journal->entries, object_id);
+	if (entry == NULL) {
+		entry = _entry_new();
+		g_hash_table_insert(journal->entries, g_strdup(object_id),
+				    entry);
+	}
+	journal->dirty = TRUE;
+
+	return entry;
+}
+
+static void _journal_unref(MafwGstRendererStatsJournal *journal)
+{
+	if (--journal->refcount > 0)
+		return;
+
+	g_hash_table_unref(journal->entries);
+	g_object_unref(journal->registry);
+	g_free(journal->path);
+	g_free(journal);
+}
+
+/*
+ * Writes the pending updates to disk, so they survive a crash.  The file is
+ * removed when nothing is pending.
+ */
+static void _save(MafwGstRendererStatsJournal *journal)
+{
+	GKeyFile *keyfile;
+	GHashTableIter iter;
+	gpointer key, value;
+	gchar *data;
+	gsize length;
+	guint i = 0;
+	GError *error = NULL;
+
+	if (!journal->dirty)
+		return;
+	journal->dirty = FALSE;
+
+	if (g_hash_table_size(journal->entries) == 0) {
+		g_unlink(journal->path);
+		return;
+	}
+
+	keyfile = g_key_file_new();
+	g_hash_table_iter_init(&iter, journal->entries);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		JournalEntry *entry = value;
+		gchar *group;
+
+		/* Object IDs are not valid group names, store them as
+		 * values */
+		group = g_strdup_printf("entry-%u", i++);
+		g_key_file_set_string(keyfile, group, JOURNAL_KEY_OBJECT_ID,
+				      key);
+		g_key_file_set_integer(keyfile, group, JOURNAL_KEY_PLAY_COUNT,
+				       entry->play_count);
+		g_key_file_set_int64(keyfile, group, JOURNAL_KEY_LAST_PLAYED,
+				     entry->last_played);
+		g_key_file_set_integer(keyfile, group, JOURNAL_KEY_DURATION,
+				       entry->duration);
+		g_free(group);
+	}
+
+	data = g_key_file_to_data(keyfile, &length, NULL);
+	if (!g_file_set_contents(journal->path, data, length, &error)) {
+		g_warning("Could not save stats journal: %s", error->message);
+		g_error_free(error);
+		journal->dirty = TRUE;
+	}
+
+	g_free(data);
+	g_key_file_free(keyfile);
+}
+
+/*
+ * Restores the updates that were pending when the process went away.
+ */
+static void _load(MafwGstRendererStatsJournal *journal)
+{
+	GKeyFile *keyfile;
+	gchar **groups;
+	gint i;
+
+	keyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(keyfile, journal->path,
+				       G_KEY_FILE_NONE, NULL)) {
+		g_key_file_free(keyfile);
+		return;
+	}
+
+	groups = g_key_file_get_groups(keyfile, NULL);
+	for (i = 0; groups[i] != NULL; i++) {
+		JournalEntry *entry;
+		gchar *object_id;
+
+		object_id = g_key_file_get_string(keyfile, groups[i],
+						  JOURNAL_KEY_OBJECT_ID, NULL);
+		if (object_id == NULL)
+			continue;
+
+		entry = _get_entry(journal, object_id);
+		entry->play_count =
+			g_key_file_get_integer(keyfile, groups[i],
+					       JOURNAL_KEY_PLAY_COUNT, NULL);
+		entry->last_played =
+			g_key_file_get_int64(keyfile, groups[i],
+					     JOURNAL_KEY_LAST_PLAYED, NULL);
+		entry->duration =
+			g_key_file_get_integer(keyfile, groups[i],
+					       JOURNAL_KEY_DURATION, NULL);
+		g_free(object_id);
+	}
+	/* What was loaded is on disk already */
+	journal->dirty = FALSE;
+
+	g_debug("restored %u pending stats updates",
+		g_hash_table_size(journal->entries));
+
+	g_strfreev(groups);
+	g_key_file_free(keyfile);
+}
+
+/*
+ * Counts a write that is over.  Once the last one of a batch is, the
+ * journal is persisted without what the sources took.
+ */
+static void _write_finished(MafwGstRendererStatsJournal *journal)
+{
+	if (--journal->writing == 0)
+		_save(journal);
+	_journal_unref(journal);
+}
+
+/*
+ * Takes what @closure wrote off its entry if the source took it.  Failed
+ * writes are kept for the next flush, unless the object is gone or the
+ * source keeps failing.
+ */
+static void _write_done(WriteClosure *closure, const GError *error)
+{
+	MafwGstRendererStatsJournal *journal = closure->journal;
+	JournalEntry *entry;
+
+	entry = g_hash_table_lookup(journal->entries, closure->object_id);
+	if (entry != NULL) {
+		entry->writing = FALSE;
+		journal->dirty = TRUE;
+		if (error == NULL) {
+			entry->play_count -= closure->written.play_count;
+			if (entry->last_played ==
+			    closure->written.last_played)
+				entry->last_played = -1;
+			if (entry->duration == closure->written.duration)
+				entry->duration = -1;
+			entry->failures = 0;
+			if (entry->play_count == 0 &&
+			    entry->last_played == -1 &&
+			    entry->duration == -1)
+				g_hash_table_remove(journal->entries,
+						    closure->object_id);
+		} else if (g_error_matches(error, MAFW_SOURCE_ERROR,
+				       MAFW_SOURCE_ERROR_INVALID_OBJECT_ID) ||
+			   ++entry->failures >=
+			   MAFW_GST_RENDERER_STATS_JOURNAL_MAX_FAILURES) {
+			g_warning("Dropping stats of %s: %s",
+				  closure->object_id, error->message);
+			g_hash_table_remove(journal->entries,
+					    closure->object_id);
+		} else {
+			g_debug("Keeping stats of %s: %s",
+				closure->object_id, error->message);
+		}
+	}
+
+	if (closure->metadata != NULL)
+		g_hash_table_unref(closure->metadata);
+	g_free(closure->object_id);
+	g_free(closure);
+
+	_write_finished(journal);
+}
+
+static void _metadata_set_cb(MafwSource *self, const gchar *object_id,
+			     const gchar **failed_keys, gpointer user_data,
+			     const GError *error)
+{
+	WriteClosure *closure = user_data;
+
+	if (error != NULL)
+		g_debug("Error received when setting metadata: "
+			"%s (%d): %s", g_quark_to_string(error->domain),
+			error->code, error->message);
+	else
+		g_debug("Metadata set correctly");
+
+	_write_done(closure, error);
+}
+
+/*
+ * Receives the current play count of an object, adds the plays recorded in
+ * the journal to it and writes it back together with the rest of the merged
+ * metadata.
+ */
+static void _play_count_cb(MafwSource *cb_source, const gchar *cb_object_id,
+			   GHashTable *cb_metadata, gpointer cb_user_data,
+			   const GError *cb_error)
+{
+	WriteClosure *closure = cb_user_data;
+	GValue *curval = NULL;
+	gint curplaycount;
+
+	if (cb_error != NULL) {
+		g_warning("_play_count_cb received an error: "
+			  "%s (%d): %s", g_quark_to_string(cb_error->domain),
+			  cb_error->code, cb_error->message);
+		_write_done(closure, cb_error);
+		return;
+	}
+
+	if (cb_metadata)
+		curval = mafw_metadata_first(cb_metadata,
+					     MAFW_METADATA_KEY_PLAY_COUNT);
+	if (curval == NULL) {
+		/* Playing at first time, or not supported... */
+		curplaycount = closure->written.play_count;
+	} else if (G_VALUE_HOLDS(curval, G_TYPE_INT)) {
+		curplaycount = g_value_get_int(curval) +
+			closure->written.play_count;
+	} else {
+		curplaycount = -1;
+	}
+
+	if (curplaycount > 0)
+		mafw_metadata_add_int(closure->metadata,
+				      MAFW_METADATA_KEY_PLAY_COUNT,
+				      curplaycount);
+
+	if (g_hash_table_size(closure->metadata) > 0)
+		mafw_source_set_metadata(cb_source, cb_object_id,
+					 closure->metadata, _metadata_set_cb,
+					 closure);
+	else
+		_write_done(closure, NULL);
+}
+
+static void _flush_entry(MafwGstRendererStatsJournal *journal,
+			 MafwSource *source, const gchar *object_id,
+			 JournalEntry *entry)
+{
+	WriteClosure *closure;
+
+	closure = g_new0(WriteClosure, 1);
+	journal->refcount++;
+	journal->writing++;
+	closure->journal = journal;
+	closure->object_id = g_strdup(object_id);
+	closure->written = *entry;
+	entry->writing = TRUE;
+
+	closure->metadata = mafw_metadata_new();
+	if (entry->last_played != -1)
+		mafw_metadata_add_int64(closure->metadata,
+					MAFW_METADATA_KEY_LAST_PLAYED,
+					entry->last_played);
+	if (entry->duration != -1)
+		mafw_metadata_add_int(closure->metadata,
+				      MAFW_METADATA_KEY_DURATION,
+				      entry->duration);
+
+	if (entry->play_count > 0) {
+		static const gchar * const keys[] =
+			{ MAFW_METADATA_KEY_PLAY_COUNT, NULL };
+
+		/* The play count has to be read before it can be
+		 * increased, the rest is written together with it */
+		mafw_source_get_metadata(source, object_id, keys,
+					 _play_count_cb, closure);
+	} else {
+		mafw_source_set_metadata(source, object_id,
+					 closure->metadata, _metadata_set_cb,
+					 closure);
+	}
+}
+
+static gboolean _flush_timeout(gpointer data)
+{
+	MafwGstRendererStatsJournal *journal = data;
+
+	journal->flush_id = 0;
+	mafw_gst_renderer_stats_journal_flush(journal);
+
+	return FALSE;
+}
+
+static void _schedule_flush(MafwGstRendererStatsJournal *journal)
+{
+	if (g_hash_table_size(journal->entries) >=
+	    MAFW_GST_RENDERER_STATS_JOURNAL_MAX_PENDING) {
+		mafw_gst_renderer_stats_journal_flush(journal);
+	} else if (journal->flush_id == 0) {
+		journal->flush_id = g_timeout_add_seconds(
+			MAFW_GST_RENDERER_STATS_JOURNAL_FLUSH_DELAY,
+			_flush_timeout, journal);
+	}
+}
+
+/**
+ * mafw_gst_renderer_stats_journal_new:
+ * @registry: registry to look up the sources of the journaled objects.
+ * @uuid: UUID of the renderer owning the journal.
+ *
+ * Creates a journal that accumulates play statistics and duration updates
+ * and writes them back to their sources in batches.  Updates left pending by
+ * a previous instance are restored and scheduled for writing.
+ */
+MafwGstRendererStatsJournal *mafw_gst_renderer_stats_journal_new(
+	MafwRegistry *registry, const gchar *uuid)
+{
+	MafwGstRendererStatsJournal *journal;
+	gchar *dir, *file;
+
+	g_return_val_if_fail(registry != NULL, NULL);
+
+	journal = g_new0(MafwGstRendererStatsJournal, 1);
+	journal->refcount = 1;
+	journal->registry = g_object_ref(registry);
+	journal->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 g_free, g_free);
+
+	dir = g_build_filename(g_get_user_cache_dir(),
+			       MAFW_GST_RENDERER_STATS_JOURNAL_DIR, NULL);
+	g_mkdir_with_parents(dir, 0700);
+	/* One file per renderer, several can share the process */
+	file = g_strdup_printf(MAFW_GST_RENDERER_STATS_JOURNAL_FILE, uuid);
+	journal->path = g_build_filename(dir, file, NULL);
+	g_free(file);
+	g_free(dir);
+
+	_load(journal);
+	if (g_hash_table_size(journal->entries) > 0)
+		_schedule_flush(journal);
+
+	return journal;
+}
+
+/**
+ * mafw_gst_renderer_stats_journal_add_play:
+ * @journal: a journal.
+ * @object_id: object that has been played.
+ * @last_played: time of the play, in milliseconds since the epoch.
+ *
+ * Records one play of @object_id.  Plays of the same object are merged into
+ * a single play count increase.  Nothing is written before the next flush.
+ */
+void mafw_gst_renderer_stats_journal_add_play(
+	MafwGstRendererStatsJournal *journal, const gchar *object_id,
+	gint64 last_played)
+{
+	JournalEntry *entry;
+
+	g_return_if_fail(journal != NULL);
+	g_return_if_fail(object_id != NULL);
+
+	entry = _get_entry(journal, object_id);
+	entry->play_count++;
+	entry->last_played = MAX(entry->last_played, last_played);
+
+	_schedule_flush(journal);
+}
+
+/**
+ * mafw_gst_renderer_stats_journal_add_duration:
+ * @journal: a journal.
+ * @object_id: object whose duration has been refined.
+ * @duration: the duration, in seconds.
+ *
+ * Records the duration of @object_id.  Only the latest duration is written.
+ */
+void mafw_gst_renderer_stats_journal_add_duration(
+	MafwGstRendererStatsJournal *journal, const gchar *object_id,
+	gint duration)
+{
+	JournalEntry *entry;
+
+	g_return_if_fail(journal != NULL);
+	g_return_if_fail(object_id != NULL);
+
+	entry = g_hash_table_lookup(journal->entries, object_id);
+	if (entry != NULL && entry->duration == duration)
+		return;
+	entry = _get_entry(journal, object_id);
+	entry->duration = duration;
+
+	_schedule_flush(journal);
+}
+
+/**
+ * mafw_gst_renderer_stats_journal_get_pending:
+ * @journal: a journal.
+ *
+ * Returns: the number of objects with updates not written yet.
+ */
+guint mafw_gst_renderer_stats_journal_get_pending(
+	MafwGstRendererStatsJournal *journal)
+{
+	g_return_val_if_fail(journal != NULL, 0);
+
+	return g_hash_table_size(journal->entries);
+}
+
+/**
+ * mafw_gst_renderer_stats_journal_flush:
+ * @journal: a journal.
+ *
+ * Persists the pending updates, then writes them to their sources, grouped
+ * by source.  Updates stay in the journal until their source has taken
+ * them: those for objects whose source is not available, or whose write
+ * failed, are kept for the next flush.
+ */
+void mafw_gst_renderer_stats_journal_flush(
+	MafwGstRendererStatsJournal *journal)
+{
+	GHashTable *by_source;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_return_if_fail(journal != NULL);
+
+	if (journal->flush_id != 0) {
+		g_source_remove(journal->flush_id);
+		journal->flush_id = 0;
+	}
+
+	if (g_hash_table_size(journal->entries) == 0) {
+		_save(journal);
+		return;
+	}
+
+	g_debug("flushing %u pending stats updates",
+		g_hash_table_size(journal->entries));
+
+	/* Source ID -> list of object IDs */
+	by_source = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					  NULL);
+	g_hash_table_iter_init(&iter, journal->entries);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		JournalEntry *entry = value;
+		gchar *sourceid = NULL;
+		GSList *objects;
+
+		/* Taken again once the write on its way is over */
+		if (entry->writing)
+			continue;
+		if (!mafw_source_split_objectid(key, &sourceid, NULL)) {
+			g_warning("Dropping stats for invalid object ID %s",
+				  (gchar *) key);
+			g_hash_table_iter_remove(&iter);
+			journal->dirty = TRUE;
+			continue;
+		}
+		objects = g_hash_table_lookup(by_source, sourceid);
+		objects = g_slist_prepend(objects, key);
+		g_hash_table_insert(by_source, sourceid, objects);
+	}
+
+	/* Held until all the writes are on their way, so that the journal
+	 * is saved once for the batch even if the sources answer right
+	 * away */
+	_save(journal);
+	journal->refcount++;
+	journal->writing++;
+
+	g_hash_table_iter_init(&iter, by_source);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		MafwSource *source;
+		GSList *item;
+
+		source = MAFW_SOURCE(mafw_registry_get_extension_by_uuid(
+					     journal->registry, key));
+		if (source == NULL) {
+			g_debug("source %s not available, keeping its stats",
+				(gchar *) key);
+		} else {
+			for (item = value; item != NULL; item = item->next)
+				_flush_entry(journal, source, item->data,
+					     g_hash_table_lookup(
+						     journal->entries,
+						     item->data));
+		}
+		g_slist_free(value);
+	}
+
+	g_hash_table_unref(by_source);
+
+	_write_finished(journal);
+}
+
+/**
+ * mafw_gst_renderer_stats_journal_destroy:
+ * @journal: a journal.
+ *
+ * Flushes the pending updates and frees @journal, once the writes on their
+ * way are over.  Whatever could not be written stays on disk for the next
+ * instance.
+ */
+void mafw_gst_renderer_stats_journal_destroy(
+	MafwGstRendererStatsJournal *journal)
+{
+	g_return_if_fail(journal != NULL);
+
+	mafw_gst_renderer_stats_journal_flush(journal);
+	_journal_unref(journal);
+}
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -0,0 +1,55 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_GST_RENDERER_STATS_JOURNAL_H
+#define MAFW_GST_RENDERER_STATS_JOURNAL_H
+
+#include <glib.h>
+#include <libmafw/mafw-registry.h>
+
+typedef struct _MafwGstRendererStatsJournal MafwGstRendererStatsJournal;
+
+G_BEGIN_DECLS
+
+MafwGstRendererStatsJournal *mafw_gst_renderer_stats_journal_new(
+	MafwRegistry *registry, const gchar *uuid);
+
+void mafw_gst_renderer_stats_journal_add_play(
+	MafwGstRendererStatsJournal *journal, const gchar *object_id,
+	gint64 last_played);
+void mafw_gst_renderer_stats_journal_add_duration(
+	MafwGstRendererStatsJournal *journal, const gchar *object_id,
+	gint duration);
+
+guint mafw_gst_renderer_stats_journal_get_pending(
+	MafwGstRendererStatsJournal *journal);
+void mafw_gst_renderer_stats_journal_flush(
+	MafwGstRendererStatsJournal *journal);
+
+void mafw_gst_renderer_stats_journal_destroy(
+	MafwGstRendererStatsJournal *journal);
+
+G_END_DECLS
+#endif
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -26,7 +26,12 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <glib.h>
+#include <gio/gio.h>
+#include <gst/gst.h>
 
 #include "mafw-gst-renderer-utils.h"
 
@@ -102,4 +107,195 @@ gboolean uri_is_stream(const gchar *uri)
 	}
 }
 
+/**
+ * uri_is_audio:
+ * @uri: the URI to be checked.
+ *
+ * Guesses from its name whether @uri is audio only.  Playlists and names
+ * that tell nothing are not.
+ *
+ * Returns: TRUE if the URI is most likely audio only.
+ */
+gboolean uri_is_audio(const gchar *uri)
+{
+	gchar *name, *type, *mime;
+	gboolean uncertain, audio;
+
+	if (uri == NULL || uri_is_playlist(uri))
+		return FALSE;
+
+	name = g_path_get_basename(uri);
+	type = g_content_type_guess(name, NULL, 0, &uncertain);
+	mime = g_content_type_get_mime_type(type);
+	audio = !uncertain && mime != NULL && g_str_has_prefix(mime, "audio/");
+
+	g_free(mime);
+	g_free(type);
+	g_free(name);
+
+	return audio;
+}
+
+/*
+ * Milliseconds since the process started, -1 if it cannot be told.  Both
+ * the start time in /proc/self/stat and /proc/uptime count from boot.
+ */
+static gint64 _process_age(void)
+{
+	gchar *stat = NULL, *fields;
+	gdouble uptime;
+	unsigned long long start;
+	FILE *file;
+	gint64 age = -1;
+
+	file = fopen("/proc/uptime", "r");
+	if (file == NULL)
+		return -1;
+	if (fscanf(file, "%lf", &uptime) != 1)
+		uptime = -1;
+	fclose(file);
+
+	/* The command name may hold spaces, the fields start after it */
+	if (uptime >= 0 &&
+	    g_file_get_contents("/proc/self/stat", &stat, NULL, NULL) &&
+	    (fields = strrchr(stat, ')')) != NULL &&
+	    sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+		   "%*u %*u %*d %*d %*d %*d %*d %*d %llu", &start) == 1) {
+		age = uptime * 1000 - start * 1000 / sysconf(_SC_CLK_TCK);
+	}
+	g_free(stat);
+
+	return age;
+}
+
+/**
+ * startup_trace:
+ * @step: what has just been done.
+ *
+ * Logs how long after the start of the process @step was reached, and
+ * how long after the previous step.
+ */
+void startup_trace(const gchar *step)
+{
+	static gint64 previous = -1;
+	gint64 age;
+
+	age = _process_age();
+	if (age < 0)
+		return;
+	g_debug("startup: %s at %" G_GINT64_FORMAT " ms (+%" G_GINT64_FORMAT
+		" ms)", step, age, previous < 0 ? age : age - previous);
+	previous = age;
+}
+
+/**
+ * mp4_read_moov:
+ * @file: an MP4 file, at its beginning.
+ * @size: where to return the size of the payload.
+ *
+ * Reads the payload of the moov atom of @file, up to
+ * %MP4_MAX_MOOV_SIZE bytes.
+ *
+ * Returns: the payload, to be freed with g_free(), or NULL.
+ */
+guchar *mp4_read_moov(FILE *file, gsize *size)
+{
+	guchar header[8];
+	guchar *moov;
+
+	while (fread(header, 1, 8, file) == 8) {
+		guint32 atom_size = GST_READ_UINT32_BE(header);
+
+		if (atom_size < 8)
+			return NULL;
+		if (!memcmp(header + 4, "moov", 4)) {
+			if (atom_size > MP4_MAX_MOOV_SIZE)
+				return NULL;
+			*size = atom_size - 8;
+			moov = g_malloc(*size);
+			if (fread(moov, 1, *size, file) != *size) {
+				g_free(moov);
+				return NULL;
+			}
+			return moov;
+		}
+		if (fseek(file, atom_size - 8, SEEK_CUR) != 0)
+			return NULL;
+	}
+	return NULL;
+}
+
+/**
+ * mp4_find_atom:
+ * @parent: payload of an MP4 atom.
+ * @size: size of @parent.
+ * @type: the four characters of the atom looked for.
+ * @payload_size: where to return the size of the payload.
+ *
+ * Returns: the payload of the first child atom of @parent of @type, or
+ * NULL.
+ */
+const guchar *mp4_find_atom(const guchar *parent, gsize size,
+			    const gchar *type, gsize *payload_size)
+{
+	const guchar *p = parent;
+
+	while (p + 8 <= parent + size) {
+		guint32 atom_size = GST_READ_UINT32_BE(p);
+
+		if (atom_size < 8 || p + atom_size > parent + size)
+			return NULL;
+		if (!memcmp(p + 4, type, 4)) {
+			*payload_size = atom_size - 8;
+			return p + 8;
+		}
+		p += atom_size;
+	}
+	return NULL;
+}
+
+static gboolean _mp4_track_has_handler(const guchar *trak, gsize size,
+				       const gchar *handler)
+{
+	const guchar *mdia, *hdlr;
+	gsize mdia_size, hdlr_size;
+
+	mdia = mp4_find_atom(trak, size, "mdia", &mdia_size);
+	if (mdia == NULL)
+		return FALSE;
+	hdlr = mp4_find_atom(mdia, mdia_size, "hdlr", &hdlr_size);
+	return hdlr != NULL && hdlr_size >= 12 &&
+		!memcmp(hdlr + 8, handler, 4);
+}
+
+/**
+ * mp4_find_track:
+ * @moov: payload of a moov atom.
+ * @moov_size: size of @moov.
+ * @handler: handler type of the track looked for, "soun" or "vide".
+ * @trak_size: where to return the size of the payload.
+ *
+ * Returns: the payload of the first trak atom of @moov with @handler, or
+ * NULL.
+ */
+const guchar *mp4_find_track(const guchar *moov, gsize moov_size,
+			     const gchar *handler, gsize *trak_size)
+{
+	const guchar *p = moov;
+
+	while (p + 8 <= moov + moov_size) {
+		guint32 atom_size = GST_READ_UINT32_BE(p);
+
+		if (atom_size < 8 || p + atom_size > moov + moov_size)
+			return NULL;
+		if (!memcmp(p + 4, "trak", 4) &&
+		    _mp4_track_has_handler(p + 8, atom_size - 8, handler)) {
+			*trak_size = atom_size - 8;
+			return p + 8;
+		}
+		p += atom_size;
+	}
+	return NULL;
+}
+
 /* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
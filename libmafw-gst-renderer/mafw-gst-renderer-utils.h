@@ -23,11 +23,24 @@
 #ifndef MAFW_GST_RENDERER_UTILS_H
 #define MAFW_GST_RENDERER_UTILS_H
 
+#include <stdio.h>
+#include <glib.h>
+
+/* Larger moov atoms are not worth reading for metadata */
+#define MP4_MAX_MOOV_SIZE (8 * 1024 * 1024)
+
 G_BEGIN_DECLS
 
 gboolean convert_utf8(const gchar *src, gchar **dst);
 gboolean uri_is_playlist(const gchar *uri);
 gboolean uri_is_stream(const gchar *uri);
+gboolean uri_is_audio(const gchar *uri);
+void startup_trace(const gchar *step);
+guchar *mp4_read_moov(FILE *file, gsize *size);
+const guchar *mp4_find_atom(const guchar *parent, gsize size,
+			    const gchar *type, gsize *payload_size);
+const guchar *mp4_find_track(const guchar *moov, gsize moov_size,
+			     const gchar *handler, gsize *trak_size);
 
 G_END_DECLS
 #endif
@@ -0,0 +1,431 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "mafw-gst-renderer-warmup.h"
+
+#undef  G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-gst-renderer-warmup"
+
+/* Warm-up is disabled with the enabled key of the [warmup] group of the
+ * decoder configuration, and the factories key lists what to warm up
+ * instead of what was used most. */
+#define MAFW_GST_RENDERER_WARMUP_CONFIG "mafw-gst-renderer/decoders.conf"
+/* How many times each demuxer, parser and decoder was used, in the user
+ * cache directory */
+#define MAFW_GST_RENDERER_WARMUP_DIR "mafw-gst-renderer"
+#define MAFW_GST_RENDERER_WARMUP_FILE "warmup"
+#define MAFW_GST_RENDERER_WARMUP_GROUP "factories"
+
+/* Factories warmed up at most */
+#define MAFW_GST_RENDERER_WARMUP_MAX_FACTORIES 8
+/* Delay before saving what was used, not to write while starting to
+ * play */
+#define MAFW_GST_RENDERER_WARMUP_SECONDS_SAVE 30
+
+/* Plugins every media needs */
+static const gchar *common_plugins[] = {
+	"playback", "coreelements", "typefindfunctions", "pulseaudio", NULL
+};
+
+/* Formats warmed up until there is some history */
+static const gchar *default_caps[] = {
+	"application/x-id3",
+	"audio/mpeg, mpegversion=(int)1, layer=(int)3, parsed=(boolean)true",
+	"audio/mpeg, mpegversion=(int)4, stream-format=(string)raw",
+	"video/quicktime",
+	"application/ogg",
+	"audio/x-vorbis",
+	NULL
+};
+
+typedef enum {
+	WARMUP_DISABLED,
+	WARMUP_PENDING,
+	WARMUP_RUNNING,
+	WARMUP_DONE
+} WarmupStatus;
+
+static const gchar *status_names[] = {
+	"disabled", "pending", "running", "done"
+};
+
+G_LOCK_DEFINE_STATIC(warmup);
+static WarmupStatus status = WARMUP_DISABLED;
+static gboolean started;
+/* Warm-up and history saving run in a thread of their own, shared by all
+ * the renderers of the process */
+static GMainContext *context;
+static GSource *warming;
+static GSource *saving;
+static GKeyFile *history;
+static gchar *history_path;
+/* Factory names still to warm up */
+static GQueue *pending;
+
+static gint _compare_uses(gconstpointer a, gconstpointer b)
+{
+	gint uses_a, uses_b;
+
+	uses_a = g_key_file_get_integer(history, MAFW_GST_RENDERER_WARMUP_GROUP,
+					a, NULL);
+	uses_b = g_key_file_get_integer(history, MAFW_GST_RENDERER_WARMUP_GROUP,
+					b, NULL);
+	return uses_b - uses_a;
+}
+
+static void _queue_factory(GstElementFactory *factory)
+{
+	const gchar *name = GST_OBJECT_NAME(factory);
+
+	if (!g_queue_find_custom(pending, name, (GCompareFunc) strcmp))
+		g_queue_push_tail(pending, g_strdup(name));
+}
+
+/*
+ * The demuxer, parser or decoder decodebin would pick for each of the
+ * default formats.
+ */
+static void _queue_defaults(void)
+{
+	GList *factories;
+	gint i;
+
+	factories = gst_element_factory_list_get_elements(
+		GST_ELEMENT_FACTORY_TYPE_DECODABLE, GST_RANK_MARGINAL);
+	factories = g_list_sort(factories,
+				gst_plugin_feature_rank_compare_func);
+
+	for (i = 0; default_caps[i] != NULL; i++) {
+		GstCaps *caps;
+		GList *usable;
+
+		caps = gst_caps_from_string(default_caps[i]);
+		usable = gst_element_factory_list_filter(factories, caps,
+							 GST_PAD_SINK, FALSE);
+		if (usable != NULL)
+			_queue_factory(usable->data);
+		gst_plugin_feature_list_free(usable);
+		gst_caps_unref(caps);
+	}
+	gst_plugin_feature_list_free(factories);
+}
+
+static void _queue_most_used(void)
+{
+	gchar **names;
+	GList *sorted = NULL, *l;
+	gint count = 0;
+
+	names = g_key_file_get_keys(history, MAFW_GST_RENDERER_WARMUP_GROUP,
+				    NULL, NULL);
+	if (names == NULL)
+		return;
+
+	for (count = 0; names[count] != NULL; count++)
+		sorted = g_list_prepend(sorted, names[count]);
+	sorted = g_list_sort(sorted, _compare_uses);
+
+	count = 0;
+	for (l = sorted; l != NULL &&
+		     count < MAFW_GST_RENDERER_WARMUP_MAX_FACTORIES;
+	     l = l->next, count++)
+		g_queue_push_tail(pending, g_strdup(l->data));
+
+	g_list_free(sorted);
+	g_strfreev(names);
+}
+
+/*
+ * Loads the plugin of one factory and instantiates an element from it,
+ * which also initializes its class.  One per dispatch, so that it stops
+ * soon after mafw_gst_renderer_warmup_stop().
+ */
+static gboolean _warm_up_next(gpointer data)
+{
+	GstElementFactory *factory;
+	GstElement *element;
+	gchar *name;
+	gint64 start;
+
+	G_LOCK(warmup);
+	name = g_queue_pop_head(pending);
+	if (name == NULL) {
+		g_debug("warm-up done");
+		status = WARMUP_DONE;
+		g_source_unref(warming);
+		warming = NULL;
+		G_UNLOCK(warmup);
+		return FALSE;
+	}
+	G_UNLOCK(warmup);
+
+	start = g_get_monotonic_time();
+	factory = gst_element_factory_find(name);
+	if (factory != NULL) {
+		element = gst_element_factory_create(factory, NULL);
+		if (element != NULL)
+			gst_object_unref(element);
+		gst_object_unref(factory);
+		g_debug("warmed up %s in %" G_GINT64_FORMAT " us", name,
+			g_get_monotonic_time() - start);
+	}
+	g_free(name);
+
+	return TRUE;
+}
+
+/*
+ * The common plugins, and those of the type finders, which are all tried
+ * on every media, are loaded first.
+ */
+static void _load_common_plugins(void)
+{
+	GList *typefinders, *l;
+	gint i;
+
+	for (i = 0; common_plugins[i] != NULL; i++) {
+		GstPlugin *plugin = gst_plugin_load_by_name(common_plugins[i]);
+
+		if (plugin != NULL)
+			gst_object_unref(plugin);
+		else
+			g_debug("cannot load plugin %s", common_plugins[i]);
+	}
+
+	typefinders = gst_type_find_factory_get_list();
+	for (l = typefinders; l != NULL; l = l->next) {
+		GstPluginFeature *loaded;
+
+		loaded = gst_plugin_feature_load(l->data);
+		if (loaded != NULL)
+			gst_object_unref(loaded);
+	}
+	gst_plugin_feature_list_free(typefinders);
+}
+
+static gboolean _start_warm_up(gpointer data)
+{
+	/* Every media needs them, with warm-up disabled too */
+	_load_common_plugins();
+
+	G_LOCK(warmup);
+	if (status == WARMUP_PENDING) {
+		status = WARMUP_RUNNING;
+		warming = g_idle_source_new();
+		g_source_set_priority(warming, G_PRIORITY_LOW);
+		g_source_set_callback(warming, _warm_up_next, NULL, NULL);
+		g_source_attach(warming, context);
+	}
+	G_UNLOCK(warmup);
+
+	return FALSE;
+}
+
+static gpointer _thread(gpointer data)
+{
+	GMainLoop *loop;
+
+	g_main_context_push_thread_default(context);
+	loop = g_main_loop_new(context, FALSE);
+	g_main_loop_run(loop);
+
+	return NULL;
+}
+
+static gpointer _init(gpointer data)
+{
+	GKeyFile *config;
+	gchar *path, **factories = NULL;
+	gboolean enabled = TRUE;
+	gint i;
+
+	config = g_key_file_new();
+	path = g_build_filename(g_get_user_config_dir(),
+				MAFW_GST_RENDERER_WARMUP_CONFIG, NULL);
+	if (g_key_file_load_from_file(config, path, G_KEY_FILE_NONE, NULL)) {
+		if (g_key_file_has_key(config, "warmup", "enabled", NULL))
+			enabled = g_key_file_get_boolean(config, "warmup",
+							 "enabled", NULL);
+		factories = g_key_file_get_string_list(config, "warmup",
+						       "factories", NULL,
+						       NULL);
+	}
+	g_free(path);
+	g_key_file_free(config);
+
+	path = g_build_filename(g_get_user_cache_dir(),
+				MAFW_GST_RENDERER_WARMUP_DIR, NULL);
+	g_mkdir_with_parents(path, 0700);
+	history_path = g_build_filename(path, MAFW_GST_RENDERER_WARMUP_FILE,
+					NULL);
+	g_free(path);
+	history = g_key_file_new();
+	g_key_file_load_from_file(history, history_path, G_KEY_FILE_NONE,
+				  NULL);
+
+	context = g_main_context_new();
+	g_thread_unref(g_thread_new("mafw-gst-renderer-warmup", _thread,
+				    NULL));
+
+	if (!enabled) {
+		g_strfreev(factories);
+		return NULL;
+	}
+
+	pending = g_queue_new();
+	if (factories != NULL) {
+		for (i = 0; factories[i] != NULL; i++)
+			g_queue_push_tail(pending, g_strdup(factories[i]));
+	} else {
+		_queue_most_used();
+		if (g_queue_is_empty(pending))
+			_queue_defaults();
+	}
+	g_strfreev(factories);
+	status = WARMUP_PENDING;
+
+	return NULL;
+}
+
+/**
+ * mafw_gst_renderer_warmup_start:
+ *
+ * Loads and instantiates, in a thread of its own, the type finders and
+ * the demuxers, parsers and decoders used most so far, so that the first
+ * media played does not wait for them.  If warm-up is disabled, only
+ * the plugins every media needs are loaded.  Does nothing after the
+ * first call.
+ */
+void mafw_gst_renderer_warmup_start(void)
+{
+	static GOnce once = G_ONCE_INIT;
+	GSource *source;
+
+	g_once(&once, _init, NULL);
+
+	G_LOCK(warmup);
+	if (started) {
+		G_UNLOCK(warmup);
+		return;
+	}
+	started = TRUE;
+	G_UNLOCK(warmup);
+
+	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_LOW);
+	g_source_set_callback(source, _start_warm_up, NULL, NULL);
+	g_source_attach(source, context);
+	g_source_unref(source);
+}
+
+/**
+ * mafw_gst_renderer_warmup_stop:
+ *
+ * Stops warming up: playback started, and loads what it needs itself.
+ */
+void mafw_gst_renderer_warmup_stop(void)
+{
+	G_LOCK(warmup);
+	if (status == WARMUP_PENDING || status == WARMUP_RUNNING) {
+		g_debug("warm-up stopped, %u factories left",
+			pending ? g_queue_get_length(pending) : 0);
+		status = WARMUP_DONE;
+		if (warming != NULL) {
+			g_source_destroy(warming);
+			g_source_unref(warming);
+			warming = NULL;
+		}
+	}
+	G_UNLOCK(warmup);
+}
+
+/**
+ * mafw_gst_renderer_warmup_status:
+ *
+ * Returns: "disabled", "pending", "running" or "done".
+ */
+const gchar *mafw_gst_renderer_warmup_status(void)
+{
+	return status_names[status];
+}
+
+static gboolean _save_history(gpointer data)
+{
+	G_LOCK(warmup);
+	if (!g_key_file_save_to_file(history, history_path, NULL))
+		g_warning("could not save %s", history_path);
+	g_source_unref(saving);
+	saving = NULL;
+	G_UNLOCK(warmup);
+
+	return FALSE;
+}
+
+/**
+ * mafw_gst_renderer_warmup_learn:
+ * @element: an element just created for playback.
+ *
+ * Counts the use of @element, if it is a demuxer, parser or decoder.  The
+ * ones used most are warmed up in the next sessions.
+ */
+void mafw_gst_renderer_warmup_learn(GstElement *element)
+{
+	GstElementFactory *factory;
+	const gchar *name;
+
+	g_return_if_fail(GST_IS_ELEMENT(element));
+
+	factory = gst_element_get_factory(element);
+	if (history == NULL || factory == NULL ||
+	    !gst_element_factory_list_is_type(
+		    factory, GST_ELEMENT_FACTORY_TYPE_DECODABLE))
+		return;
+
+	name = GST_OBJECT_NAME(factory);
+	G_LOCK(warmup);
+	g_key_file_set_integer(history, MAFW_GST_RENDERER_WARMUP_GROUP, name,
+			       g_key_file_get_integer(
+				       history,
+				       MAFW_GST_RENDERER_WARMUP_GROUP,
+				       name, NULL) + 1);
+	if (saving == NULL && context != NULL) {
+		saving = g_timeout_source_new_seconds(
+			MAFW_GST_RENDERER_WARMUP_SECONDS_SAVE);
+		g_source_set_priority(saving, G_PRIORITY_LOW);
+		g_source_set_callback(saving, _save_history, NULL, NULL);
+		g_source_attach(saving, context);
+	}
+	G_UNLOCK(warmup);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
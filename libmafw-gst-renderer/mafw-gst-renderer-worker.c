@@ -26,7 +26,10 @@
 #endif
 
 #include <string.h>
+#include <sys/resource.h>
 #include <glib.h>
+#include <glib-unix.h>
+#include <gobject/gvaluecollector.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xvlib.h>
 
@@ -49,6 +52,13 @@
 #include "mafw-gst-renderer.h"
 #include "mafw-gst-renderer-worker.h"
 #include "mafw-gst-renderer-utils.h"
+#include "mafw-gst-renderer-decoder-policy.h"
+#include "mafw-gst-renderer-converter-audit.h"
+#include "mafw-gst-renderer-decoder-ranking.h"
+#include "mafw-gst-renderer-gapless.h"
+#include "mafw-gst-renderer-warmup.h"
+#include "mafw-gst-renderer-autoplug-cache.h"
+#include "mafw-gst-renderer-seek-index.h"
 #include "blanking.h"
 #include "keypad.h"
 
@@ -57,12 +67,76 @@
 
 #define MAFW_GST_RENDERER_WORKER_SECONDS_READY 60
 #define MAFW_GST_RENDERER_WORKER_SECONDS_DURATION_AND_SEEKABILITY 4
+#define MAFW_GST_RENDERER_WORKER_SECONDS_CONVERTER_AUDIT 10
 
 #define MAFW_GST_MISSING_TYPE_DECODER "decoder"
 #define MAFW_GST_MISSING_TYPE_ENCODER "encoder"
 
-#define MAFW_GST_BUFFER_TIME  600000L
-#define MAFW_GST_LATENCY_TIME (MAFW_GST_BUFFER_TIME / 2)
+/* Scale the video down before the sink when the window is at least this
+ * many times smaller than the video */
+#define MAFW_GST_RENDERER_WORKER_DOWNSCALE_FACTOR 1.5
+
+/* QoS governor: a measuring window that drops at least this percentage of
+ * the frames raises the degradation level, that many seconds without
+ * drops lowers it again. */
+#define MAFW_GST_RENDERER_WORKER_QOS_WINDOW (2 * G_USEC_PER_SEC)
+#define MAFW_GST_RENDERER_WORKER_QOS_DROP_PERCENT 20
+#define MAFW_GST_RENDERER_WORKER_QOS_SECONDS_RELAX 5
+#define MAFW_GST_RENDERER_WORKER_QOS_MAX_LEVEL 3
+
+/* playbin flags: video, audio and native video.  With native video no
+ * converter is plugged before the video sink, the decoder negotiates one
+ * of its formats (I420/YV12 for xvimagesink, the GL upload formats for
+ * glimagesink) directly.  Audio keeps its converters: pulsesink takes
+ * most formats and rates as they are, so they are mostly passthrough. */
+#define MAFW_GST_PLAY_FLAGS 0x43
+#define MAFW_GST_PLAY_FLAG_VIDEO 0x1
+
+/* Audio output profiles: how much audio pulsesink buffers (buffer-time)
+ * and how often it wakes up to refill it (latency-time), in microseconds.
+ * The sink sizes its ring buffer when it gets caps, so a new profile takes
+ * effect the next time it opens its stream: next media, or resuming from
+ * READY. */
+static const struct {
+	const gchar *name;
+	gint64 buffer_time;
+	gint64 latency_time;
+} output_profiles[_LAST_OUTPUT_PROFILE] = {
+	[OUTPUT_PROFILE_AUDIO] = { "audio", 600000, 300000 },
+	/* Short, so that the audio latency does not spoil lip-sync */
+	[OUTPUT_PROFILE_VIDEO] = { "video", 100000, 10000 },
+	/* Screen off: wake up as rarely as possible */
+	[OUTPUT_PROFILE_POWER_SAVE] = { "power-save", 2000000, 1000000 },
+	/* Network streams: room for the jitter, but short segments so the
+	 * sink keeps following the source */
+	[OUTPUT_PROFILE_LIVE] = { "live", 1000000, 100000 },
+};
+
+/* Every audio underrun adds this much to the buffer time of the profile,
+ * up to the maximum.  It is taken back step by step once playback has
+ * been smooth for that many seconds. */
+#define MAFW_GST_RENDERER_WORKER_OUTPUT_GROW_STEP 50000
+#define MAFW_GST_RENDERER_WORKER_OUTPUT_MAX_EXTRA 200000
+#define MAFW_GST_RENDERER_WORKER_OUTPUT_SECONDS_STABLE 60
+/* How long moving the audio stream to another output may take */
+#define MAFW_GST_RENDERER_WORKER_OUTPUT_SECONDS_SWITCH 3
+
+/* HTTP streams dropping the connection are reopened this many times, the
+ * first retry after that many seconds and each next one after twice as
+ * long.  The budget is given back once the stream has held up for a
+ * while. */
+#define MAFW_GST_RENDERER_WORKER_RECONNECT_ATTEMPTS 5
+#define MAFW_GST_RENDERER_WORKER_RECONNECT_SECONDS 1
+#define MAFW_GST_RENDERER_WORKER_RECONNECT_SECONDS_STABLE 30
+
+/* Start position seek, see _seek_at_first_segment() */
+enum {
+	START_SEEK_NONE,
+	/* Waiting for the first segment at the audio sink */
+	START_SEEK_ARMED,
+	/* Seek issued, the audio sink drops buffers until it flushes */
+	START_SEEK_ISSUED,
+};
 
 #define NSECONDS_TO_SECONDS(ns) ((ns)%1000000000 < 500000000?\
                                  GST_TIME_AS_SECONDS((ns)):\
@@ -78,18 +152,492 @@
 					key, type, 1, value); \
 		} while (0)
 
+/* How to hold the media once prerolled, instead of playing it */
+typedef struct {
+	gint audio;
+	gint text;
+	gboolean release;
+} PausedPlay;
+
 /* Private variables. */
-/* Global reference to worker instance, needed for Xerror handler */
-static MafwGstRendererWorker *Global_worker = NULL;
+/* All the worker instances, needed for the process wide Xerror handler */
+G_LOCK_DEFINE_STATIC(workers);
+static GSList *workers = NULL;
+/* Protects the teardown counters of the workers */
+G_LOCK_DEFINE_STATIC(teardown);
+/* Protects the notifications the workers queued for their owner */
+G_LOCK_DEFINE_STATIC(owner_calls);
 
 /* Forward declarations. */
 static void _do_play(MafwGstRendererWorker *worker);
 static void _do_seek(MafwGstRendererWorker *worker, GstSeekType seek_type,
 		     gboolean relative, gint position, GError **error);
 static void _play_pl_next(MafwGstRendererWorker *worker);
+static void _play_at(MafwGstRendererWorker *worker, const gchar *uri,
+		     GSList *plitems, gint position,
+		     const PausedPlay *paused);
+static void _stop(MafwGstRendererWorker *worker);
+static void _seek_at_first_segment(MafwGstRendererWorker *worker,
+				   gint position);
+static gboolean _start_seek_probe(MafwGstRendererWorker *worker,
+				  GstObject *top, GstPadProbeInfo *info);
+static void _qos_reset(MafwGstRendererWorker *worker);
+static void _refresh_video_window(MafwGstRendererWorker *worker);
 
 static void _emit_metadatas(MafwGstRendererWorker *worker);
 
+/* Worker thread and owner notifications */
+typedef void (*WorkerOwnerFunc)(MafwGstRendererWorker *worker, gpointer data);
+
+typedef struct {
+	MafwGstRendererWorker *worker;
+	guint generation;
+	WorkerOwnerFunc func;
+	gpointer data;
+	GDestroyNotify destroy;
+	GSource *source;
+} OwnerCall;
+
+typedef struct {
+	WorkerOwnerFunc func;
+	gpointer data;
+	GDestroyNotify destroy;
+} WorkerCommand;
+
+typedef struct {
+	gchar *uri;
+	gchar **uris;
+	GSList *plitems;
+	gint position;
+	PausedPlay *paused;
+	guint generation;
+} PlayCommand;
+
+typedef struct {
+	GstSeekType seek_type;
+	gboolean relative;
+	gint position;
+} SeekCommand;
+
+typedef struct {
+	gchar *key;
+	GValueArray *values;
+} MetadataClosure;
+
+typedef struct {
+	MafwGstRendererWorker *worker;
+	guint generation;
+	gint64 start;
+	gint64 stop;
+} GaplessTrims;
+
+static gpointer _worker_thread(gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
+
+	g_main_context_push_thread_default(worker->context);
+	g_main_loop_run(worker->loop);
+	g_main_context_pop_thread_default(worker->context);
+
+	return NULL;
+}
+
+static void _worker_thread_quit(MafwGstRendererWorker *worker, gpointer data)
+{
+	g_main_loop_quit(worker->loop);
+}
+
+static guint _worker_timeout_add_seconds(MafwGstRendererWorker *worker,
+					 guint seconds, GSourceFunc func)
+{
+	GSource *source;
+	guint id;
+
+	source = g_timeout_source_new_seconds(seconds);
+	g_source_set_callback(source, func, worker, NULL);
+	id = g_source_attach(source, worker->context);
+	g_source_unref(source);
+
+	return id;
+}
+
+static void _worker_source_remove(MafwGstRendererWorker *worker, guint id)
+{
+	GSource *source;
+
+	source = g_main_context_find_source_by_id(worker->context, id);
+	if (source != NULL)
+		g_source_destroy(source);
+}
+
+/*
+ * Takes the worker lock from a source dispatched in the worker thread.
+ * Returns FALSE if the source was removed while we were waiting for it.
+ */
+static gboolean _worker_dispatch_lock(MafwGstRendererWorker *worker)
+{
+	g_rec_mutex_lock(&worker->lock);
+
+	if (g_source_is_destroyed(g_main_current_source())) {
+		g_rec_mutex_unlock(&worker->lock);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Gets the position in the worker thread, rounded down into precision of
+ * one second.  If a seek is pending, returns the position we are going to
+ * seek.  Returns -1 on failure.
+ */
+static gint _get_position(MafwGstRendererWorker *worker)
+{
+	gint64 time = 0;
+
+	if (worker->seek_position != -1)
+		return worker->seek_position;
+	if (worker->pipeline &&
+	    gst_element_query_position(worker->pipeline, GST_FORMAT_TIME,
+				       &time))
+		return (gint)(NSECONDS_TO_SECONDS(time));
+	return -1;
+}
+
+/*
+ * Publishes what the owner reads of the worker state.  The owner never
+ * takes the worker lock, so it is not held up by slow commands.
+ */
+static void _publish(MafwGstRendererWorker *worker)
+{
+	GstElement *old = NULL;
+	gint i;
+
+	g_mutex_lock(&worker->shared.lock);
+	if (worker->shared.pipeline != worker->pipeline) {
+		old = worker->shared.pipeline;
+		worker->shared.pipeline = worker->pipeline != NULL ?
+			gst_object_ref(worker->pipeline) : NULL;
+	}
+	worker->shared.has_media = worker->media.location != NULL;
+	worker->shared.seek_position = worker->seek_position;
+	worker->shared.eos = worker->eos;
+	worker->shared.seekable = worker->media.seekable;
+	worker->shared.endless = worker->is_stream &&
+		worker->media.length_nanos == -1 &&
+		worker->media.seekable == SEEKABILITY_NO_SEEKABLE;
+	worker->shared.active = worker->output.active;
+	worker->shared.since = worker->output.since;
+	worker->shared.wakeups_since = worker->output.wakeups_since;
+	for (i = 0; i < _LAST_OUTPUT_PROFILE; i++) {
+		worker->shared.stats[i].usecs = worker->output.stats[i].usecs;
+		worker->shared.stats[i].wakeups =
+			worker->output.stats[i].wakeups;
+	}
+	worker->shared.switch_latency = worker->output.switch_latency;
+	worker->shared.switch_dropped = worker->output.switch_dropped;
+	g_mutex_unlock(&worker->shared.lock);
+
+	if (old != NULL)
+		gst_object_unref(old);
+}
+
+/*
+ * Lets go of the worker lock taken in the worker thread, publishing the
+ * state first.
+ */
+static void _worker_unlock(MafwGstRendererWorker *worker)
+{
+	_publish(worker);
+	g_rec_mutex_unlock(&worker->lock);
+}
+
+/*
+ * Waits at most 2 seconds for the pipeline to complete its state change.
+ * The lock is let go meanwhile: only the worker thread changes the
+ * pipeline, and it is waiting here.
+ */
+static void _wait_for_state_change(MafwGstRendererWorker *worker)
+{
+	GstElement *pipeline = worker->pipeline;
+
+	_worker_unlock(worker);
+	gst_element_get_state(pipeline, NULL, NULL, 2 * GST_SECOND);
+	g_rec_mutex_lock(&worker->lock);
+}
+
+static gboolean _worker_command_dispatch(gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
+	WorkerCommand *command;
+
+	command = g_async_queue_try_pop(worker->commands);
+	if (command == NULL)
+		return FALSE;
+
+	g_rec_mutex_lock(&worker->lock);
+	command->func(worker, command->data);
+	_worker_unlock(worker);
+
+	if (command->destroy != NULL)
+		command->destroy(command->data);
+	g_free(command);
+
+	return FALSE;
+}
+
+/*
+ * Runs @func in the worker thread, after the commands queued before it.
+ * The owner does not wait for it, so it is never held up by the worker
+ * thread waiting for the pipeline.  @destroy is called on @data
+ * afterwards.
+ */
+static void _worker_command(MafwGstRendererWorker *worker,
+			    WorkerOwnerFunc func, gpointer data,
+			    GDestroyNotify destroy)
+{
+	WorkerCommand *command;
+	GSource *source;
+
+	command = g_new0(WorkerCommand, 1);
+	command->func = func;
+	command->data = data;
+	command->destroy = destroy;
+	g_async_queue_push(worker->commands, command);
+
+	/* Each source runs the oldest command, whatever the order the
+	 * sources are dispatched in */
+	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_HIGH);
+	g_source_set_callback(source, _worker_command_dispatch, worker, NULL);
+	g_source_attach(source, worker->context);
+	g_source_unref(source);
+}
+
+static gboolean _owner_call_dispatch(gpointer user_data)
+{
+	OwnerCall *call = user_data;
+	MafwGstRendererWorker *worker = call->worker;
+
+	G_LOCK(owner_calls);
+	worker->owner_calls = g_slist_remove(worker->owner_calls,
+					     call->source);
+	G_UNLOCK(owner_calls);
+
+	/* Drop what was queued for media that has been stopped since.  Only
+	 * the owner bumps the generation. */
+	if (call->generation == worker->generation)
+		call->func(worker, call->data);
+
+	return FALSE;
+}
+
+static void _owner_call_free(gpointer user_data)
+{
+	OwnerCall *call = user_data;
+
+	if (call->destroy != NULL)
+		call->destroy(call->data);
+	g_free(call);
+}
+
+/*
+ * Runs @func in the owner's main context.  Calls made from any other thread
+ * than the owner's are queued, in order; calls made from the owner run right
+ * away.  @destroy is called on @data afterwards.
+ */
+static void _invoke_owner(MafwGstRendererWorker *worker, WorkerOwnerFunc func,
+			  gpointer data, GDestroyNotify destroy)
+{
+	OwnerCall *call;
+
+	if (g_thread_self() == worker->owner_thread) {
+		func(worker, data);
+		if (destroy != NULL)
+			destroy(data);
+		return;
+	}
+
+	call = g_new0(OwnerCall, 1);
+	call->worker = worker;
+	call->generation = g_atomic_int_get(&worker->media_generation);
+	call->func = func;
+	call->data = data;
+	call->destroy = destroy;
+	call->source = g_idle_source_new();
+	g_source_set_priority(call->source, G_PRIORITY_HIGH);
+	g_source_set_callback(call->source, _owner_call_dispatch, call,
+			      _owner_call_free);
+	G_LOCK(owner_calls);
+	worker->owner_calls = g_slist_prepend(worker->owner_calls,
+					      call->source);
+	g_source_attach(call->source, worker->owner_context);
+	G_UNLOCK(owner_calls);
+	g_source_unref(call->source);
+}
+
+static void _call_play_handler(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->notify_play_handler)
+		worker->notify_play_handler(worker, worker->owner);
+}
+
+static void _call_pause_handler(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->notify_pause_handler)
+		worker->notify_pause_handler(worker, worker->owner);
+}
+
+static void _call_eos_handler(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->notify_eos_handler)
+		worker->notify_eos_handler(worker, worker->owner);
+}
+
+static void _call_buffer_status_handler(MafwGstRendererWorker *worker,
+					gpointer data)
+{
+	if (worker->notify_buffer_status_handler)
+		worker->notify_buffer_status_handler(worker, worker->owner,
+						     GPOINTER_TO_INT(data));
+}
+
+static void _call_error_handler(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->notify_error_handler)
+		worker->notify_error_handler(worker, worker->owner, data);
+}
+
+static void _notify_play(MafwGstRendererWorker *worker)
+{
+	_invoke_owner(worker, _call_play_handler, NULL, NULL);
+}
+
+static void _notify_pause(MafwGstRendererWorker *worker)
+{
+	_invoke_owner(worker, _call_pause_handler, NULL, NULL);
+}
+
+static void _emit_metadata_cb(MafwGstRendererWorker *worker, gpointer data)
+{
+	MetadataClosure *closure = data;
+
+	g_signal_emit_by_name(worker->owner, "metadata-changed", closure->key,
+			      closure->values);
+}
+
+static void _metadata_closure_free(gpointer data)
+{
+	MetadataClosure *closure = data;
+
+	g_free(closure->key);
+	g_value_array_free(closure->values);
+	g_free(closure);
+}
+
+/*
+ * Emits metadata-changed for @key in the owner's context.  Takes ownership of
+ * @values.
+ */
+static void _emit_metadata_values(MafwGstRendererWorker *worker,
+				  const gchar *key, GValueArray *values)
+{
+	MetadataClosure *closure;
+
+	closure = g_new0(MetadataClosure, 1);
+	closure->key = g_strdup(key);
+	closure->values = values;
+	_invoke_owner(worker, _emit_metadata_cb, closure,
+		      _metadata_closure_free);
+}
+
+/*
+ * Emits a single metadata value of @type, given as the variable argument.
+ */
+static void _emit_metadata(MafwGstRendererWorker *worker, const gchar *key,
+			   GType type, ...)
+{
+	GValue value = G_VALUE_INIT;
+	GValueArray *values;
+	gchar *error = NULL;
+	va_list args;
+
+	va_start(args, type);
+	G_VALUE_COLLECT_INIT(&value, type, args, 0, &error);
+	va_end(args);
+
+	if (error != NULL) {
+		g_warning("cannot emit %s: %s", key, error);
+		g_free(error);
+		return;
+	}
+
+	values = g_value_array_new(1);
+	g_value_array_append(values, &value);
+	g_value_unset(&value);
+	_emit_metadata_values(worker, key, values);
+}
+
+static void _update_source_duration_cb(MafwGstRendererWorker *worker,
+				       gpointer data)
+{
+	mafw_gst_renderer_update_source_duration(worker->owner,
+						 GPOINTER_TO_INT(data));
+}
+
+static void _playback_started_cb(MafwGstRendererWorker *worker,
+				 gpointer data)
+{
+	MafwGstRenderer *renderer = worker->owner;
+
+	renderer->play_failed_count = 0;
+}
+
+/*
+ * Blanking and keypad locking are shared by the renderers of the process and
+ * refcounted, so each worker takes and releases them at most once.
+ */
+static void _prohibit_blanking_cb(MafwGstRendererWorker *worker,
+				  gpointer data)
+{
+	/* Prevent blanking if we are playing video */
+	if (GPOINTER_TO_INT(data) && !worker->prohibits_blanking) {
+		/* Not needed before the first video */
+		if (!worker->blanking_initialized) {
+			blanking_init();
+			worker->blanking_initialized = TRUE;
+		}
+		blanking_prohibit();
+		worker->prohibits_blanking = TRUE;
+	}
+	if (!worker->prohibits_keypadlocking) {
+		keypadlocking_prohibit();
+		worker->prohibits_keypadlocking = TRUE;
+	}
+}
+
+static void _allow_blanking_cb(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->prohibits_blanking) {
+		blanking_allow();
+		worker->prohibits_blanking = FALSE;
+	}
+	if (worker->prohibits_keypadlocking) {
+		keypadlocking_allow();
+		worker->prohibits_keypadlocking = FALSE;
+	}
+}
+
+static void _cancel_stats_update_cb(MafwGstRendererWorker *worker,
+				    gpointer data)
+{
+	MafwGstRenderer *renderer = worker->owner;
+
+	if (renderer->update_playcount_id > 0) {
+		g_source_remove(renderer->update_playcount_id);
+		renderer->update_playcount_id = 0;
+	}
+}
+
 /* Playlist parsing */
 static void _on_pl_entry_parsed(TotemPlParser *parser, gchar *uri,
 				gpointer metadata, GSList **plitems)
@@ -98,41 +646,41 @@ static void _on_pl_entry_parsed(TotemPlParser *parser, gchar *uri,
 		*plitems = g_slist_append(*plitems, g_strdup(uri));
 	}
 }
-static GSList *_parse_playlist(const gchar *uri)
+static GSList *_parse_playlist(MafwGstRendererWorker *worker,
+			       const gchar *uri)
 {
-	static TotemPlParser *pl_parser = NULL;
 	GSList *plitems = NULL;
 	gulong handler_id;
 
 	/* Initialize the playlist parser */
-	if (!pl_parser)
+	if (!worker->pl_parser)
 	{
-		pl_parser = totem_pl_parser_new ();
-		g_object_set(pl_parser, "recurse", TRUE, "disable-unsafe",
-		     TRUE, NULL);
+		worker->pl_parser = totem_pl_parser_new ();
+		g_object_set(worker->pl_parser, "recurse", TRUE,
+			     "disable-unsafe", TRUE, NULL);
 	}
-	handler_id = g_signal_connect(G_OBJECT(pl_parser), "entry-parsed",
-			 G_CALLBACK(_on_pl_entry_parsed), &plitems);
+	handler_id = g_signal_connect(G_OBJECT(worker->pl_parser),
+				      "entry-parsed",
+				      G_CALLBACK(_on_pl_entry_parsed),
+				      &plitems);
 	/* Parsing */
-	if (totem_pl_parser_parse(pl_parser, uri, FALSE) !=
+	if (totem_pl_parser_parse(worker->pl_parser, uri, FALSE) !=
 	    TOTEM_PL_PARSER_RESULT_SUCCESS) {
 		/* An error happens while parsing */
 		
 	}
-	g_signal_handler_disconnect(pl_parser, handler_id);
+	g_signal_handler_disconnect(worker->pl_parser, handler_id);
 	return plitems;
 }
 		
 /*
- * Sends @error to MafwGstRenderer.  Only call this from the glib main thread, or
- * face the consequences.  @err is free'd.
+ * Sends @error to MafwGstRenderer, in the owner's context.  @err is free'd.
  */
 static void _send_error(MafwGstRendererWorker *worker, GError *err)
 {
 	worker->is_error = TRUE;
-        if (worker->notify_error_handler)
-                worker->notify_error_handler(worker, worker->owner, err);
-	g_error_free(err);
+	_invoke_owner(worker, _call_error_handler, err,
+		      (GDestroyNotify) g_error_free);
 }
 
 /*
@@ -224,6 +772,8 @@ static void _emit_gst_buffer_as_graphic_file_cb(GstSample *sample,
 	SaveGraphicData *sgd = user_data;
 	GdkPixbuf *pixbuf = NULL;
 
+	g_rec_mutex_lock(&sgd->worker->lock);
+
 	if (sample != NULL) {
 		DestroyPixbufData *dpd = g_new(DestroyPixbufData, 1);
 		dpd->buffer = gst_sample_get_buffer(sample);
@@ -275,9 +825,8 @@ static void _emit_gst_buffer_as_graphic_file_cb(GstSample *sample,
 					      (gchar*)filename);
 
 			/* Emit the metadata. */
-			mafw_renderer_emit_metadata_string(sgd->worker->owner,
-							   sgd->metadata_key,
-							   (gchar *) filename);
+			_emit_metadata(sgd->worker, sgd->metadata_key,
+				       G_TYPE_STRING, filename);
 		} else {
 			if (error != NULL) {
 				g_warning ("%s\n", error->message);
@@ -291,6 +840,8 @@ static void _emit_gst_buffer_as_graphic_file_cb(GstSample *sample,
 		g_warning("Could not create pixbuf from GstBuffer");
 	}
 
+	g_rec_mutex_unlock(&sgd->worker->lock);
+
 	g_free(sgd->metadata_key);
 	g_free(sgd);
 }
@@ -361,9 +912,16 @@ static void _emit_gst_buffer_as_graphic_file(MafwGstRendererWorker *worker,
 		sgd->metadata_key = g_strdup(metadata_key);
 
 		g_debug("pixbuf: using bvw to convert image format");
-		bvw_frame_conv_convert (sample, to_caps, worker->use_xv,
-					_emit_gst_buffer_as_graphic_file_cb,
-					sgd);
+		if (worker->frame_conv == NULL)
+			worker->frame_conv = bvw_frame_conv_new(worker->use_xv);
+		if (worker->frame_conv == NULL ||
+		    !bvw_frame_conv_convert(worker->frame_conv, sample,
+					    to_caps,
+					    _emit_gst_buffer_as_graphic_file_cb,
+					    sgd)) {
+			g_free(sgd->metadata_key);
+			g_free(sgd);
+		}
 	} else {
 		GdkPixbuf *pixbuf = NULL;
 		loader = gdk_pixbuf_loader_new_with_mime_type (mime, &error);
@@ -418,16 +976,24 @@ static gboolean _go_to_gst_ready(gpointer user_data)
 {
 	MafwGstRendererWorker *worker = user_data;
 
-	g_return_val_if_fail(worker->state == GST_STATE_PAUSED ||
-			     worker->prerolling, FALSE);
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	worker->ready_timeout = 0;
+	if (worker->state != GST_STATE_PAUSED && !worker->prerolling) {
+		g_critical("ready timeout while not paused");
+		_worker_unlock(worker);
+		return FALSE;
+	}
 
 	worker->seek_position =
-		mafw_gst_renderer_worker_get_position(worker);
+		_get_position(worker);
 
 	g_debug("going to GST_STATE_READY");
 	gst_element_set_state(worker->pipeline, GST_STATE_READY);
 	worker->in_ready = TRUE;
-        worker->ready_timeout = 0;
+
+	_worker_unlock(worker);
 
 	return FALSE;
 }
@@ -439,10 +1005,12 @@ static void _add_ready_timeout(MafwGstRendererWorker *worker)
 		{
 			g_debug("Adding timeout to go to GST_STATE_READY");
 			worker->ready_timeout =
-				g_timeout_add_seconds(
+				_worker_timeout_add_seconds(
+					worker,
+					worker->release_paused ? 0 :
 					MAFW_GST_RENDERER_WORKER_SECONDS_READY,
-					_go_to_gst_ready,
-					worker);
+					_go_to_gst_ready);
+			worker->release_paused = FALSE;
 		}
 	} else {
 		g_debug("Not adding timeout to go to GST_STATE_READY as media "
@@ -455,76 +1023,332 @@ static void _remove_ready_timeout(MafwGstRendererWorker *worker)
 {
 	if (worker->ready_timeout != 0) {
 		g_debug("removing timeout for READY");
-		g_source_remove(worker->ready_timeout);
+		_worker_source_remove(worker, worker->ready_timeout);
 		worker->ready_timeout = 0;
 	}
 	worker->in_ready = FALSE;
 }
 
-static gboolean _emit_video_info(MafwGstRendererWorker *worker)
+/*
+ * Closes the media and opens it again at @position (-1 for where it
+ * opens), the way it is resumed from READY.  The sinks open their
+ * devices again too.
+ */
+static void _reopen(MafwGstRendererWorker *worker, gint position)
 {
-	mafw_renderer_emit_metadata_int(worker->owner,
-				    MAFW_METADATA_KEY_RES_X,
-				    worker->media.video_width);
-	mafw_renderer_emit_metadata_int(worker->owner,
-				    MAFW_METADATA_KEY_RES_Y,
-				    worker->media.video_height);
-	mafw_renderer_emit_metadata_double(worker->owner,
-				       MAFW_METADATA_KEY_VIDEO_FRAMERATE,
-				       worker->media.fps);
-	return FALSE;
+	/* The client does not need to know the pipeline goes through
+	 * PAUSED */
+	worker->report_statechanges = FALSE;
+	_remove_ready_timeout(worker);
+	gst_element_set_state(worker->pipeline, GST_STATE_READY);
+	worker->in_ready = TRUE;
+	worker->seek_position = position > 0 ? position : -1;
+	worker->eos = FALSE;
+
+	/* If paused meanwhile, resuming opens the stream */
+	if (!worker->stay_paused) {
+		gst_element_set_state(worker->pipeline, GST_STATE_PAUSED);
+		if (position > 0)
+			_seek_at_first_segment(worker, position);
+	}
 }
 
 /*
- * Checks if the video details are supported.  It also extracts other useful
- * information (such as PAR and framerate) from the caps, if available.  NOTE:
- * this will be called from a different thread than glib's mainloop (when
- * invoked via _stream_info_cb);  don't call MafwGstRenderer directly.
- *
- * Returns: TRUE if video details are acceptable.
+ * Reopens the stream that dropped the connection: the source is closed
+ * and opened again at the position played up to, which souphttpsrc asks
+ * for with a range request.  Live streams are just connected to again.
  */
-static gboolean _handle_video_info(MafwGstRendererWorker *worker,
-				   const GstStructure *structure)
+static gboolean _reconnect_timeout(gpointer user_data)
 {
-	gint width, height;
-	gdouble fps;
+	MafwGstRendererWorker *worker = user_data;
+	gint position = -1;
 
-	width = height = 0;
-	gst_structure_get_int(structure, "width", &width);
-	gst_structure_get_int(structure, "height", &height);
-	g_debug("video size: %d x %d", width, height);
-	if (gst_structure_has_field(structure, "pixel-aspect-ratio"))
-	{
-		gst_structure_get_fraction(structure, "pixel-aspect-ratio",
-					   &worker->media.par_n,
-					   &worker->media.par_d);
-		g_debug("video PAR: %d:%d", worker->media.par_n,
-			worker->media.par_d);
-		width = width * worker->media.par_n / worker->media.par_d;
-	}
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
 
-	fps = 1.0;
-	if (gst_structure_has_field(structure, "framerate"))
-	{
-		gint fps_n, fps_d;
+	worker->reconnect.timeout = 0;
+	worker->reconnect.since = g_get_monotonic_time();
+	if (worker->media.seekable == SEEKABILITY_SEEKABLE && !worker->is_live)
+		position = _get_position(worker);
+	g_debug("reconnecting to the stream (attempt %d) at %d s",
+		worker->reconnect.attempts, position);
+	_reopen(worker, position);
 
-		gst_structure_get_fraction(structure, "framerate",
-					   &fps_n, &fps_d);
-		if (fps_d > 0)
-			fps = (gdouble)fps_n / (gdouble)fps_d;
-		g_debug("video fps: %f", fps);
-	}
+	_worker_unlock(worker);
 
-	worker->media.video_width = width;
-	worker->media.video_height = height;
-	worker->media.fps = fps;
+	return FALSE;
+}
 
-	/* Add the info to the current metadata. */
-	gint p_width, p_height, p_fps;
+/*
+ * Whether the EOS of the stream came before its end.  Streams read up to
+ * the content length the server gave are at their end.  Short of it, a
+ * stream of unknown duration is cut off; endless radio, which gives no
+ * length, is only reconnected to on read errors.  The others end at their
+ * duration.
+ */
+static gboolean _eos_is_premature(MafwGstRendererWorker *worker)
+{
+	GstElement *source = NULL;
+	gint64 position, length;
+	gboolean have_length = FALSE;
+
+	g_object_get(worker->pipeline, "source", &source, NULL);
+	if (source != NULL) {
+		have_length = gst_element_query_duration(source,
+							 GST_FORMAT_BYTES,
+							 &length) &&
+			length > 0 &&
+			gst_element_query_position(source, GST_FORMAT_BYTES,
+						   &position);
+		gst_object_unref(source);
+		if (have_length && position >= length)
+			return FALSE;
+	}
 
-	p_width = width;
-	p_height = height;
-	p_fps = fps;
+	if (worker->media.length_nanos == -1)
+		return have_length;
+	if (worker->gapless.stop >= 0)
+		return FALSE;
+
+	return gst_element_query_position(worker->pipeline, GST_FORMAT_TIME,
+					  &position) &&
+		position + 2 * GST_SECOND < worker->media.length_nanos;
+}
+
+/*
+ * Takes a read error (@err) or an early EOS (@err is NULL) of an HTTP
+ * stream for a dropped connection, and has the stream reopened after a
+ * while.  Meanwhile the data buffered so far keeps playing.  Returns FALSE
+ * if the failure is to be handled as usual, for other media and failures,
+ * and once the retry budget is used up.
+ */
+static gboolean _reconnect(MafwGstRendererWorker *worker, const GError *err)
+{
+	guint seconds;
+
+	if (worker->media.location == NULL ||
+	    (!g_str_has_prefix(worker->media.location, "http://") &&
+	     !g_str_has_prefix(worker->media.location, "https://")) ||
+	    worker->prerolling)
+		return FALSE;
+
+	if (err != NULL) {
+		/* Connecting again may fail as well while retrying */
+		if (err->domain != GST_RESOURCE_ERROR ||
+		    (err->code != GST_RESOURCE_ERROR_READ &&
+		     (err->code != GST_RESOURCE_ERROR_OPEN_READ ||
+		      worker->reconnect.attempts == 0)))
+			return FALSE;
+	} else if (worker->reconnect.timeout == 0 &&
+		   !_eos_is_premature(worker)) {
+		return FALSE;
+	}
+
+	/* The buffered data ran out before the stream is reopened */
+	if (worker->reconnect.timeout != 0)
+		return TRUE;
+
+	if (worker->reconnect.since != 0 &&
+	    g_get_monotonic_time() - worker->reconnect.since >
+	    MAFW_GST_RENDERER_WORKER_RECONNECT_SECONDS_STABLE *
+	    G_USEC_PER_SEC)
+		worker->reconnect.attempts = 0;
+	if (worker->reconnect.attempts >=
+	    MAFW_GST_RENDERER_WORKER_RECONNECT_ATTEMPTS) {
+		g_debug("giving up reconnecting to the stream");
+		return FALSE;
+	}
+
+	seconds = MAFW_GST_RENDERER_WORKER_RECONNECT_SECONDS <<
+		worker->reconnect.attempts++;
+	g_debug("stream connection lost, reconnecting in %u s", seconds);
+	worker->reconnect.timeout = _worker_timeout_add_seconds(
+		worker, seconds, _reconnect_timeout);
+
+	return TRUE;
+}
+
+static void _emit_video_info(MafwGstRendererWorker *worker)
+{
+	_emit_metadata(worker, MAFW_METADATA_KEY_RES_X, G_TYPE_INT,
+		       worker->media.video_width);
+	_emit_metadata(worker, MAFW_METADATA_KEY_RES_Y, G_TYPE_INT,
+		       worker->media.video_height);
+	_emit_metadata(worker, MAFW_METADATA_KEY_VIDEO_FRAMERATE,
+		       G_TYPE_DOUBLE, worker->media.fps);
+}
+
+/*
+ * When the window is much smaller than the video, makes the scaler in front
+ * of the sink hand it frames of the window size.  Otherwise the scaler
+ * passes the frames through.
+ */
+static void _update_video_scaling(MafwGstRendererWorker *worker)
+{
+	GstCaps *caps, *old_caps;
+	gdouble scale;
+
+	if (worker->vscale_filter == NULL)
+		return;
+
+	scale = 1.0;
+	if (worker->media.video_width > 0 && worker->media.video_height > 0 &&
+	    worker->window.width > 0 && worker->window.height > 0) {
+		scale = MIN((gdouble)worker->window.width /
+			    worker->media.video_width,
+			    (gdouble)worker->window.height /
+			    worker->media.video_height);
+	}
+
+	if (scale * MAFW_GST_RENDERER_WORKER_DOWNSCALE_FACTOR <= 1.0) {
+		gint width, height;
+
+		/* Most of the formats want even sizes */
+		width = MAX((gint)(worker->media.video_width * scale) & ~1, 2);
+		height = MAX((gint)(worker->media.video_height * scale) & ~1,
+			     2);
+		caps = gst_caps_new_simple("video/x-raw",
+					   "width", G_TYPE_INT, width,
+					   "height", G_TYPE_INT, height,
+					   NULL);
+	} else {
+		caps = gst_caps_new_any();
+	}
+
+	/* Do not renegotiate while the window is resized in small steps */
+	g_object_get(worker->vscale_filter, "caps", &old_caps, NULL);
+	if (old_caps == NULL || !gst_caps_is_equal(old_caps, caps)) {
+		gchar *str = gst_caps_to_string(caps);
+		g_debug("video sink caps: %s", str);
+		g_free(str);
+		g_object_set(worker->vscale_filter, "caps", caps, NULL);
+	}
+	if (old_caps != NULL)
+		gst_caps_unref(old_caps);
+	gst_caps_unref(caps);
+}
+
+static gboolean _window_event_cb(gint fd, GIOCondition condition,
+				 gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
+	XEvent event;
+
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	while (XPending(worker->window.display)) {
+		XNextEvent(worker->window.display, &event);
+		if (event.type == ConfigureNotify &&
+		    event.xconfigure.window == worker->xid) {
+			worker->window.width = event.xconfigure.width;
+			worker->window.height = event.xconfigure.height;
+			g_debug("video window is %d x %d",
+				worker->window.width, worker->window.height);
+			_update_video_scaling(worker);
+			_refresh_video_window(worker);
+		}
+	}
+
+	_worker_unlock(worker);
+
+	return TRUE;
+}
+
+/*
+ * Follows the geometry of the video window.  The sinks do not handle the
+ * window events themselves, so they are told about size changes, and GL
+ * gets the video scaled down to the window size.
+ */
+static void _watch_window(MafwGstRendererWorker *worker, XID old_xid)
+{
+	XWindowAttributes attrs;
+
+	worker->window.width = worker->window.height = 0;
+
+	if (worker->window.display == NULL) {
+		GSource *source;
+
+		worker->window.display = XOpenDisplay(NULL);
+		if (worker->window.display == NULL) {
+			g_warning("Failed to open $DISPLAY");
+			return;
+		}
+
+		source = g_unix_fd_source_new(
+			ConnectionNumber(worker->window.display), G_IO_IN);
+		g_source_set_callback(source, (GSourceFunc)_window_event_cb,
+				      worker, NULL);
+		g_source_attach(source, worker->context);
+		worker->window.watch = source;
+	}
+
+	if (old_xid)
+		XSelectInput(worker->window.display, old_xid, NoEventMask);
+	if (worker->xid) {
+		XSelectInput(worker->window.display, worker->xid,
+			     StructureNotifyMask);
+		if (XGetWindowAttributes(worker->window.display, worker->xid,
+					 &attrs)) {
+			worker->window.width = attrs.width;
+			worker->window.height = attrs.height;
+		}
+	}
+	XFlush(worker->window.display);
+
+	_update_video_scaling(worker);
+}
+
+/*
+ * Checks if the video details are supported.  It also extracts other useful
+ * information (such as PAR and framerate) from the caps, if available.  NOTE:
+ * this is called from the worker thread;  don't call MafwGstRenderer
+ * directly.
+ *
+ * Returns: TRUE if video details are acceptable.
+ */
+static gboolean _handle_video_info(MafwGstRendererWorker *worker,
+				   const GstStructure *structure)
+{
+	gint width, height;
+	gdouble fps;
+
+	width = height = 0;
+	gst_structure_get_int(structure, "width", &width);
+	gst_structure_get_int(structure, "height", &height);
+	g_debug("video size: %d x %d", width, height);
+	if (gst_structure_has_field(structure, "pixel-aspect-ratio"))
+	{
+		gst_structure_get_fraction(structure, "pixel-aspect-ratio",
+					   &worker->media.par_n,
+					   &worker->media.par_d);
+		g_debug("video PAR: %d:%d", worker->media.par_n,
+			worker->media.par_d);
+		width = width * worker->media.par_n / worker->media.par_d;
+	}
+
+	fps = 1.0;
+	if (gst_structure_has_field(structure, "framerate"))
+	{
+		gint fps_n, fps_d;
+
+		gst_structure_get_fraction(structure, "framerate",
+					   &fps_n, &fps_d);
+		if (fps_d > 0)
+			fps = (gdouble)fps_n / (gdouble)fps_d;
+		g_debug("video fps: %f", fps);
+	}
+
+	worker->media.video_width = width;
+	worker->media.video_height = height;
+	worker->media.fps = fps;
+
+	/* Add the info to the current metadata. */
+	gint p_width, p_height, p_fps;
+
+	p_width = width;
+	p_height = height;
+	p_fps = fps;
 
 	_current_metadata_add(worker, MAFW_METADATA_KEY_RES_X, G_TYPE_INT,
 			      p_width);
@@ -535,7 +1359,9 @@ static gboolean _handle_video_info(MafwGstRendererWorker *worker,
 			      p_fps);
 
 	/* Emit the metadata.*/
-	g_idle_add((GSourceFunc)_emit_video_info, worker);
+	_emit_video_info(worker);
+
+	_update_video_scaling(worker);
 
 	return TRUE;
 }
@@ -546,17 +1372,18 @@ static void mafw_gst_renderer_worker_apply_xid(MafwGstRendererWorker *worker)
 	   a XID a valid video sink and we are rendeing video content */
 	if (worker->xid && 
 	    worker->vsink && 
-	    worker->media.has_visual_content)
+	    g_atomic_int_get(&worker->media.has_visual_content))
 	{
 		g_debug ("Setting overlay, window id: %x", 
 			 (gint) worker->xid);
 		gst_video_overlay_set_window_handle(GST_VIDEO_OVERLAY(worker->vsink),
 					     worker->xid);
-		/* Ask the gst to redraw the frame if we are paused */
-		/* TODO: in MTG this works only in non-fs -> fs way. */
-		if (worker->state == GST_STATE_PAUSED)
-		{
-			gst_video_overlay_expose(GST_VIDEO_OVERLAY(worker->vsink));
+		/* Use the whole new window, whatever the size of the old
+		 * one was */
+		if (worker->window.width > 0 && worker->window.height > 0) {
+			gst_video_overlay_set_render_rectangle(
+				GST_VIDEO_OVERLAY(worker->vsink), 0, 0,
+				worker->window.width, worker->window.height);
 		}
 	} else {
 		g_debug("Not setting overlay for window id: %x", 
@@ -564,9 +1391,32 @@ static void mafw_gst_renderer_worker_apply_xid(MafwGstRendererWorker *worker)
 	}
 }
 
+/*
+ * Makes the sink pick up the current window geometry and draw the last
+ * frame again right away, instead of with the next frame (or never, when
+ * paused).  There is no state change or seek involved, so switching
+ * between windows or toggling fullscreen does not preroll again.
+ */
+static void _refresh_video_window(MafwGstRendererWorker *worker)
+{
+	if (!worker->xid || !worker->vsink ||
+	    !g_atomic_int_get(&worker->media.has_visual_content) ||
+	    worker->audio_only || worker->state < GST_STATE_PAUSED)
+		return;
+
+	if (worker->window.width > 0 && worker->window.height > 0) {
+		gst_video_overlay_set_render_rectangle(
+			GST_VIDEO_OVERLAY(worker->vsink), 0, 0,
+			worker->window.width, worker->window.height);
+	}
+	gst_video_overlay_expose(GST_VIDEO_OVERLAY(worker->vsink));
+}
+
 /*
  * GstBus synchronous message handler.  NOTE that this handler is NOT invoked
- * from the glib thread, so be careful what you do here.
+ * from the glib thread, so be careful what you do here.  It cannot take
+ * the worker lock: the worker thread holds it while bringing the sinks
+ * down, which waits for this streaming thread.
  */
 static GstBusSyncReply _sync_bus_handler(GstBus *bus, GstMessage *msg,
 					 MafwGstRendererWorker *worker)
@@ -577,24 +1427,23 @@ static GstBusSyncReply _sync_bus_handler(GstBus *bus, GstMessage *msg,
 
 	if (worker->xid) {
 		g_debug("got prepare-window-handle");
-		worker->media.has_visual_content = TRUE;
+		g_atomic_int_set(&worker->media.has_visual_content, TRUE);
 		g_debug ("Video window to use is: %x", (gint) worker->xid);
 
 		/* Instruct vsink to use the client-provided window */
 		mafw_gst_renderer_worker_apply_xid(worker);
 	} else if (worker->state != GST_STATE_NULL) {
 		/* The user has to preset the XID, we don't create windows by
-		 * ourselves. */
-		/* We must post an error message to the bus that will
-		 * be picked up by _async_bus_handler.  Calling the
-		 * notification function directly from here (different
-		 * thread) is not healthy. */
-		g_warning("No video window set!");
-		_post_error(worker,
-			    g_error_new_literal(
-				    MAFW_RENDERER_ERROR,
-				    MAFW_RENDERER_ERROR_PLAYBACK,
-				    "No video window XID set"));
+		 * ourselves.  Without one we just play the audio.  The
+		 * pipeline cannot be reconfigured from a streaming thread,
+		 * so let _async_bus_handler do it. */
+		g_debug("No video window set, playing audio only");
+		g_atomic_int_set(&worker->media.has_visual_content, TRUE);
+		gst_bus_post(worker->bus,
+			     gst_message_new_application(
+				     GST_OBJECT(worker->pipeline),
+				     gst_structure_new_empty(
+					     "mafw-audio-only")));
 	}
 
 	gst_message_unref (msg);
@@ -630,10 +1479,14 @@ static gboolean _seconds_duration_equal(gint64 duration1, gint64 duration2)
 
 static void _check_duration(MafwGstRendererWorker *worker, gint64 value)
 {
-	MafwGstRenderer *renderer = worker->owner;
 	gboolean right_query = TRUE;
+	gint64 indexed;
 
-	if (value == -1) {
+	/* Files scanned before know it exactly, without estimating */
+	indexed = mafw_gst_renderer_seek_index_get_duration(worker->pipeline);
+	if (indexed > 0) {
+		value = indexed;
+	} else if (value == -1) {
 		right_query = gst_element_query_duration(
 				      worker->pipeline, GST_FORMAT_TIME,
 				      &value);
@@ -649,18 +1502,17 @@ static void _check_duration(MafwGstRendererWorker *worker, gint64 value)
 						G_TYPE_INT64,
 						(gint64)duration_seconds);
 			/* Emit the duration. */
-			mafw_renderer_emit_metadata_int64(
-				worker->owner, MAFW_METADATA_KEY_DURATION,
-				(gint64)duration_seconds);
+			_emit_metadata(worker, MAFW_METADATA_KEY_DURATION,
+				       G_TYPE_INT64, (gint64)duration_seconds);
 		}
 
 		/* We compare this duration we just got with the
 		 * source one and update it in the source if needed */
 		if (duration_seconds > 0 &&
-			duration_seconds != renderer->media->duration) {
-			mafw_gst_renderer_update_source_duration(
-				renderer,
-				duration_seconds);
+			duration_seconds != worker->source.duration) {
+			worker->source.duration = duration_seconds;
+			_invoke_owner(worker, _update_source_duration_cb,
+				      GINT_TO_POINTER(duration_seconds), NULL);
 		}
 	}
 
@@ -671,14 +1523,13 @@ static void _check_duration(MafwGstRendererWorker *worker, gint64 value)
 
 static void _check_seekability(MafwGstRendererWorker *worker)
 {
-	MafwGstRenderer *renderer = worker->owner;
 	SeekabilityType seekable = SEEKABILITY_NO_SEEKABLE;
 
 	if (worker->media.length_nanos != -1)
 	{
-		g_debug("source seekability %d", renderer->media->seekability);
+		g_debug("source seekability %d", worker->source.seekability);
 
-		if (renderer->media->seekability != SEEKABILITY_NO_SEEKABLE) {
+		if (worker->source.seekability != SEEKABILITY_NO_SEEKABLE) {
 			g_debug("Quering GStreamer for seekability");
 			GstQuery *seek_query;
 			GstFormat format = GST_FORMAT_TIME;
@@ -707,9 +1558,8 @@ static void _check_seekability(MafwGstRendererWorker *worker)
 			G_TYPE_BOOLEAN, is_seekable);
 
 		/* Emit. */
-		mafw_renderer_emit_metadata_boolean(
-			worker->owner, MAFW_METADATA_KEY_IS_SEEKABLE,
-			is_seekable);
+		_emit_metadata(worker, MAFW_METADATA_KEY_IS_SEEKABLE,
+			       G_TYPE_BOOLEAN, is_seekable);
 	}
 
 	g_debug("media seekable: %d", seekable);
@@ -720,10 +1570,14 @@ static gboolean _query_duration_and_seekability_timeout(gpointer data)
 {
 	MafwGstRendererWorker *worker = data;
 
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	worker->duration_seek_timeout = 0;
 	_check_duration(worker, -1);
 	_check_seekability(worker);
 
-	worker->duration_seek_timeout = 0;
+	_worker_unlock(worker);
 
 	return FALSE;
 }
@@ -734,9 +1588,15 @@ static gboolean _query_duration_and_seekability_timeout(gpointer data)
  */
 static void _finalize_startup(MafwGstRendererWorker *worker)
 {
+	/* Replays plug the same elements */
+	mafw_gst_renderer_autoplug_cache_commit(worker->pipeline);
+
 	/* Check video caps */
-	if (worker->media.has_visual_content) {
-		GstElement *vsink = GST_ELEMENT(worker->vsink);
+	if (g_atomic_int_get(&worker->media.has_visual_content)) {
+		/* The bin's pad has the caps before scaling */
+		GstElement *vsink = GST_ELEMENT(worker->vsink_bin ?
+						worker->vsink_bin :
+						worker->vsink);
 		GstPad *pad = GST_PAD(vsink->sinkpads->data);
 		GstCaps *caps = gst_pad_get_current_caps(pad);
 		if (caps && gst_caps_is_fixed(caps)) {
@@ -758,32 +1618,95 @@ static void _finalize_startup(MafwGstRendererWorker *worker)
 
 	/* Check duration and seekability */
 	if (worker->duration_seek_timeout != 0) {
-		g_source_remove(worker->duration_seek_timeout);
+		_worker_source_remove(worker, worker->duration_seek_timeout);
 		worker->duration_seek_timeout = 0;
 	}
 	_check_duration(worker, -1);
 	_check_seekability(worker);
+
+	/* Streams chosen before the media was opened */
+	if (worker->streams.audio >= 0)
+		g_object_set(worker->pipeline, "current-audio",
+			     worker->streams.audio, NULL);
+	if (worker->streams.text >= 0)
+		g_object_set(worker->pipeline, "current-text",
+			     worker->streams.text, NULL);
 }
 
 static void _add_duration_seek_query_timeout(MafwGstRendererWorker *worker)
 {
 	if (worker->duration_seek_timeout != 0) {
-		g_source_remove(worker->duration_seek_timeout);
+		_worker_source_remove(worker, worker->duration_seek_timeout);
 	}
-	worker->duration_seek_timeout = g_timeout_add_seconds(
+	worker->duration_seek_timeout = _worker_timeout_add_seconds(
+		worker,
 		MAFW_GST_RENDERER_WORKER_SECONDS_DURATION_AND_SEEKABILITY,
-		_query_duration_and_seekability_timeout,
-		worker);
+		_query_duration_and_seekability_timeout);
 }
 
-static void _do_pause_postprocessing(MafwGstRendererWorker *worker)
+/*
+ * Publishes which format converters playbin had to plug, and what they
+ * cost.  Video should need none, as the sinks take the decoder formats.
+ */
+static void _report_converters(MafwGstRendererWorker *worker)
 {
-	if (worker->notify_pause_handler) {
-		worker->notify_pause_handler(worker, worker->owner);
+	gchar *report;
+
+	if (worker->pipeline == NULL)
+		return;
+
+	report = mafw_gst_renderer_converter_audit_report(worker->pipeline);
+	if (report == NULL)
+		return;
+
+	g_debug("converters: %s", report);
+	_current_metadata_add(worker,
+			      MAFW_METADATA_KEY_GST_RENDERER_CONVERTERS,
+			      G_TYPE_STRING, report);
+	_emit_metadata(worker, MAFW_METADATA_KEY_GST_RENDERER_CONVERTERS,
+		       G_TYPE_STRING, report);
+	g_free(report);
+}
+
+static gboolean _report_converters_timeout(gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
+
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	worker->audit_timeout = 0;
+	_report_converters(worker);
+
+	_worker_unlock(worker);
+	return FALSE;
+}
+
+static void _add_converter_audit_timeout(MafwGstRendererWorker *worker)
+{
+	if (worker->audit_timeout != 0) {
+		_worker_source_remove(worker, worker->audit_timeout);
+	}
+	worker->audit_timeout = _worker_timeout_add_seconds(
+		worker,
+		MAFW_GST_RENDERER_WORKER_SECONDS_CONVERTER_AUDIT,
+		_report_converters_timeout);
+}
+
+static void _remove_converter_audit_timeout(MafwGstRendererWorker *worker)
+{
+	if (worker->audit_timeout != 0) {
+		_worker_source_remove(worker, worker->audit_timeout);
+		worker->audit_timeout = 0;
 	}
+}
+
+static void _do_pause_postprocessing(MafwGstRendererWorker *worker)
+{
+	_notify_pause(worker);
 
 #ifdef HAVE_GDKPIXBUF
-	if (worker->media.has_visual_content &&
+	if (g_atomic_int_get(&worker->media.has_visual_content) &&
 	    worker->current_frame_on_pause) {
 		GstSample *sample = NULL;
 
@@ -807,10 +1730,7 @@ static void _report_playing_state(MafwGstRendererWorker * worker)
 		case WORKER_MODE_SINGLE_PLAY:
 			/* Notify play if we are playing in
 			 * single mode */
-			if (worker->notify_play_handler)
-				worker->notify_play_handler(
-					worker,
-					worker->owner);
+			_notify_play(worker);
 			break;
 		case WORKER_MODE_PLAYLIST:
 		case WORKER_MODE_REDUNDANT:
@@ -818,10 +1738,7 @@ static void _report_playing_state(MafwGstRendererWorker * worker)
 			   playback starts, don't notify play for each
 			   individual element of the playlist. */
 			if (worker->pl.notify_play_pending) {
-				if (worker->notify_play_handler)
-					worker->notify_play_handler(
-						worker,
-						worker->owner);
+				_notify_play(worker);
 				worker->pl.notify_play_pending = FALSE;
 			}
 			break;
@@ -830,114 +1747,637 @@ static void _report_playing_state(MafwGstRendererWorker * worker)
 	}
 }
 
-static void _handle_state_changed(GstMessage *msg, MafwGstRendererWorker *worker)
+/*
+ * Called once prerolling is done.  If the media should start at an offset
+ * and the pipeline did not take the seek while prerolling, seek now (at
+ * the cost of a second preroll).
+ */
+static void _seek_to_start_position(MafwGstRendererWorker *worker)
 {
-	GstState newstate, oldstate;
-	GstStateChange statetrans;
-	MafwGstRenderer *renderer = (MafwGstRenderer*)worker->owner;
+	/* Nothing reached the audio sink before prerolling, or it came
+	 * before the seek was armed */
+	g_atomic_int_compare_and_exchange(&worker->start_seek.state,
+					  START_SEEK_ARMED, START_SEEK_NONE);
+	if ((worker->start_position > 0 || worker->gapless.start > 0 ||
+	     worker->gapless.stop >= 0) &&
+	    g_atomic_int_get(&worker->start_seek.state) == START_SEEK_NONE &&
+	    !g_atomic_int_get(&worker->preroll_seek_done)) {
+		g_debug("seeking to start position after prerolling");
+		_do_seek(worker, GST_SEEK_TYPE_SET, FALSE,
+			 worker->start_position, NULL);
+	}
+	worker->preroll_seek_done = FALSE;
+}
 
-	gst_message_parse_state_changed(msg, &oldstate, &newstate, NULL);
-	statetrans = GST_STATE_TRANSITION(oldstate, newstate);
-	g_debug ("State changed: %d: %d -> %d", worker->state, oldstate, newstate);
+/*
+ * Segment seek to @start, up to the end of the loop.  The pipeline then
+ * posts SEGMENT_DONE instead of EOS when it gets there.  The encoder delay
+ * and padding stay out of the loop.
+ */
+static gboolean _loop_seek(MafwGstRendererWorker *worker, GstSeekFlags flags,
+			   gint64 start)
+{
+	gint64 stop;
+
+	stop = worker->loop.stop >= 0 ? worker->loop.stop : worker->gapless.stop;
+	if (worker->gapless.stop >= 0 && stop > worker->gapless.stop)
+		stop = worker->gapless.stop;
+	return gst_element_seek(worker->pipeline, 1.0, GST_FORMAT_TIME,
+				flags | GST_SEEK_FLAG_SEGMENT |
+				GST_SEEK_FLAG_ACCURATE,
+				GST_SEEK_TYPE_SET,
+				MAX(start, worker->gapless.start),
+				stop >= 0 ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+				stop >= 0 ? stop : GST_CLOCK_TIME_NONE);
+}
 
-	/* If the state is the same we do nothing, otherwise, we keep
-	 * it */
-	if (worker->state == newstate) {
+/*
+ * Puts the pipeline in segment mode, from where it is playing if that is
+ * inside the loop.  This costs one flush; from then on every round is
+ * queued without any.
+ */
+static void _arm_loop(MafwGstRendererWorker *worker)
+{
+	gint64 position;
+
+	if (!worker->loop.enabled || worker->pipeline == NULL ||
+	    worker->prerolling || worker->in_ready || worker->eos ||
+	    worker->state < GST_STATE_PAUSED || !worker->media.seekable)
 		return;
-	} else {
-		worker->state = newstate;
-	}
 
-        if (statetrans == GST_STATE_CHANGE_READY_TO_PAUSED &&
-            worker->in_ready) {
-                /* Woken up from READY, resume stream position and playback */
-                g_debug("State changed to pause after ready");
-                if (worker->seek_position > 0) {
-                        _check_seekability(worker);
-                        if (worker->media.seekable) {
-                                g_debug("performing a seek");
-				_do_seek(worker, GST_SEEK_TYPE_SET, FALSE,
-                                         worker->seek_position, NULL);
-                        } else {
-                                g_critical("media is not seekable (and should)");
-                        }
-                }
+	if (!gst_element_query_position(worker->pipeline, GST_FORMAT_TIME,
+					&position) ||
+	    position < worker->loop.start ||
+	    (worker->loop.stop >= 0 && position >= worker->loop.stop))
+		position = worker->loop.start;
 
-                /* If playing a stream wait for buffering to finish before
-                   starting to play */
-                if (!worker->is_stream || worker->is_live) {
-                        _do_play(worker);
-                }
-                return;
-        }
+	g_debug("looping from %" GST_TIME_FORMAT, GST_TIME_ARGS(position));
+	/* The flush is no pause for the UI */
+	worker->report_statechanges = FALSE;
+	worker->loop.armed = _loop_seek(worker, GST_SEEK_FLAG_FLUSH, position);
+}
 
-	/* While buffering, we have to wait in PAUSED 
-	   until we reach 100% before doing anything */
-	if (worker->buffering) {
-	        if (statetrans == GST_STATE_CHANGE_PAUSED_TO_PLAYING) {
-			/* Mmm... probably the client issued a seek on the
-			 * stream and then a play/resume command right away,
-			 * so the stream got into PLAYING state while
-			 * buffering. When the next buffering signal arrives,
-			 * the stream will be PAUSED silently and resumed when
-			 * buffering is done (silently too), so let's signal
-			 * the state change to PLAYING here. */
-			_report_playing_state(worker);			
-		}
+/*
+ * Leaves segment mode, so that playback goes on to the end of the media,
+ * or to the end the gapless trim leaves of it.
+ */
+static void _disarm_loop(MafwGstRendererWorker *worker)
+{
+	gint64 position;
+
+	if (!worker->loop.armed)
 		return;
-	}
 
-	switch (statetrans) {
-	case GST_STATE_CHANGE_READY_TO_PAUSED:
-		if (worker->prerolling && worker->report_statechanges) {
-			/* PAUSED after pipeline has been
-			 * constructed. We check caps, seek and
-			 * duration and if staying in pause is needed,
-			 * we perform operations for pausing, such as
-			 * current frame on pause and signalling state
-			 * change and adding the timeout to go to ready */
-			g_debug ("Prerolling done, finalizaing startup");
-			_finalize_startup(worker);
-			_do_play(worker);
-			renderer->play_failed_count = 0;
+	worker->loop.armed = FALSE;
+	if (worker->pipeline != NULL &&
+	    gst_element_query_position(worker->pipeline, GST_FORMAT_TIME,
+				       &position)) {
+		worker->report_statechanges = FALSE;
+		gst_element_seek(worker->pipeline, 1.0, GST_FORMAT_TIME,
+				 GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
+				 GST_SEEK_TYPE_SET,
+				 MAX(position, worker->gapless.start),
+				 worker->gapless.stop >= 0 ?
+				 GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+				 worker->gapless.stop >= 0 ?
+				 worker->gapless.stop : GST_CLOCK_TIME_NONE);
+	}
+}
 
-			if (worker->stay_paused) {
-				_do_pause_postprocessing(worker);
-			}
-			worker->prerolling = FALSE;
-		}
-		break;
-	case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
-		/* When pausing we do the stuff, like signalling
-		 * state, current frame on pause and timeout to go to
-		 * ready */
-		if (worker->report_statechanges) {
-			_do_pause_postprocessing(worker);
-		}
-		break;
-	case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
-		/* if seek was called, at this point it is really ended */
-		worker->seek_position = -1;
-                worker->eos = FALSE;
+/*
+ * The end of the loop has been reached.  Queue the next round behind the
+ * data the sinks still have, so it follows without a gap.
+ */
+static void _handle_segment_done(MafwGstRendererWorker *worker)
+{
+	if (!worker->loop.armed)
+		return;
+
+	if (!_loop_seek(worker, GST_SEEK_FLAG_NONE, worker->loop.start)) {
+		g_warning("could not loop, stopping at the end");
+		worker->loop.armed = FALSE;
+		gst_element_post_message(
+			worker->pipeline,
+			gst_message_new_eos(GST_OBJECT(worker->pipeline)));
+	}
+}
+
+static OutputProfile _select_output_profile(MafwGstRendererWorker *worker,
+					    gboolean has_video)
+{
+	if (has_video && !worker->audio_only)
+		return OUTPUT_PROFILE_VIDEO;
+	if (worker->is_stream)
+		return OUTPUT_PROFILE_LIVE;
+	if (!worker->display_on)
+		return OUTPUT_PROFILE_POWER_SAVE;
+	return OUTPUT_PROFILE_AUDIO;
+}
+
+static void _set_output_profile(MafwGstRendererWorker *worker,
+				GstElement *asink, OutputProfile profile)
+{
+	g_object_set(asink,
+		     "buffer-time", output_profiles[profile].buffer_time +
+		     g_atomic_int_get(&worker->output.extra_usecs),
+		     "latency-time", output_profiles[profile].latency_time,
+		     NULL);
+}
+
+/*
+ * Picks the output profile again after the content or the screen state
+ * changed.  It applies when the audio sink next opens its stream.
+ */
+static void _update_output_profile(MafwGstRendererWorker *worker)
+{
+	OutputProfile profile;
+
+	if (worker->asink == NULL)
+		return;
+
+	profile = _select_output_profile(
+		worker, g_atomic_int_get(&worker->media.has_visual_content));
+	if (profile != worker->output.active) {
+		g_debug("switching to the %s audio output profile",
+			output_profiles[profile].name);
+	}
+	_set_output_profile(worker, worker->asink, profile);
+}
+
+/*
+ * Adds up the times the streaming thread of the audio sink slept and
+ * woke up, from the audio sink probe.  The thread changes with the
+ * pipeline, so only what it counted since the last buffer is added.
+ * Without per thread usage the whole process is counted.
+ */
+static void _count_sink_wakeups(MafwGstRendererWorker *worker)
+{
+	struct rusage usage;
+
+#ifdef RUSAGE_THREAD
+	if (getrusage(RUSAGE_THREAD, &usage) != 0)
+		return;
+#else
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return;
+#endif
+	if (worker->output.sink_thread == g_thread_self() &&
+	    usage.ru_nvcsw >= worker->output.sink_thread_nvcsw) {
+		g_atomic_int_add(&worker->output.sink_wakeups,
+				 usage.ru_nvcsw -
+				 worker->output.sink_thread_nvcsw);
+	}
+	worker->output.sink_thread = g_thread_self();
+	worker->output.sink_thread_nvcsw = usage.ru_nvcsw;
+}
+
+/* Times the streaming thread of the audio sink woke up so far */
+static glong _count_wakeups(MafwGstRendererWorker *worker)
+{
+	return g_atomic_int_get(&worker->output.sink_wakeups);
+}
+
+static void _output_stats_start(MafwGstRendererWorker *worker)
+{
+	worker->output.since = g_get_monotonic_time();
+	worker->output.wakeups_since = _count_wakeups(worker);
+}
+
+static void _output_stats_stop(MafwGstRendererWorker *worker)
+{
+	OutputProfile profile = worker->output.active;
+	gint64 usecs;
+	glong wakeups;
+
+	if (worker->output.since == 0)
+		return;
+
+	usecs = g_get_monotonic_time() - worker->output.since;
+	wakeups = _count_wakeups(worker) - worker->output.wakeups_since;
+	worker->output.stats[profile].usecs += usecs;
+	worker->output.stats[profile].wakeups += wakeups;
+	worker->output.since = 0;
+
+	g_debug("%s audio output: %.1f sink thread wakeups/s, %d underruns, "
+		"%d discontinuities so far",
+		output_profiles[profile].name,
+		usecs > 0 ? wakeups * (gdouble) G_USEC_PER_SEC / usecs : 0.0,
+		g_atomic_int_get(&worker->output.stats[profile].underruns),
+		g_atomic_int_get(&worker->output.discontinuities));
+}
+
+static gboolean _output_relax_cb(gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
+
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	if (worker->state == GST_STATE_PLAYING &&
+	    g_get_monotonic_time() - worker->output.last_underrun >=
+	    MAFW_GST_RENDERER_WORKER_OUTPUT_SECONDS_STABLE * G_USEC_PER_SEC &&
+	    worker->output.extra_usecs > 0) {
+		g_atomic_int_add(&worker->output.extra_usecs,
+				 -MAFW_GST_RENDERER_WORKER_OUTPUT_GROW_STEP);
+		g_debug("audio stable, buffering %d ms more than the profile",
+			worker->output.extra_usecs / 1000);
+		_update_output_profile(worker);
+	}
+
+	if (worker->output.extra_usecs == 0) {
+		worker->output.relax_timeout = 0;
+		_worker_unlock(worker);
+		return FALSE;
+	}
+
+	_worker_unlock(worker);
+	return TRUE;
+}
+
+/*
+ * The audio sink ran dry, most likely because the CPU is too busy to
+ * decode in time.  Buffer more, latency is better than glitches.  The
+ * sink only sizes its ring buffer when it opens its stream, so the
+ * larger buffer applies when it next does, rather than interrupting the
+ * media for it.
+ */
+static void _handle_audio_underrun(MafwGstRendererWorker *worker)
+{
+	worker->output.last_underrun = g_get_monotonic_time();
+	if (worker->output.extra_usecs >=
+	    MAFW_GST_RENDERER_WORKER_OUTPUT_MAX_EXTRA)
+		return;
+
+	g_atomic_int_add(&worker->output.extra_usecs,
+			 MAFW_GST_RENDERER_WORKER_OUTPUT_GROW_STEP);
+	g_debug("audio underrun, buffering %d ms more than the profile",
+		worker->output.extra_usecs / 1000);
+	_update_output_profile(worker);
+
+	if (worker->output.relax_timeout == 0) {
+		worker->output.relax_timeout = _worker_timeout_add_seconds(
+			worker, MAFW_GST_RENDERER_WORKER_OUTPUT_SECONDS_STABLE,
+			_output_relax_cb);
+	}
+}
+
+static void _remove_output_switch_timeout(MafwGstRendererWorker *worker)
+{
+	if (worker->output.switch_timeout != 0) {
+		_worker_source_remove(worker, worker->output.switch_timeout);
+		worker->output.switch_timeout = 0;
+	}
+}
+
+/*
+ * The audio stream plays on the new output.  Whatever the sink waited for
+ * longer than it buffers was not heard.
+ */
+static void _handle_output_switched(MafwGstRendererWorker *worker,
+				    GstMessage *msg)
+{
+	const GstStructure *s = gst_message_get_structure(msg);
+	gint64 latency = 0, gap = 0;
+
+	_remove_output_switch_timeout(worker);
+	gst_structure_get_int64(s, "latency", &latency);
+	gst_structure_get_int64(s, "gap", &gap);
+	worker->output.switch_latency = latency;
+	worker->output.switch_dropped =
+		MAX(gap - worker->output.sink_buffer_time, 0);
+	g_debug("audio output switched to %s in %" G_GINT64_FORMAT
+		" ms, %" G_GINT64_FORMAT " ms of audio lost",
+		gst_structure_get_string(s, "device"), latency / 1000,
+		worker->output.switch_dropped / 1000);
+}
+
+static gboolean _output_switch_timeout_cb(gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
+
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	worker->output.switch_timeout = 0;
+	if (g_atomic_int_get(&worker->output.switching)) {
+		g_atomic_int_set(&worker->output.switching, FALSE);
+		worker->output.switch_latency = -1;
+		worker->output.switch_dropped = 0;
+		g_warning("audio output did not switch to %s",
+			  worker->output.device);
+	}
+
+	_worker_unlock(worker);
+	return FALSE;
+}
+
+/*
+ * The audio sink opened its stream with another profile.
+ */
+static void _handle_output_profile(MafwGstRendererWorker *worker,
+				   GstMessage *msg)
+{
+	gint profile;
+	gboolean playing;
+
+	if (!gst_structure_get_int(gst_message_get_structure(msg), "profile",
+				   &profile) ||
+	    profile == worker->output.active)
+		return;
+
+	playing = worker->output.since != 0;
+	_output_stats_stop(worker);
+	worker->output.active = profile;
+	g_debug("audio output profile: %s", output_profiles[profile].name);
+	if (playing)
+		_output_stats_start(worker);
+}
+
+/*
+ * Logs how long the media took to start playing, up to when the audio
+ * sink rendered its first buffer, and whether the plugins had been warmed
+ * up for it.
+ */
+static void _report_first_audio(MafwGstRendererWorker *worker,
+				GstMessage *msg)
+{
+	gint64 rendered = 0;
+
+	if (worker->first_audio.requested == 0)
+		return;
+
+	gst_structure_get_int64(gst_message_get_structure(msg), "time",
+				&rendered);
+	g_debug("time to first audio: %" G_GINT64_FORMAT " ms, %s media, "
+		"warm-up %s",
+		(rendered - worker->first_audio.requested) / 1000,
+		worker->first_audio.played ? "later" : "first",
+		worker->first_audio.warmup);
+	worker->first_audio.requested = 0;
+	worker->first_audio.played = TRUE;
+}
+
+/*
+ * Runs in the streaming thread, while the audio stream is being moved to
+ * another output.  The move is over once the sink writes to the output
+ * asked for.
+ */
+static void _check_output_switch(MafwGstRendererWorker *worker,
+				 GstObject *sink, GstObject *top, gint64 now)
+{
+	gchar *device, *current;
+
+	if (worker->output.last_buffer != 0 &&
+	    now - worker->output.last_buffer > worker->output.switch_gap)
+		worker->output.switch_gap = now - worker->output.last_buffer;
+
+	g_object_get(sink, "device", &device, "current-device", &current,
+		     NULL);
+	if (device == NULL || !g_strcmp0(device, current)) {
+		g_atomic_int_set(&worker->output.switching, FALSE);
+		gst_element_post_message(
+			GST_ELEMENT(top),
+			gst_message_new_application(
+				top,
+				gst_structure_new(
+					"mafw-output-switched",
+					"device", G_TYPE_STRING, current,
+					"latency", G_TYPE_INT64,
+					now - worker->output.switch_start,
+					"gap", G_TYPE_INT64,
+					worker->output.switch_gap,
+					NULL)));
+	}
+	g_free(device);
+	g_free(current);
+}
+
+/*
+ * Runs in the streaming thread.  Sets the output profile right before
+ * the audio sink sizes its ring buffer from the caps, and counts the
+ * underruns: upstream not feeding the sink for longer than its buffer
+ * lasts.
+ */
+static GstPadProbeReturn _asink_probe_cb(GstPad *pad, GstPadProbeInfo *info,
+					 MafwGstRendererWorker *worker)
+{
+	GstObject *top;
+	GstEvent *event;
+	OutputProfile profile;
+	gint n_video = 0;
+
+	top = GST_OBJECT_PARENT(pad);
+	while (GST_OBJECT_PARENT(top) != NULL)
+		top = GST_OBJECT_PARENT(top);
+
+	if (_start_seek_probe(worker, top, info))
+		return GST_PAD_PROBE_DROP;
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+		gint64 now = g_get_monotonic_time();
+
+		/* The sink renders the prerolled buffer as it goes to
+		 * PLAYING, and this one right after it */
+		if (GST_STATE(GST_OBJECT_PARENT(pad)) == GST_STATE_PLAYING &&
+		    g_atomic_int_compare_and_exchange(
+			    &worker->first_audio.pending, TRUE, FALSE)) {
+			gst_element_post_message(
+				GST_ELEMENT(top),
+				gst_message_new_application(
+					top,
+					gst_structure_new(
+						"mafw-first-audio",
+						"time", G_TYPE_INT64, now,
+						NULL)));
+		}
+
+		/* The pipeline (re)started playing since the last buffer,
+		 * the sink was not consuming meanwhile */
+		if (g_atomic_int_compare_and_exchange(
+			    &worker->output.restarted, TRUE, FALSE))
+			worker->output.last_buffer = 0;
+		if (worker->output.last_buffer != 0 &&
+		    g_atomic_int_get(&worker->output.playing)) {
+			if (now - worker->output.last_buffer >
+			    worker->output.sink_buffer_time) {
+				profile = worker->output.sink_profile;
+				g_atomic_int_inc(
+					&worker->output.stats[profile].underruns);
+				gst_element_post_message(
+					GST_ELEMENT(top),
+					gst_message_new_application(
+						top,
+						gst_structure_new_empty(
+							"mafw-audio-underrun")));
+			}
+			/* Data lost or dropped upstream */
+			if (GST_BUFFER_IS_DISCONT(buffer)) {
+				g_atomic_int_inc(
+					&worker->output.discontinuities);
+			}
+		}
+		if (g_atomic_int_get(&worker->output.switching))
+			_check_output_switch(worker, GST_OBJECT_PARENT(pad),
+					     top, now);
+		_count_sink_wakeups(worker);
+		worker->output.last_buffer = now;
+		return GST_PAD_PROBE_OK;
+	}
+
+	event = GST_PAD_PROBE_INFO_EVENT(info);
+	if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+		worker->output.last_buffer = 0;
+		return GST_PAD_PROBE_OK;
+	}
+	if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+		return GST_PAD_PROBE_OK;
+
+	if (g_object_class_find_property(G_OBJECT_GET_CLASS(top), "n-video"))
+		g_object_get(top, "n-video", &n_video, NULL);
+
+	profile = _select_output_profile(worker, n_video > 0);
+	_set_output_profile(worker, GST_ELEMENT(GST_OBJECT_PARENT(pad)),
+			    profile);
+	worker->output.sink_profile = profile;
+	g_object_get(GST_OBJECT_PARENT(pad), "buffer-time",
+		     &worker->output.sink_buffer_time, NULL);
+
+	gst_element_post_message(
+		GST_ELEMENT(top),
+		gst_message_new_application(
+			top,
+			gst_structure_new("mafw-output-profile",
+					  "profile", G_TYPE_INT, profile,
+					  NULL)));
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void _handle_state_changed(GstMessage *msg, MafwGstRendererWorker *worker)
+{
+	GstState newstate, oldstate;
+	GstStateChange statetrans;
+
+	gst_message_parse_state_changed(msg, &oldstate, &newstate, NULL);
+	statetrans = GST_STATE_TRANSITION(oldstate, newstate);
+	g_debug ("State changed: %d: %d -> %d", worker->state, oldstate, newstate);
+
+	/* If the state is the same we do nothing, otherwise, we keep
+	 * it */
+	if (worker->state == newstate) {
+		return;
+	} else {
+		worker->state = newstate;
+	}
+
+	if (newstate == GST_STATE_PLAYING) {
+		/* Not an underrun, the sink was not consuming.  The probe
+		 * forgets the last buffer before it sees the new state. */
+		g_atomic_int_set(&worker->output.restarted, TRUE);
+		g_atomic_int_set(&worker->output.playing, TRUE);
+		_output_stats_start(worker);
+	} else if (oldstate == GST_STATE_PLAYING) {
+		g_atomic_int_set(&worker->output.playing, FALSE);
+		_output_stats_stop(worker);
+	}
+
+        if (statetrans == GST_STATE_CHANGE_READY_TO_PAUSED &&
+            worker->in_ready) {
+                /* Woken up from READY, resume stream position and playback */
+                g_debug("State changed to pause after ready");
+                if (worker->seek_position > 0 &&
+		    !g_atomic_int_get(&worker->preroll_seek_done)) {
+                        _check_seekability(worker);
+                        if (worker->media.seekable) {
+                                g_debug("performing a seek");
+				_do_seek(worker, GST_SEEK_TYPE_SET, FALSE,
+                                         worker->seek_position, NULL);
+                        } else {
+                                g_critical("media is not seekable (and should)");
+                        }
+                }
+                worker->preroll_seek_done = FALSE;
+
+                /* If playing a stream wait for buffering to finish before
+                   starting to play */
+                if (!worker->is_stream || worker->is_live) {
+                        _do_play(worker);
+                }
+                return;
+        }
+
+	/* While buffering, we have to wait in PAUSED 
+	   until we reach 100% before doing anything */
+	if (worker->buffering) {
+	        if (statetrans == GST_STATE_CHANGE_PAUSED_TO_PLAYING) {
+			/* Mmm... probably the client issued a seek on the
+			 * stream and then a play/resume command right away,
+			 * so the stream got into PLAYING state while
+			 * buffering. When the next buffering signal arrives,
+			 * the stream will be PAUSED silently and resumed when
+			 * buffering is done (silently too), so let's signal
+			 * the state change to PLAYING here. */
+			_report_playing_state(worker);			
+		}
+		return;
+	}
+
+	switch (statetrans) {
+	case GST_STATE_CHANGE_READY_TO_PAUSED:
+		if (worker->prerolling && worker->report_statechanges) {
+			/* PAUSED after pipeline has been
+			 * constructed. We check caps, seek and
+			 * duration and if staying in pause is needed,
+			 * we perform operations for pausing, such as
+			 * current frame on pause and signalling state
+			 * change and adding the timeout to go to ready */
+			g_debug ("Prerolling done, finalizaing startup");
+			_finalize_startup(worker);
+			_seek_to_start_position(worker);
+			_do_play(worker);
+			_invoke_owner(worker, _playback_started_cb, NULL, NULL);
+
+			if (worker->stay_paused) {
+				_do_pause_postprocessing(worker);
+			}
+			worker->prerolling = FALSE;
+		}
+		break;
+	case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+		/* When pausing we do the stuff, like signalling
+		 * state, current frame on pause and timeout to go to
+		 * ready */
+		if (worker->report_statechanges) {
+			_do_pause_postprocessing(worker);
+		}
+		_remove_converter_audit_timeout(worker);
+		_report_converters(worker);
+		break;
+	case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+		/* if seek was called, at this point it is really ended */
+		worker->seek_position = -1;
+                worker->eos = FALSE;
 
 		/* Signal state change if needed */
 		_report_playing_state(worker);
 
 		/* Prevent blanking if we are playing video */
-                if (worker->media.has_visual_content) {
-                        blanking_prohibit();
-                }
-		keypadlocking_prohibit();
+		_invoke_owner(worker, _prohibit_blanking_cb,
+			      GINT_TO_POINTER(!worker->audio_only &&
+					      g_atomic_int_get(
+						&worker->media.has_visual_content)),
+			      NULL);
 		/* Remove the ready timeout if we are playing [again] */
 		_remove_ready_timeout(worker);
+		if (!worker->loop.armed)
+			_arm_loop(worker);
                 /* If mode is redundant we are trying to play one of several
                  * candidates, so when we get a successful playback, we notify
                  * the real URI that we are playing */
                 if (worker->mode == WORKER_MODE_REDUNDANT) {
-                        mafw_renderer_emit_metadata_string(
-                                worker->owner,
-                                MAFW_METADATA_KEY_URI,
-                                worker->media.location);
+                        _emit_metadata(worker, MAFW_METADATA_KEY_URI,
+                                       G_TYPE_STRING, worker->media.location);
                 }
 
 		/* Emit metadata. We wait until we reach the playing
@@ -946,6 +2386,8 @@ static void _handle_state_changed(GstMessage *msg, MafwGstRendererWorker *worker
 		/* Query duration and seekability. Useful for vbr
 		 * clips or streams. */
 		_add_duration_seek_query_timeout(worker);
+		/* Once the converters have done some work */
+		_add_converter_audit_timeout(worker);
 		break;
 	case GST_STATE_CHANGE_PAUSED_TO_READY:
 		/* If we went to READY, we free the taglist and
@@ -968,7 +2410,7 @@ static void _handle_duration(MafwGstRendererWorker *worker, GstMessage *msg)
 	gst_message_parse_duration(msg, &fmt, &duration);
 
 	if (worker->duration_seek_timeout != 0) {
-		g_source_remove(worker->duration_seek_timeout);
+		_worker_source_remove(worker, worker->duration_seek_timeout);
 		worker->duration_seek_timeout = 0;
 	}
 
@@ -999,7 +2441,7 @@ static void _emit_renderer_art(MafwGstRendererWorker *worker,
 }
 #endif
 
-static GHashTable* _build_tagmap(void)
+static gpointer _build_tagmap(gpointer data)
 {
 	GHashTable *hash_table = NULL;
 
@@ -1040,17 +2482,17 @@ static GHashTable* _build_tagmap(void)
 static void _emit_tag(const GstTagList *list, const gchar *tag,
 		      MafwGstRendererWorker *worker)
 {
-	/* Mapping between Gst <-> MAFW metadata tags
+	/* Mapping between Gst <-> MAFW metadata tags, shared read-only by
+	 * all the workers.
 	 * NOTE: This assumes that GTypes matches between GST and MAFW. */
-	static GHashTable *tagmap = NULL;
+	static GOnce tagmap_once = G_ONCE_INIT;
+	GHashTable *tagmap;
 	gint i, count;
 	const gchar *mafwtag;
 	GType type;
 	GValueArray *values;
 
-	if (tagmap == NULL) {
-		tagmap = _build_tagmap();
-	}
+	tagmap = g_once(&tagmap_once, _build_tagmap, NULL);
 
 	g_debug("tag: '%s' (type: %s)", tag,
 		g_type_name(gst_tag_get_type(tag)));
@@ -1110,10 +2552,7 @@ static void _emit_tag(const GstTagList *list, const gchar *tag,
 	}
 
 	/* Emit the metadata. */
-	g_signal_emit_by_name(worker->owner, "metadata-changed", mafwtag,
-			      values);
-
-	g_value_array_free(values);
+	_emit_metadata_values(worker, mafwtag, values);
 }
 
 /**
@@ -1180,7 +2619,6 @@ static void _reset_volume_and_mute_to_pipeline(MafwGstRendererWorker *worker)
 static void _handle_buffering(MafwGstRendererWorker *worker, GstMessage *msg)
 {
 	gint percent;
-	MafwGstRenderer *renderer = (MafwGstRenderer*)worker->owner;
 
 	gst_message_parse_buffering(msg, &percent);
 	g_debug("buffering: %d", percent);
@@ -1201,10 +2639,7 @@ static void _handle_buffering(MafwGstRendererWorker *worker, GstMessage *msg)
 					      GST_STATE_PAUSED) ==
 		    			GST_STATE_CHANGE_ASYNC)
 			{
-				/* XXX this blocks at most 2 seconds. */
-				gst_element_get_state(worker->pipeline, NULL,
-					      NULL,
-					      2 * GST_SECOND);
+				_wait_for_state_change(worker);
 			}
 		}
 
@@ -1219,14 +2654,14 @@ static void _handle_buffering(MafwGstRendererWorker *worker, GstMessage *msg)
 					g_debug("buffering concluded during "
 						"prerolling");
 					_finalize_startup(worker);
+					_seek_to_start_position(worker);
 					_do_play(worker);
-					renderer->play_failed_count = 0;
+					_invoke_owner(worker,
+						      _playback_started_cb,
+						      NULL, NULL);
 					/* Send the paused notification */
-					if (worker->stay_paused &&
-					    worker->notify_pause_handler) {
-						worker->notify_pause_handler(
-							worker,
-							worker->owner);
+					if (worker->stay_paused) {
+						_notify_pause(worker);
 					}
 					worker->prerolling = FALSE;
                                 } else if (worker->in_ready) {
@@ -1254,10 +2689,7 @@ static void _handle_buffering(MafwGstRendererWorker *worker, GstMessage *msg)
 						GST_STATE_PLAYING) ==
 		    					GST_STATE_CHANGE_ASYNC)
 					{
-						/* XXX this blocks at most 2 seconds. */
-						gst_element_get_state(
-							worker->pipeline, NULL, NULL,
-							2 * GST_SECOND);
+						_wait_for_state_change(worker);
 					}
 				}
                         } else if (worker->state == GST_STATE_PLAYING) {
@@ -1280,16 +2712,10 @@ static void _handle_buffering(MafwGstRendererWorker *worker, GstMessage *msg)
 						GST_STATE_PLAYING) ==
 		    					GST_STATE_CHANGE_ASYNC)
 				{
-					/* XXX this blocks at most 2 seconds. */
-					gst_element_get_state(
-						worker->pipeline, NULL, NULL,
-						2 * GST_SECOND);
+					_wait_for_state_change(worker);
 				}
-				if (worker->report_statechanges &&
-                		    worker->notify_play_handler) {
-					worker->notify_play_handler(
-                                               		worker,
-	                                                worker->owner);
+				if (worker->report_statechanges) {
+					_notify_play(worker);
 				}
                                 _add_duration_seek_query_timeout(worker);
                         }
@@ -1297,51 +2723,309 @@ static void _handle_buffering(MafwGstRendererWorker *worker, GstMessage *msg)
         }
 
 	/* Send buffer percentage */
-        if (worker->notify_buffer_status_handler)
-                worker->notify_buffer_status_handler(worker, worker->owner,
-						     percent);
+	_invoke_owner(worker, _call_buffer_status_handler,
+		      GINT_TO_POINTER(percent), NULL);
 }
 
-static void _handle_element_msg(MafwGstRendererWorker *worker, GstMessage *msg)
+/*
+ * Turns video decoding off when there is no window to show it in, and back
+ * on when there is one again.  In the latter case we seek to the current
+ * position, so the picture comes back at the nearest keyframe.
+ */
+static void _update_video_decoding(MafwGstRendererWorker *worker)
 {
-	/* Only HelixBin sends "resolution" messages. */
-	if (gst_structure_has_name(gst_message_get_structure(msg),
-				   "resolution") &&
-	    _handle_video_info(worker, gst_message_get_structure(msg)))
-	{
-		worker->media.has_visual_content = TRUE;
+	gboolean audio_only;
+
+	audio_only = worker->lean_audio || !worker->xid ||
+		!worker->video_visible;
+	if (worker->pipeline == NULL || audio_only == worker->audio_only)
+		return;
+
+	g_debug("%s video decoding", audio_only ? "disabling" : "enabling");
+	worker->audio_only = audio_only;
+	g_object_set(worker->pipeline, "flags", audio_only ?
+		     MAFW_GST_PLAY_FLAGS & ~MAFW_GST_PLAY_FLAG_VIDEO :
+		     MAFW_GST_PLAY_FLAGS, NULL);
+
+	_update_output_profile(worker);
+
+	if (audio_only) {
+		/* Nothing is rendered, so nothing to govern */
+		_qos_reset(worker);
+		_invoke_owner(worker, _allow_blanking_cb, NULL, NULL);
+	} else if (worker->media.location && !worker->prerolling &&
+		   !worker->in_ready && worker->state >= GST_STATE_PAUSED) {
+		_do_seek(worker, GST_SEEK_TYPE_SET, FALSE,
+			 _get_position(worker), NULL);
 	}
 }
 
-static void _reset_pl_info(MafwGstRendererWorker *worker)
+/*
+ * Sets "skip-frame" on the video decoders that have it (avdec_*): 1 skips
+ * the frames not used as reference, 0 decodes everything.
+ */
+static void _qos_set_decoder_skip_frame(MafwGstRendererWorker *worker,
+					gint skip)
 {
-	if (worker->pl.items) {
-		g_slist_foreach(worker->pl.items, (GFunc) g_free, NULL);
-		g_slist_free(worker->pl.items);
-		worker->pl.items = NULL;
+	GstIterator *it;
+	GValue item = G_VALUE_INIT;
+	gboolean done = FALSE;
+
+	it = gst_bin_iterate_recurse(GST_BIN(worker->pipeline));
+	while (!done) {
+		switch (gst_iterator_next(it, &item)) {
+		case GST_ITERATOR_OK: {
+			GstElement *element = g_value_get_object(&item);
+			GstElementFactory *factory;
+
+			factory = gst_element_get_factory(element);
+			if (factory != NULL &&
+			    gst_element_factory_list_is_type(
+				    factory,
+				    GST_ELEMENT_FACTORY_TYPE_DECODER |
+				    GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO) &&
+			    g_object_class_find_property(
+				    G_OBJECT_GET_CLASS(element),
+				    "skip-frame")) {
+				g_object_set(element, "skip-frame", skip, NULL);
+			}
+			g_value_reset(&item);
+			break;
+		}
+		case GST_ITERATOR_RESYNC:
+			gst_iterator_resync(it);
+			break;
+		default:
+			done = TRUE;
+			break;
+		}
 	}
-
-	worker->pl.current = 0;
-	worker->pl.notify_play_pending = TRUE;
+	g_value_unset(&item);
+	gst_iterator_free(it);
 }
 
-static GError * _get_specific_missing_plugin_error(GstMessage *msg)
+/*
+ * Level 1 skips the decoding of non-reference frames, levels 2 and 3 on
+ * top of that render at most a half and a quarter of the frames.  Audio
+ * is never touched.
+ */
+static void _qos_apply_level(MafwGstRendererWorker *worker)
 {
-	const GstStructure *gst_struct;
-	const gchar *type;
+	guint64 throttle = 0;
 
-	GError *error;
-	gchar *desc;
+	g_debug("QoS level %u", worker->qos.level);
+	if (worker->pipeline != NULL) {
+		_qos_set_decoder_skip_frame(worker,
+					    worker->qos.level >= 1 ? 1 : 0);
+	}
 
-	desc = gst_missing_plugin_message_get_description(msg);
+	if (worker->qos.level >= 2 && worker->media.fps > 0) {
+		throttle = (guint64)((worker->qos.level == 2 ? 2 : 4) *
+				     GST_SECOND / worker->media.fps);
+	}
+	if (worker->vsink != NULL) {
+		GstElement *sink = NULL;
+
+		/* glimagesink wraps the base sink, which throttles */
+		if (g_object_class_find_property(
+			    G_OBJECT_GET_CLASS(worker->vsink), "sink"))
+			g_object_get(worker->vsink, "sink", &sink, NULL);
+		if (sink == NULL)
+			sink = gst_object_ref(worker->vsink);
+		g_object_set(sink, "throttle-time", throttle, NULL);
+		gst_object_unref(sink);
+	}
+}
 
-	gst_struct = gst_message_get_structure(msg);
-	type = gst_structure_get_string(gst_struct, "type");
+static void _qos_emit_counters(MafwGstRendererWorker *worker)
+{
+	gint rendered, dropped;
+
+	rendered = worker->qos.rendered;
+	dropped = worker->qos.dropped;
+	_current_metadata_add(worker,
+			      MAFW_METADATA_KEY_GST_RENDERER_RENDERED_FRAMES,
+			      G_TYPE_INT, rendered);
+	_current_metadata_add(worker,
+			      MAFW_METADATA_KEY_GST_RENDERER_DROPPED_FRAMES,
+			      G_TYPE_INT, dropped);
+	_emit_metadata(worker, MAFW_METADATA_KEY_GST_RENDERER_RENDERED_FRAMES,
+		       G_TYPE_INT, rendered);
+	_emit_metadata(worker, MAFW_METADATA_KEY_GST_RENDERER_DROPPED_FRAMES,
+		       G_TYPE_INT, dropped);
+	worker->qos.last_emit = g_get_monotonic_time();
+}
 
-	if ((type) && ((strcmp(type, MAFW_GST_MISSING_TYPE_DECODER) == 0) ||
-		       (strcmp(type, MAFW_GST_MISSING_TYPE_ENCODER) == 0))) {
+static gboolean _qos_relax_cb(gpointer data)
+{
+	MafwGstRendererWorker *worker = data;
 
-		/* Missing codec error. */
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	if (g_get_monotonic_time() - worker->qos.last_drop >=
+	    MAFW_GST_RENDERER_WORKER_QOS_SECONDS_RELAX * G_USEC_PER_SEC &&
+	    worker->qos.level > 0) {
+		worker->qos.level--;
+		_qos_apply_level(worker);
+	}
+
+	if (worker->qos.level == 0) {
+		worker->qos.relax_timeout = 0;
+		_worker_unlock(worker);
+		return FALSE;
+	}
+
+	_worker_unlock(worker);
+	return TRUE;
+}
+
+/*
+ * Forgets the QoS history and goes back to decoding and rendering
+ * everything.
+ */
+static void _qos_reset(MafwGstRendererWorker *worker)
+{
+	if (worker->qos.relax_timeout != 0) {
+		_worker_source_remove(worker, worker->qos.relax_timeout);
+		worker->qos.relax_timeout = 0;
+	}
+	if (worker->qos.level > 0) {
+		worker->qos.level = 0;
+		_qos_apply_level(worker);
+	}
+	memset(&worker->qos, 0, sizeof(worker->qos));
+}
+
+/*
+ * The video sink posts QoS messages when it drops late frames.  If it
+ * keeps doing so, degrade the video step by step rather than letting the
+ * whole playback stutter.
+ */
+static void _handle_qos(MafwGstRendererWorker *worker, GstMessage *msg)
+{
+	GstFormat format;
+	guint64 rendered, dropped;
+	gint64 now;
+
+	/* glimagesink is a bin, its inner sink posts them */
+	if (worker->vsink == NULL ||
+	    !gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg),
+					GST_OBJECT(worker->vsink)))
+		return;
+
+	gst_message_parse_qos_stats(msg, &format, &rendered, &dropped);
+	if (format != GST_FORMAT_BUFFERS ||
+	    rendered == (guint64)-1 || dropped == (guint64)-1)
+		return;
+
+	now = g_get_monotonic_time();
+	worker->qos.rendered = rendered;
+	worker->qos.dropped = dropped;
+	if (dropped > worker->qos.window_dropped)
+		worker->qos.last_drop = now;
+
+	if (worker->qos.window_start == 0) {
+		worker->qos.window_start = now;
+		worker->qos.window_rendered = rendered;
+		worker->qos.window_dropped = dropped;
+	} else if (now - worker->qos.window_start >=
+		   MAFW_GST_RENDERER_WORKER_QOS_WINDOW) {
+		guint64 wdropped, wtotal;
+
+		wdropped = dropped - worker->qos.window_dropped;
+		wtotal = wdropped + rendered - worker->qos.window_rendered;
+		if (wdropped > 0 &&
+		    wdropped * 100 >=
+		    wtotal * MAFW_GST_RENDERER_WORKER_QOS_DROP_PERCENT &&
+		    worker->qos.level < MAFW_GST_RENDERER_WORKER_QOS_MAX_LEVEL) {
+			worker->qos.level++;
+			_qos_apply_level(worker);
+			if (worker->qos.relax_timeout == 0) {
+				worker->qos.relax_timeout =
+					_worker_timeout_add_seconds(
+					worker,
+					MAFW_GST_RENDERER_WORKER_QOS_SECONDS_RELAX,
+					_qos_relax_cb);
+			}
+		}
+		worker->qos.window_start = now;
+		worker->qos.window_rendered = rendered;
+		worker->qos.window_dropped = dropped;
+	}
+
+	if (now - worker->qos.last_emit >= G_USEC_PER_SEC)
+		_qos_emit_counters(worker);
+}
+
+/*
+ * Publishes the threading _element_setup_cb() chose for a video decoder.
+ */
+static void _handle_decoder_policy(MafwGstRendererWorker *worker,
+				   GstMessage *msg)
+{
+	const GstStructure *s;
+	const gchar *type;
+	gint threads;
+
+	s = gst_message_get_structure(msg);
+	if (!gst_structure_get_int(s, "max-threads", &threads))
+		return;
+	type = gst_structure_get_string(s, "thread-type");
+
+	_current_metadata_add(worker,
+			      MAFW_METADATA_KEY_GST_RENDERER_DECODER_THREADS,
+			      G_TYPE_INT, threads);
+	_current_metadata_add(worker,
+			      MAFW_METADATA_KEY_GST_RENDERER_DECODER_THREAD_TYPE,
+			      G_TYPE_STRING, type);
+	_emit_metadata(worker, MAFW_METADATA_KEY_GST_RENDERER_DECODER_THREADS,
+		       G_TYPE_INT, threads);
+	_emit_metadata(worker,
+		       MAFW_METADATA_KEY_GST_RENDERER_DECODER_THREAD_TYPE,
+		       G_TYPE_STRING, type);
+}
+
+static void _handle_element_msg(MafwGstRendererWorker *worker, GstMessage *msg)
+{
+	/* Only HelixBin sends "resolution" messages. */
+	if (gst_structure_has_name(gst_message_get_structure(msg),
+				   "resolution") &&
+	    _handle_video_info(worker, gst_message_get_structure(msg)))
+	{
+		g_atomic_int_set(&worker->media.has_visual_content, TRUE);
+	}
+}
+
+static void _reset_pl_info(MafwGstRendererWorker *worker)
+{
+	if (worker->pl.items) {
+		g_slist_foreach(worker->pl.items, (GFunc) g_free, NULL);
+		g_slist_free(worker->pl.items);
+		worker->pl.items = NULL;
+	}
+
+	worker->pl.current = 0;
+	worker->pl.notify_play_pending = TRUE;
+}
+
+static GError * _get_specific_missing_plugin_error(GstMessage *msg)
+{
+	const GstStructure *gst_struct;
+	const gchar *type;
+
+	GError *error;
+	gchar *desc;
+
+	desc = gst_missing_plugin_message_get_description(msg);
+
+	gst_struct = gst_message_get_structure(msg);
+	type = gst_structure_get_string(gst_struct, "type");
+
+	if ((type) && ((strcmp(type, MAFW_GST_MISSING_TYPE_DECODER) == 0) ||
+		       (strcmp(type, MAFW_GST_MISSING_TYPE_ENCODER) == 0))) {
+
+		/* Missing codec error. */
 		const GValue *val;
 		const GstCaps *caps;
 		GstStructure *caps_struct;
@@ -1382,10 +3066,10 @@ static GError * _get_specific_missing_plugin_error(GstMessage *msg)
 }
 
 /*
- * Asynchronous message handler.  It gets removed from if it returns FALSE.
+ * Handles a bus message in the worker thread, with the worker lock held.
  */
-static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
-				   MafwGstRendererWorker *worker)
+static gboolean _handle_bus_message(GstBus *bus, GstMessage *msg,
+				    MafwGstRendererWorker *worker)
 {
 	/* No need to handle message if error has already occured. */
 	if (worker->is_error)
@@ -1417,6 +3101,14 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 			if (debug)
 				g_free(debug);
 
+			/* Streams losing the connection are reopened */
+			if (_reconnect(worker, err)) {
+				g_error_free(err);
+				break;
+			}
+			mafw_gst_renderer_autoplug_cache_forget(
+				worker->pipeline);
+
 			/* If we are in playlist/radio mode, we silently
 			   ignore the error and continue with the next
 			   item until we end the playlist. If no
@@ -1451,12 +3143,13 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 				if (err->domain == GST_STREAM_ERROR &&
 					err->code == GST_STREAM_ERROR_WRONG_TYPE)
 				{/* Maybe it is a playlist? */
-					GSList *plitems = _parse_playlist(worker->media.location);
+					GSList *plitems = _parse_playlist(worker, worker->media.location);
 					
 					if (plitems)
 					{/* Yes, it is a plitem */
 						g_error_free(err);
-						mafw_gst_renderer_worker_play(worker, NULL, plitems);
+						_play_at(worker, NULL, plitems,
+							 0, NULL);
 						break;
 					}
 					
@@ -1468,6 +3161,9 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 		break;
 	case GST_MESSAGE_EOS:
 		if (!worker->is_error) {
+			/* Streams ending early lost the connection */
+			if (_reconnect(worker, NULL))
+				break;
 			worker->eos = TRUE;
 
 			if (worker->mode == WORKER_MODE_PLAYLIST) {
@@ -1486,10 +3182,8 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 
 			if (worker->mode == WORKER_MODE_SINGLE_PLAY ||
                             worker->mode == WORKER_MODE_REDUNDANT) {
-				if (worker->notify_eos_handler)
-					worker->notify_eos_handler(
-						worker,
-						worker->owner);
+				_invoke_owner(worker, _call_eos_handler, NULL,
+					      NULL);
 
 				/* We can remove the message handlers now, we
 				   are not interested in bus messages
@@ -1501,7 +3195,8 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 								 NULL);
 				}
 				if (worker->async_bus_id) {
-					g_source_remove(worker->async_bus_id);
+					_worker_source_remove(
+						worker, worker->async_bus_id);
 					worker->async_bus_id = 0;
 				}
 
@@ -1519,12 +3214,35 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 	case GST_MESSAGE_BUFFERING:
 		_handle_buffering(worker, msg);
 		break;
+	case GST_MESSAGE_SEGMENT_DONE:
+		if ((GstElement *)GST_MESSAGE_SRC(msg) == worker->pipeline)
+			_handle_segment_done(worker);
+		break;
 	case GST_MESSAGE_DURATION:
 		_handle_duration(worker, msg);
 		break;
 	case GST_MESSAGE_ELEMENT:
 		_handle_element_msg(worker, msg);
 		break;
+	case GST_MESSAGE_QOS:
+		_handle_qos(worker, msg);
+		break;
+	case GST_MESSAGE_APPLICATION:
+		if (gst_message_has_name(msg, "mafw-audio-only"))
+			_update_video_decoding(worker);
+		else if (gst_message_has_name(msg, "mafw-decoder-policy"))
+			_handle_decoder_policy(worker, msg);
+		else if (gst_message_has_name(msg, "mafw-output-profile"))
+			_handle_output_profile(worker, msg);
+		else if (gst_message_has_name(msg, "mafw-audio-underrun"))
+			_handle_audio_underrun(worker);
+		else if (gst_message_has_name(msg, "mafw-first-audio"))
+			_report_first_audio(worker, msg);
+		else if (gst_message_has_name(msg, "mafw-video-found"))
+			_leave_lean_audio(worker);
+		else if (gst_message_has_name(msg, "mafw-output-switched"))
+			_handle_output_switched(worker, msg);
+		break;
 	case GST_MESSAGE_STATE_CHANGED:
 		if ((GstElement *)GST_MESSAGE_SRC(msg) == worker->pipeline)
 			_handle_state_changed(msg, worker);
@@ -1535,13 +3253,38 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 	return TRUE;
 }
 
+/*
+ * Asynchronous message handler, dispatched in the worker thread.  It gets
+ * removed if it returns FALSE.
+ */
+static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
+				   MafwGstRendererWorker *worker)
+{
+	gboolean ret;
+
+	if (!_worker_dispatch_lock(worker))
+		return FALSE;
+
+	ret = _handle_bus_message(bus, msg, worker);
+
+	_worker_unlock(worker);
+
+	return ret;
+}
+
+static void _reset_volume_and_mute_cmd(MafwGstRendererWorker *worker,
+				       gpointer data)
+{
+	_reset_volume_and_mute_to_pipeline(worker);
+}
+
 static void _volume_cb(MafwGstRendererWorkerVolume *wvolume, gdouble volume,
 		       gpointer data)
 {
 	MafwGstRendererWorker *worker = data;
 	GValue value = {0, };
 
-	_reset_volume_and_mute_to_pipeline(worker);
+	_worker_command(worker, _reset_volume_and_mute_cmd, NULL, NULL);
 
 	g_value_init(&value, G_TYPE_UINT);
 	g_value_set_uint(&value, (guint) (volume * 100.0));
@@ -1558,7 +3301,7 @@ static void _mute_cb(MafwGstRendererWorkerVolume *wvolume, gboolean mute,
 	MafwGstRendererWorker *worker = data;
 	GValue value = {0, };
 
-	_reset_volume_and_mute_to_pipeline(worker);
+	_worker_command(worker, _reset_volume_and_mute_cmd, NULL, NULL);
 
 	g_value_init(&value, G_TYPE_BOOLEAN);
 	g_value_set_boolean(&value, mute);
@@ -1575,30 +3318,37 @@ static void _mute_cb(MafwGstRendererWorkerVolume *wvolume, gboolean mute,
  * us... */
 static int xerror(Display *dpy, XErrorEvent *xev)
 {
-	MafwGstRendererWorker *worker;
+	GSList *item;
 
-	if (Global_worker == NULL) {
+	G_LOCK(workers);
+	if (workers == NULL) {
+		G_UNLOCK(workers);
 		return -1;
-	} else {
-		worker = Global_worker;
 	}
 
 	/* Swallow BadWindow and stop pipeline when the error is about the
-	 * currently set xid. */
-	if (worker->xid &&
-	    xev->resourceid == worker->xid &&
-	    xev->error_code == BadWindow)
-	{
-		g_warning("BadWindow received for current xid (%x).",
-			(gint)xev->resourceid);
-		worker->xid = 0;
-		/* We must post a message to the bus, because this function is
-		 * invoked from a different thread (xvimagerenderer's queue). */
-		_post_error(worker, g_error_new_literal(
-				    MAFW_RENDERER_ERROR,
-				    MAFW_RENDERER_ERROR_PLAYBACK,
-				    "Video window gone"));
+	 * currently set xid of one of the workers. */
+	for (item = workers; item != NULL; item = item->next) {
+		MafwGstRendererWorker *worker = item->data;
+
+		if (worker->xid &&
+		    xev->resourceid == worker->xid &&
+		    xev->error_code == BadWindow)
+		{
+			g_warning("BadWindow received for current xid (%x).",
+				  (gint)xev->resourceid);
+			worker->xid = 0;
+			/* We must post a message to the bus, because this
+			 * function is invoked from a different thread
+			 * (xvimagerenderer's queue). */
+			_post_error(worker, g_error_new_literal(
+					    MAFW_RENDERER_ERROR,
+					    MAFW_RENDERER_ERROR_PLAYBACK,
+					    "Video window gone"));
+		}
 	}
+	G_UNLOCK(workers);
+
 	return 0;
 }
 
@@ -1612,7 +3362,7 @@ static void _reset_media_info(MafwGstRendererWorker *worker)
 		worker->media.location = NULL;
 	}
 	worker->media.length_nanos = -1;
-	worker->media.has_visual_content = FALSE;
+	g_atomic_int_set(&worker->media.has_visual_content, FALSE);
 	worker->media.seekable = SEEKABILITY_UNKNOWN;
 	worker->media.video_width = 0;
 	worker->media.video_height = 0;
@@ -1645,21 +3395,205 @@ static void _set_mute(MafwGstRendererWorker *worker, gboolean mute)
 		mute);
 }
 
+/*
+ * Issues a seek while the pipeline is on its way to PAUSED, so that the
+ * sinks preroll at @position instead of prerolling at the beginning and
+ * then again after a seek.  Returns FALSE if the pipeline refused it.
+ */
+static gboolean _seek_while_prerolling(MafwGstRendererWorker *worker,
+				       gint position)
+{
+	GstSeekFlags flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+	gint64 start = (gint64) position * GST_SECOND;
+	gboolean ret;
+
+	/* Cut the encoder delay to the sample */
+	if (start <= worker->gapless.start) {
+		start = worker->gapless.start;
+		flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+	}
+	ret = gst_element_seek(worker->pipeline, 1.0, GST_FORMAT_TIME, flags,
+			       GST_SEEK_TYPE_SET, start,
+			       worker->gapless.stop >= 0 ?
+			       GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+			       worker->gapless.stop >= 0 ?
+			       worker->gapless.stop : GST_CLOCK_TIME_NONE);
+	g_debug("seek to %d while prerolling %s", position,
+		ret ? "issued" : "refused");
+
+	return ret;
+}
+
+/*
+ * Runs in a thread of the pipeline, as the streaming thread that got the
+ * first segment must not seek.
+ */
+static void _start_seek_async(GstElement *pipeline,
+			      MafwGstRendererWorker *worker)
+{
+	gint position = worker->start_seek.position;
+	gboolean ret;
+
+	ret = _seek_while_prerolling(worker, position);
+	if (!ret) {
+		/* Let the sink preroll, _seek_to_start_position() or the
+		 * READY wake-up seek after it */
+		g_atomic_int_set(&worker->start_seek.state, START_SEEK_NONE);
+		if (position == 0)
+			g_warning("could not trim the encoder delay");
+	}
+	g_atomic_int_set(&worker->preroll_seek_done, ret);
+}
+
+/*
+ * Prerolls at @position.  Right after the pipeline went to PAUSED
+ * nothing is linked yet and the pipeline refuses a seek, so it is issued
+ * once the audio sink gets its first segment.  The sink drops what comes
+ * before the seek flushes, and prerolls only once, at @position.  If the
+ * seek fails anyway, it is done again after prerolling.
+ */
+static void _seek_at_first_segment(MafwGstRendererWorker *worker,
+				   gint position)
+{
+	g_atomic_int_set(&worker->preroll_seek_done, FALSE);
+	if (worker->asink == NULL) {
+		g_atomic_int_set(&worker->preroll_seek_done,
+				 _seek_while_prerolling(worker, position));
+		return;
+	}
+	worker->start_seek.position = position;
+	g_atomic_int_set(&worker->start_seek.state, START_SEEK_ARMED);
+}
+
+/*
+ * Runs in the streaming thread.  Issues the seek _seek_at_first_segment()
+ * armed, and drops the buffers before its flush.
+ */
+static gboolean _start_seek_probe(MafwGstRendererWorker *worker,
+				  GstObject *top, GstPadProbeInfo *info)
+{
+	GstEvent *event;
+
+	switch (g_atomic_int_get(&worker->start_seek.state)) {
+	case START_SEEK_ARMED:
+		if (!(GST_PAD_PROBE_INFO_TYPE(info) &
+		      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM))
+			return TRUE;
+		event = GST_PAD_PROBE_INFO_EVENT(info);
+		if (GST_EVENT_TYPE(event) != GST_EVENT_SEGMENT)
+			return FALSE;
+		if (g_atomic_int_compare_and_exchange(
+			    &worker->start_seek.state, START_SEEK_ARMED,
+			    START_SEEK_ISSUED)) {
+			gst_element_call_async(
+				GST_ELEMENT(top),
+				(GstElementCallAsyncFunc) _start_seek_async,
+				worker, NULL);
+		}
+		return FALSE;
+	case START_SEEK_ISSUED:
+		if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+			return TRUE;
+		event = GST_PAD_PROBE_INFO_EVENT(info);
+		if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+			g_atomic_int_compare_and_exchange(
+				&worker->start_seek.state, START_SEEK_ISSUED,
+				START_SEEK_NONE);
+		return FALSE;
+	default:
+		return FALSE;
+	}
+}
+
+static void _gapless_cancel(MafwGstRendererWorker *worker)
+{
+	if (worker->gapless.probe != NULL) {
+		mafw_gst_renderer_gapless_cancel(worker->gapless.probe);
+		worker->gapless.probe = NULL;
+	}
+}
+
+/*
+ * Takes the trims of media that was probed after it started to play.
+ * They are applied if the sinks have not prerolled yet: at the first
+ * segment, or after prerolling if it already went by.  Otherwise they are
+ * only for the next time the media plays.
+ */
+static void _gapless_trims_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	GaplessTrims *trims = data;
+
+	if (trims->generation != g_atomic_int_get(&worker->media_generation) ||
+	    worker->gapless.probe == NULL)
+		return;
+	_gapless_cancel(worker);
+	if (!worker->prerolling || (trims->start <= 0 && trims->stop < 0))
+		return;
+
+	worker->gapless.start = trims->start;
+	worker->gapless.stop = trims->stop;
+	if (worker->start_position == 0 && !worker->is_live &&
+	    g_atomic_int_get(&worker->start_seek.state) == START_SEEK_NONE &&
+	    !g_atomic_int_get(&worker->preroll_seek_done))
+		_seek_at_first_segment(worker, 0);
+}
+
+/* Runs in the gapless prober thread */
+static void _gapless_trims_cb(gint64 start, gint64 stop, gpointer data)
+{
+	GaplessTrims *trims = data;
+
+	trims->start = start;
+	trims->stop = stop;
+	_worker_command(trims->worker, _gapless_trims_cmd, trims, g_free);
+}
+
 /*
  * Start to play the media
  */
 static void _start_play(MafwGstRendererWorker *worker)
 {
-	MafwGstRenderer *renderer = (MafwGstRenderer*) worker->owner;
 	GstStateChangeReturn state_change_info;
+	GaplessTrims *trims;
 
 	g_assert(worker->pipeline);
+	worker->first_audio.requested = g_get_monotonic_time();
+	worker->first_audio.warmup = mafw_gst_renderer_warmup_status();
+	g_atomic_int_set(&worker->first_audio.pending, TRUE);
+	mafw_gst_renderer_warmup_stop();
 	g_object_set(G_OBJECT(worker->pipeline),
 		     "uri", worker->media.location, NULL);
+	mafw_gst_renderer_autoplug_cache_attach(worker->pipeline,
+						worker->media.location);
+	mafw_gst_renderer_seek_index_attach(worker->pipeline,
+					    worker->media.location);
 
 	g_debug("URI: %s", worker->media.location);
 	g_debug("setting pipeline to PAUSED");
 
+	/* Needed by the decoder policy as soon as decoders are plugged */
+	worker->is_stream = uri_is_stream(worker->media.location);
+
+	/* Music is played without a video sink, and without decoding
+	 * video it might carry (cover art streams) */
+	worker->lean_audio = uri_is_audio(worker->media.location);
+	if (!worker->lean_audio)
+		_setup_video_sink(worker);
+	worker->audio_only = worker->lean_audio || !worker->xid ||
+		!worker->video_visible;
+	g_object_set(worker->pipeline, "flags", worker->audio_only ?
+		     MAFW_GST_PLAY_FLAGS & ~MAFW_GST_PLAY_FLAG_VIDEO :
+		     MAFW_GST_PLAY_FLAGS, NULL);
+	/* Albums play without gaps only without the silence the encoder
+	 * added around each track.  Files not looked into yet are read in
+	 * the background, _gapless_trims_cmd() gets what was found. */
+	_gapless_cancel(worker);
+	trims = g_new0(GaplessTrims, 1);
+	trims->worker = worker;
+	trims->generation = g_atomic_int_get(&worker->media_generation);
+	worker->gapless.probe = mafw_gst_renderer_gapless_lookup(
+		worker->media.location, &worker->gapless.start,
+		&worker->gapless.stop, _gapless_trims_cb, trims, g_free);
 	worker->report_statechanges = TRUE;
 	state_change_info = gst_element_set_state(worker->pipeline, 
 						  GST_STATE_PAUSED);
@@ -1671,13 +3605,18 @@ static void _start_play(MafwGstRendererWorker *worker)
 	}
         worker->prerolling = TRUE;
 
-	worker->is_stream = uri_is_stream(worker->media.location);
-
-        if (renderer->update_playcount_id > 0) {
-                g_source_remove(renderer->update_playcount_id);
-                renderer->update_playcount_id = 0;
-        }
+	/* Preroll straight at the start position if we have one */
+	if (worker->start_position > 0 &&
+	    state_change_info != GST_STATE_CHANGE_FAILURE && !worker->is_live) {
+		worker->seek_position = worker->start_position;
+		_seek_at_first_segment(worker, worker->start_position);
+	} else if ((worker->gapless.start > 0 || worker->gapless.stop >= 0) &&
+		   state_change_info != GST_STATE_CHANGE_FAILURE &&
+		   !worker->is_live) {
+		_seek_at_first_segment(worker, 0);
+	}
 
+	_invoke_owner(worker, _cancel_stats_update_cb, NULL, NULL);
 }
 
 #ifndef GL_RENDERER
@@ -1793,6 +3732,157 @@ no_dpy:
 	return rv;
 }
 
+/*
+ * Wraps the video sink in a bin with a scaler in front of it, see
+ * _update_video_scaling().
+ */
+static GstElement *_create_scaling_bin(MafwGstRendererWorker *worker)
+{
+	GstElement *bin, *scale, *filter;
+	GstPad *pad;
+
+	scale = gst_element_factory_make("videoscale", NULL);
+	filter = gst_element_factory_make("capsfilter", NULL);
+	if (!scale || !filter) {
+		g_warning("Failed to create video scaler");
+		if (scale)
+			gst_object_unref(scale);
+		if (filter)
+			gst_object_unref(filter);
+		return NULL;
+	}
+
+	bin = gst_bin_new(NULL);
+	gst_bin_add_many(GST_BIN(bin), scale, filter, worker->vsink, NULL);
+	gst_element_link_many(scale, filter, worker->vsink, NULL);
+	pad = gst_element_get_static_pad(scale, "sink");
+	gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+	gst_object_unref(pad);
+
+	worker->vscale_filter = filter;
+	_update_video_scaling(worker);
+
+	return gst_object_ref(bin);
+}
+
+/*
+ * Runs in a streaming thread for every element playbin creates.  The
+ * result is published from the worker thread, through the bus.
+ */
+static void _element_setup_cb(GstElement *playbin, GstElement *element,
+			      MafwGstRendererWorker *worker)
+{
+	GstStructure *applied;
+
+	/* Both signals report most elements */
+	if (g_object_get_data(G_OBJECT(element), "mafw-decoder-policy"))
+		return;
+	g_object_set_data(G_OBJECT(element), "mafw-decoder-policy",
+			  GINT_TO_POINTER(TRUE));
+
+	mafw_gst_renderer_converter_audit_attach(element);
+	mafw_gst_renderer_decoder_ranking_watch(element);
+	mafw_gst_renderer_warmup_learn(element);
+	mafw_gst_renderer_autoplug_cache_watch(playbin, element);
+	mafw_gst_renderer_seek_index_watch(playbin, element);
+
+	if (mafw_gst_renderer_decoder_policy_apply(element, worker->is_stream,
+						   &applied)) {
+		gst_element_post_message(
+			playbin,
+			gst_message_new_application(GST_OBJECT(playbin),
+						    applied));
+	}
+}
+
+static void _deep_element_added_cb(GstBin *playbin, GstBin *bin,
+				   GstElement *element,
+				   MafwGstRendererWorker *worker)
+{
+	_element_setup_cb(GST_ELEMENT(playbin), element, worker);
+}
+
+/*
+ * Creates the video sink, if needed, and gives it to playbin.  Music is
+ * played without one, as it holds on to the display (and a GL context).
+ */
+static void _setup_video_sink(MafwGstRendererWorker *worker)
+{
+	if (!worker->vsink) {
+		if (_check_xv_supported()) {
+			g_debug("Using XV accelerated output");
+			worker->use_xv = TRUE;
+			worker->vsink = gst_element_factory_make(
+						"xvimagesink", NULL);
+		} else {
+			worker->use_xv = FALSE;
+			g_debug("Using GL accelerated output");
+			_check_gl_renderer();
+			worker->vsink = gst_element_factory_make(
+						"glimagesink", NULL);
+		}
+
+		if (!worker->vsink) {
+			g_critical("Failed to create pipeline video sink");
+			g_signal_emit_by_name(MAFW_EXTENSION (worker->owner), 
+					      "error",
+					      MAFW_RENDERER_ERROR,
+					      MAFW_RENDERER_ERROR_UNABLE_TO_PERFORM,
+					      "Could not create video sink");
+			g_assert_not_reached();
+		}
+
+		gst_object_ref(worker->vsink);
+		g_object_set(G_OBJECT(worker->vsink),
+			     "handle-events", FALSE,
+			     "force-aspect-ratio", TRUE,
+			     NULL);
+
+		/* GL uploads every pixel, so give it no more than the
+		 * window can show */
+		if (!worker->use_xv)
+			worker->vsink_bin = _create_scaling_bin(worker);
+	}
+
+	gst_video_overlay_set_window_handle(
+				GST_VIDEO_OVERLAY(worker->vsink), 0);
+	g_object_set(worker->pipeline,
+			"video-sink", worker->vsink_bin ?
+			worker->vsink_bin : worker->vsink,
+			NULL);
+}
+
+/*
+ * Runs in a streaming thread when playbin finds video streams.  Media
+ * taken for music turned out to have video, so it needs the full
+ * pipeline after all.
+ */
+static void _video_changed_cb(GstElement *playbin,
+			      MafwGstRendererWorker *worker)
+{
+	gint n_video = 0;
+
+	g_object_get(playbin, "n-video", &n_video, NULL);
+	if (n_video > 0 && worker->lean_audio) {
+		gst_element_post_message(
+			playbin,
+			gst_message_new_application(
+				GST_OBJECT(playbin),
+				gst_structure_new_empty("mafw-video-found")));
+	}
+}
+
+static void _leave_lean_audio(MafwGstRendererWorker *worker)
+{
+	if (!worker->lean_audio || worker->pipeline == NULL)
+		return;
+
+	g_debug("video found, setting up the video sink");
+	worker->lean_audio = FALSE;
+	_setup_video_sink(worker);
+	_update_video_decoding(worker);
+}
+
 /*
  * Constructs gst pipeline
  *
@@ -1801,6 +3891,8 @@ no_dpy:
  */
 static void _construct_pipeline(MafwGstRendererWorker *worker)
 {
+	GSource *source;
+
 	g_debug("constructing pipeline");
 	g_assert(worker != NULL);
 
@@ -1813,6 +3905,10 @@ static void _construct_pipeline(MafwGstRendererWorker *worker)
 	g_debug("Creating a new instance of playbin");
 	worker->pipeline = gst_element_factory_make("playbin",
 						    "playbin");
+	if (!worker->pipeline_built) {
+		startup_trace("first pipeline created");
+		worker->pipeline_built = TRUE;
+	}
 
 	if (!worker->pipeline) {
 		g_critical("failed to create playback pipeline");
@@ -1825,13 +3921,25 @@ static void _construct_pipeline(MafwGstRendererWorker *worker)
 	}
 
 
+	/* Decoders are configured as soon as they are plugged */
+	g_signal_connect(worker->pipeline, "element-setup",
+			 G_CALLBACK(_element_setup_cb), worker);
+	g_signal_connect(worker->pipeline, "deep-element-added",
+			 G_CALLBACK(_deep_element_added_cb), worker);
+	g_signal_connect(worker->pipeline, "video-changed",
+			 G_CALLBACK(_video_changed_cb), worker);
+
 	worker->bus = gst_pipeline_get_bus(GST_PIPELINE(worker->pipeline));
 	gst_bus_set_sync_handler(worker->bus,
 				 (GstBusSyncHandler)_sync_bus_handler, worker,
 				 NULL);
-	worker->async_bus_id = gst_bus_add_watch_full(worker->bus,G_PRIORITY_HIGH,
-						 (GstBusFunc)_async_bus_handler,
-						 worker, NULL);
+	/* Bus messages are handled in the worker thread */
+	source = gst_bus_create_watch(worker->bus);
+	g_source_set_priority(source, G_PRIORITY_HIGH);
+	g_source_set_callback(source, (GSourceFunc)_async_bus_handler,
+			      worker, NULL);
+	worker->async_bus_id = g_source_attach(source, worker->context);
+	g_source_unref(source);
 
 #ifndef MAFW_GST_RENDERER_DISABLE_PULSE_VOLUME
 	
@@ -1839,6 +3947,8 @@ static void _construct_pipeline(MafwGstRendererWorker *worker)
 	/* Set audio and video sinks ourselves. We create and configure
 	   them only once. */
 	if (!worker->asink) {
+		GstPad *pad;
+
 		worker->asink = gst_element_factory_make("pulsesink", NULL);
 		if (!worker->asink) {
 			g_critical("Failed to create pipeline audio sink");
@@ -1850,51 +3960,25 @@ static void _construct_pipeline(MafwGstRendererWorker *worker)
 			g_assert_not_reached();
 		}
 		gst_object_ref(worker->asink);
-		g_object_set(worker->asink,
-				"buffer-time", (gint64) MAFW_GST_BUFFER_TIME,
-				"latency-time", (gint64) MAFW_GST_LATENCY_TIME,
-				NULL);
+		g_object_set(worker->asink, "device", worker->output.device,
+			     NULL);
+		_set_output_profile(worker, worker->asink,
+				    OUTPUT_PROFILE_AUDIO);
+		pad = gst_element_get_static_pad(worker->asink, "sink");
+		worker->output.probe = gst_pad_add_probe(
+			pad, GST_PAD_PROBE_TYPE_BUFFER |
+			GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+			GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+			(GstPadProbeCallback) _asink_probe_cb, worker, NULL);
+		gst_object_unref(pad);
 	}
 	g_object_set(worker->pipeline, "audio-sink", worker->asink, NULL);
 #endif
 
-	if (!worker->vsink) {
-		if (_check_xv_supported()) {
-			g_debug("Using XV accelerated output");
-			worker->use_xv = TRUE;
-			worker->vsink = gst_element_factory_make(
-						"xvimagesink", NULL);
-		} else {
-			worker->use_xv = FALSE;
-			g_debug("Using GL accelerated output");
-			_check_gl_renderer();
-			worker->vsink = gst_element_factory_make(
-						"glimagesink", NULL);
-		}
-
-		if (!worker->vsink) {
-			g_critical("Failed to create pipeline video sink");
-			g_signal_emit_by_name(MAFW_EXTENSION (worker->owner), 
-					      "error",
-					      MAFW_RENDERER_ERROR,
-					      MAFW_RENDERER_ERROR_UNABLE_TO_PERFORM,
-					      "Could not create video sink");
-			g_assert_not_reached();
-		}
-
-		gst_object_ref(worker->vsink);
-		g_object_set(G_OBJECT(worker->vsink),
-			     "handle-events", FALSE,
-			     "force-aspect-ratio", TRUE,
-			     NULL);
-	}
-
-	gst_video_overlay_set_window_handle(
-				GST_VIDEO_OVERLAY(worker->vsink), 0);
-	g_object_set(worker->pipeline,
-			"video-sink", worker->vsink,
-			"flags", 0x43,
-			NULL);
+	/* Nothing to decode video for until the media is known */
+	worker->audio_only = TRUE;
+	g_object_set(worker->pipeline, "flags",
+		     MAFW_GST_PLAY_FLAGS & ~MAFW_GST_PLAY_FLAG_VIDEO, NULL);
 }
 
 /*
@@ -1919,7 +4003,7 @@ static void _do_seek(MafwGstRendererWorker *worker, GstSeekType seek_type,
 	absolute position seek instead if that's what you want to do. */
 	if (relative)
 	{
-		gint curpos = mafw_gst_renderer_worker_get_position(worker);
+		gint curpos = _get_position(worker);
 		position = curpos + position;
 	}
 
@@ -1940,139 +4024,546 @@ static void _do_seek(MafwGstRendererWorker *worker, GstSeekType seek_type,
 	   video playback */
         if (worker->in_ready && worker->state == GST_STATE_READY) {
                 gst_element_set_state(worker->pipeline, GST_STATE_PAUSED);
+		_seek_at_first_segment(worker, position);
+        } else if (worker->loop.enabled && spos >= worker->loop.start &&
+		   (worker->loop.stop < 0 || spos < worker->loop.stop)) {
+		/* Seeking inside the loop keeps looping */
+		ret = _loop_seek(worker, GST_SEEK_FLAG_FLUSH |
+				 GST_SEEK_FLAG_KEY_UNIT, spos);
+		worker->loop.armed = ret;
+		if (!ret)
+			goto err;
         } else {
+		GstSeekFlags flags;
+
+		/* Indexed media seek to the exact position quickly */
+		flags = mafw_gst_renderer_seek_index_adjust(worker->pipeline,
+							    &spos);
+		/* Keep the encoder delay and padding trimmed */
+		if (spos <= worker->gapless.start) {
+			spos = worker->gapless.start;
+			flags = GST_SEEK_FLAG_FLUSH|GST_SEEK_FLAG_ACCURATE;
+		}
                 ret = gst_element_seek(worker->pipeline, 1.0, GST_FORMAT_TIME,
-                                       GST_SEEK_FLAG_FLUSH|GST_SEEK_FLAG_KEY_UNIT,
-                                       seek_type, spos,
-                                       GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+                                       flags, seek_type, spos,
+				       worker->gapless.stop >= 0 ?
+				       GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+				       worker->gapless.stop >= 0 ?
+				       worker->gapless.stop :
+				       GST_CLOCK_TIME_NONE);
+		/* Looping starts over when playing again */
+		worker->loop.armed = FALSE;
                 if (!ret) {
                         /* Seeking is async, so seek_position should not be
                            invalidated here */
                         goto err;
                 }
 	}
-        return;
-
-err:    g_set_error(error,
-		    MAFW_RENDERER_ERROR,
-		    MAFW_RENDERER_ERROR_CANNOT_SET_POSITION,
-		    "Seeking to %d failed", position);
+        return;
+
+err:    g_set_error(error,
+		    MAFW_RENDERER_ERROR,
+		    MAFW_RENDERER_ERROR_CANNOT_SET_POSITION,
+		    "Seeking to %d failed", position);
+}
+
+/* @vol should be between [0 .. 100], higher values (up to 1000) are allowed,
+ * but probably cause distortion. */
+void mafw_gst_renderer_worker_set_volume(
+	MafwGstRendererWorker *worker, guint volume)
+{
+        _set_volume(worker, CLAMP((gdouble)volume / 100.0, 0.0, 1.0));
+}
+
+guint mafw_gst_renderer_worker_get_volume(
+	MafwGstRendererWorker *worker)
+{
+        return (guint)
+		(mafw_gst_renderer_worker_volume_get(worker->wvolume) * 100);
+}
+
+void mafw_gst_renderer_worker_set_mute(MafwGstRendererWorker *worker,
+                                     gboolean mute)
+{
+        _set_mute(worker, mute);
+}
+
+gboolean mafw_gst_renderer_worker_get_mute(MafwGstRendererWorker *worker)
+{
+	return mafw_gst_renderer_worker_volume_is_muted(worker->wvolume);
+}
+
+#ifdef HAVE_GDKPIXBUF
+void mafw_gst_renderer_worker_set_current_frame_on_pause(MafwGstRendererWorker *worker,
+								gboolean current_frame_on_pause)
+{
+        worker->current_frame_on_pause = current_frame_on_pause;
+}
+
+gboolean mafw_gst_renderer_worker_get_current_frame_on_pause(MafwGstRendererWorker *worker)
+{
+	return worker->current_frame_on_pause;
+}
+#endif
+
+static void _call_seek_handler(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->notify_seek_handler)
+		worker->notify_seek_handler(worker, worker->owner);
+}
+
+static void _set_position_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	SeekCommand *seek = data;
+	GError *error = NULL;
+
+        /* If player is paused and we have a timeout for going to ready
+	 * restart it. This is logical, since the user is seeking and
+	 * thus, the player is not idle anymore. Also this prevents that
+	 * when seeking streams we enter buffering and in the middle of
+	 * the buffering process we set the pipeline to ready (which stops
+	 * the buffering before it reaches 100%, making the client think
+	 * buffering is still going on).
+	 */
+        if (worker->ready_timeout) {
+                _remove_ready_timeout(worker);
+                _add_ready_timeout(worker);
+        }
+
+	_do_seek(worker, seek->seek_type, seek->relative, seek->position,
+		 &error);
+	if (error != NULL) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+	_invoke_owner(worker, _call_seek_handler, NULL, NULL);
+}
+
+/*
+ * Seeking is done in the worker thread.  @error is only set if the media
+ * cannot be seeked at all; the seek handler is notified either way.
+ */
+void mafw_gst_renderer_worker_set_position(MafwGstRendererWorker *worker,
+					  GstSeekType seek_type,
+					  gboolean relative,
+					  gint position, GError **error)
+{
+	SeekCommand *seek;
+	gboolean seekable;
+
+	g_mutex_lock(&worker->shared.lock);
+	seekable = !worker->shared.eos && worker->shared.seekable;
+	g_mutex_unlock(&worker->shared.lock);
+
+	if (!seekable) {
+		g_set_error(error,
+			    MAFW_RENDERER_ERROR,
+			    MAFW_RENDERER_ERROR_CANNOT_SET_POSITION,
+			    "Seeking to %d failed", position);
+		_call_seek_handler(worker, NULL);
+		return;
+	}
+
+	seek = g_new0(SeekCommand, 1);
+	seek->seek_type = seek_type;
+	seek->relative = relative;
+	seek->position = position;
+	_worker_command(worker, _set_position_cmd, seek, g_free);
+}
+
+/*
+ * Gets current position, rounded down into precision of one second.  If a seek
+ * is pending, returns the position we are going to seek.  Returns -1 on
+ * failure.
+ */
+gint mafw_gst_renderer_worker_get_position(MafwGstRendererWorker *worker)
+{
+	GstElement *pipeline = NULL;
+	gint64 time = 0;
+	gint position = -1;
+	g_assert(worker != NULL);
+
+	g_mutex_lock(&worker->shared.lock);
+	/* If seek is ongoing, return the position where we are seeking. */
+	if (worker->shared.seek_position != -1)
+		position = worker->shared.seek_position;
+	else if (worker->shared.pipeline != NULL)
+		pipeline = gst_object_ref(worker->shared.pipeline);
+	g_mutex_unlock(&worker->shared.lock);
+
+	/* Otherwise query position from pipeline. */
+	if (pipeline != NULL) {
+		if (gst_element_query_position(pipeline, GST_FORMAT_TIME,
+					       &time))
+			position = (gint)(NSECONDS_TO_SECONDS(time));
+		gst_object_unref(pipeline);
+	}
+
+	return position;
+}
+
+GHashTable *mafw_gst_renderer_worker_get_current_metadata(
+	MafwGstRendererWorker *worker)
+{
+	return worker->current_metadata;
+}
+
+static void _set_xid_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	XID old_xid = worker->xid;
+
+	worker->xid = (XID) GPOINTER_TO_SIZE(data);
+	_watch_window(worker, old_xid);
+
+	/* Check if we should use it right away */
+	mafw_gst_renderer_worker_apply_xid(worker);
+	_refresh_video_window(worker);
+	_update_video_decoding(worker);
+}
+
+void mafw_gst_renderer_worker_set_xid(MafwGstRendererWorker *worker, XID xid)
+{
+	/* Check for errors on the target window */
+	XSetErrorHandler(xerror);
+
+	/* Store the target window id */
+	g_debug("Setting xid: %x", (guint)xid);
+	worker->requested.xid = xid;
+	_worker_command(worker, _set_xid_cmd, GSIZE_TO_POINTER(xid), NULL);
+}
+
+/*
+ * Tells whether the video window is visible.  While it is not, only the
+ * audio is decoded.
+ */
+static void _set_video_visible_cmd(MafwGstRendererWorker *worker,
+				   gpointer data)
+{
+	worker->video_visible = GPOINTER_TO_INT(data);
+	_update_video_decoding(worker);
+}
+
+void mafw_gst_renderer_worker_set_video_visible(MafwGstRendererWorker *worker,
+						gboolean visible)
+{
+	worker->requested.video_visible = visible;
+	_worker_command(worker, _set_video_visible_cmd,
+			GINT_TO_POINTER(visible), NULL);
+}
+
+gboolean mafw_gst_renderer_worker_get_video_visible(
+	MafwGstRendererWorker *worker)
+{
+	return worker->requested.video_visible;
+}
+
+static void _set_loop_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	gint64 *loop = data;
+
+	worker->loop.enabled = loop[0];
+	worker->loop.start = loop[1];
+	worker->loop.stop = loop[2];
+	if (worker->loop.enabled)
+		_arm_loop(worker);
+	else
+		_disarm_loop(worker);
+}
+
+/*
+ * Loops the current media (and the next ones) between @start_ms and
+ * @end_ms, or the end of the media if @end_ms is 0, without any gap.
+ */
+void mafw_gst_renderer_worker_set_loop(MafwGstRendererWorker *worker,
+				       gboolean enabled, gint start_ms,
+				       gint end_ms)
+{
+	gint64 *loop;
+
+	worker->requested.loop_enabled = enabled;
+	worker->requested.loop_start = (gint64) MAX(start_ms, 0) * GST_MSECOND;
+	worker->requested.loop_stop = end_ms > start_ms ?
+		(gint64) end_ms * GST_MSECOND : -1;
+
+	loop = g_new(gint64, 3);
+	loop[0] = worker->requested.loop_enabled;
+	loop[1] = worker->requested.loop_start;
+	loop[2] = worker->requested.loop_stop;
+	_worker_command(worker, _set_loop_cmd, loop, g_free);
+}
+
+gboolean mafw_gst_renderer_worker_get_loop(MafwGstRendererWorker *worker,
+					   gint *start_ms, gint *end_ms)
+{
+	if (start_ms)
+		*start_ms = worker->requested.loop_start / GST_MSECOND;
+	if (end_ms)
+		*end_ms = worker->requested.loop_stop >= 0 ?
+			worker->requested.loop_stop / GST_MSECOND : 0;
+	return worker->requested.loop_enabled;
+}
+
+static void _set_display_on_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	worker->display_on = GPOINTER_TO_INT(data);
+	_update_output_profile(worker);
+}
+
+/*
+ * Tells whether the screen is on.  Audio is buffered longer while it is
+ * off.
+ */
+void mafw_gst_renderer_worker_set_display_on(MafwGstRendererWorker *worker,
+					     gboolean on)
+{
+	_worker_command(worker, _set_display_on_cmd, GINT_TO_POINTER(on),
+			NULL);
+}
+
+OutputProfile mafw_gst_renderer_worker_get_output_profile(
+	MafwGstRendererWorker *worker)
+{
+	OutputProfile profile;
+
+	g_mutex_lock(&worker->shared.lock);
+	profile = worker->shared.active;
+	g_mutex_unlock(&worker->shared.lock);
+
+	return profile;
+}
+
+/*
+ * Returns how long audio has been played with @profile, how often the
+ * streaming thread of the audio sink woke up meanwhile and how many
+ * times the audio sink ran dry.
+ */
+void mafw_gst_renderer_worker_get_output_stats(MafwGstRendererWorker *worker,
+					       OutputProfile profile,
+					       gint64 *playing_usecs,
+					       gdouble *wakeups_per_second,
+					       guint *underruns)
+{
+	gint64 usecs;
+	glong wakeups;
+
+	g_return_if_fail(profile < _LAST_OUTPUT_PROFILE);
+
+	g_mutex_lock(&worker->shared.lock);
+	usecs = worker->shared.stats[profile].usecs;
+	wakeups = worker->shared.stats[profile].wakeups;
+	if (worker->shared.since != 0 && profile == worker->shared.active) {
+		usecs += g_get_monotonic_time() - worker->shared.since;
+		wakeups += _count_wakeups(worker) -
+			worker->shared.wakeups_since;
+	}
+	g_mutex_unlock(&worker->shared.lock);
+
+	if (playing_usecs)
+		*playing_usecs = usecs;
+	if (wakeups_per_second)
+		*wakeups_per_second = usecs > 0 ?
+			wakeups * (gdouble) G_USEC_PER_SEC / usecs : 0.0;
+	if (underruns)
+		*underruns = g_atomic_int_get(
+			&worker->output.stats[profile].underruns);
 }
 
-/* @vol should be between [0 .. 100], higher values (up to 1000) are allowed,
- * but probably cause distortion. */
-void mafw_gst_renderer_worker_set_volume(
-	MafwGstRendererWorker *worker, guint volume)
+/*
+ * Returns how many times the audio sink ran dry, whatever the profile.
+ */
+guint mafw_gst_renderer_worker_get_audio_underruns(
+	MafwGstRendererWorker *worker)
 {
-        _set_volume(worker, CLAMP((gdouble)volume / 100.0, 0.0, 1.0));
+	guint underruns = 0;
+	gint i;
+
+	for (i = 0; i < _LAST_OUTPUT_PROFILE; i++) {
+		underruns += g_atomic_int_get(
+			&worker->output.stats[i].underruns);
+	}
+	return underruns;
 }
 
-guint mafw_gst_renderer_worker_get_volume(
+/*
+ * Returns the buffer time (in microseconds) the audio sink last opened
+ * its stream with, 0 if it has not yet.
+ */
+gint64 mafw_gst_renderer_worker_get_audio_buffer_time(
 	MafwGstRendererWorker *worker)
 {
-        return (guint)
-		(mafw_gst_renderer_worker_volume_get(worker->wvolume) * 100);
+	return worker->output.sink_buffer_time;
 }
 
-void mafw_gst_renderer_worker_set_mute(MafwGstRendererWorker *worker,
-                                     gboolean mute)
+static void _switch_audio_output_cmd(MafwGstRendererWorker *worker,
+				     gpointer data)
 {
-        _set_mute(worker, mute);
+	const gchar *device = data;
+
+	if (!g_strcmp0(device, worker->output.device))
+		return;
+	g_free(worker->output.device);
+	worker->output.device = g_strdup(device);
+
+	if (worker->asink != NULL && worker->state == GST_STATE_PLAYING) {
+		_remove_output_switch_timeout(worker);
+		worker->output.switch_start = g_get_monotonic_time();
+		worker->output.switch_gap = 0;
+		g_atomic_int_set(&worker->output.switching, TRUE);
+		worker->output.switch_timeout = _worker_timeout_add_seconds(
+			worker, MAFW_GST_RENDERER_WORKER_OUTPUT_SECONDS_SWITCH,
+			_output_switch_timeout_cb);
+	}
+	if (worker->asink != NULL)
+		g_object_set(worker->asink, "device", device, NULL);
 }
 
-gboolean mafw_gst_renderer_worker_get_mute(MafwGstRendererWorker *worker)
+/*
+ * Sends the audio to the pulse sink @device, NULL for the default one.
+ * While playing, the stream is moved as it plays: no flush, no restart
+ * of the pipeline.
+ */
+void mafw_gst_renderer_worker_set_audio_output(MafwGstRendererWorker *worker,
+					       const gchar *device)
 {
-	return mafw_gst_renderer_worker_volume_is_muted(worker->wvolume);
+	if (device != NULL && *device == '\0')
+		device = NULL;
+	if (!g_strcmp0(device, worker->requested.device))
+		return;
+	g_free(worker->requested.device);
+	worker->requested.device = g_strdup(device);
+	g_debug("audio output: %s", device ? device : "default");
+
+	_worker_command(worker, _switch_audio_output_cmd, g_strdup(device),
+			g_free);
 }
 
-#ifdef HAVE_GDKPIXBUF
-void mafw_gst_renderer_worker_set_current_frame_on_pause(MafwGstRendererWorker *worker,
-								gboolean current_frame_on_pause)
+const gchar *mafw_gst_renderer_worker_get_audio_output(
+	MafwGstRendererWorker *worker)
 {
-        worker->current_frame_on_pause = current_frame_on_pause;
+	return worker->requested.device;
 }
 
-gboolean mafw_gst_renderer_worker_get_current_frame_on_pause(MafwGstRendererWorker *worker)
+/*
+ * Returns how long the last switch of audio output took, -1 if it failed,
+ * and how much audio was lost meanwhile.
+ */
+void mafw_gst_renderer_worker_get_audio_output_switch(
+	MafwGstRendererWorker *worker, gint64 *latency_usecs,
+	gint64 *dropped_usecs)
 {
-	return worker->current_frame_on_pause;
+	g_mutex_lock(&worker->shared.lock);
+	if (latency_usecs)
+		*latency_usecs = worker->shared.switch_latency;
+	if (dropped_usecs)
+		*dropped_usecs = worker->shared.switch_dropped;
+	g_mutex_unlock(&worker->shared.lock);
 }
-#endif
 
-void mafw_gst_renderer_worker_set_position(MafwGstRendererWorker *worker,
-					  GstSeekType seek_type,
-					  gboolean relative,
-					  gint position, GError **error)
+void mafw_gst_renderer_worker_get_streams(MafwGstRendererWorker *worker,
+					  gint *audio, gint *text)
 {
-        /* If player is paused and we have a timeout for going to ready
-	 * restart it. This is logical, since the user is seeking and
-	 * thus, the player is not idle anymore. Also this prevents that
-	 * when seeking streams we enter buffering and in the middle of
-	 * the buffering process we set the pipeline to ready (which stops
-	 * the buffering before it reaches 100%, making the client think
-	 * buffering is still going on).
-	 */
-        if (worker->ready_timeout) {
-                _remove_ready_timeout(worker);
-                _add_ready_timeout(worker);
-        }
+	GstElement *pipeline = NULL;
+	gint current_audio = -1, current_text = -1;
+
+	g_mutex_lock(&worker->shared.lock);
+	if (worker->shared.pipeline != NULL && worker->shared.has_media)
+		pipeline = gst_object_ref(worker->shared.pipeline);
+	g_mutex_unlock(&worker->shared.lock);
+
+	if (pipeline != NULL) {
+		g_object_get(pipeline, "current-audio", &current_audio,
+			     "current-text", &current_text, NULL);
+		gst_object_unref(pipeline);
+	}
+
+	if (audio)
+		*audio = current_audio;
+	if (text)
+		*text = current_text;
+}
 
-	_do_seek(worker, seek_type, relative, position, error);
-        if (worker->notify_seek_handler)
-                worker->notify_seek_handler(worker, worker->owner);
+static void _set_stay_paused_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	worker->stay_paused = GPOINTER_TO_INT(data);
 }
 
 /*
- * Gets current position, rounded down into precision of one second.  If a seek
- * is pending, returns the position we are going to seek.  Returns -1 on
- * failure.
+ * Has the media being played stay paused once prerolled, or not.  The
+ * worker resets it on stop.
  */
-gint mafw_gst_renderer_worker_get_position(MafwGstRendererWorker *worker)
+void mafw_gst_renderer_worker_set_stay_paused(MafwGstRendererWorker *worker,
+					      gboolean stay_paused)
 {
-	gint64 time = 0;
-	g_assert(worker != NULL);
-
-	/* If seek is ongoing, return the position where we are seeking. */
-	if (worker->seek_position != -1)
-	{
-		return worker->seek_position;
-	}
-	/* Otherwise query position from pipeline. */
-	if (worker->pipeline &&
-	    gst_element_query_position(worker->pipeline, GST_FORMAT_TIME,
-				       &time))
-	{
-		return (gint)(NSECONDS_TO_SECONDS(time));
-	}
-	return -1;
+	worker->stay_paused_requested = stay_paused;
+	_worker_command(worker, _set_stay_paused_cmd,
+			GINT_TO_POINTER(stay_paused), NULL);
 }
 
-GHashTable *mafw_gst_renderer_worker_get_current_metadata(
+/*
+ * Returns what was last given to mafw_gst_renderer_worker_set_stay_paused()
+ * since the last stop or play.
+ */
+gboolean mafw_gst_renderer_worker_get_stay_paused(
 	MafwGstRendererWorker *worker)
 {
-	return worker->current_metadata;
+	return worker->stay_paused_requested;
 }
 
-void mafw_gst_renderer_worker_set_xid(MafwGstRendererWorker *worker, XID xid)
+static void _set_source_info_cmd(MafwGstRendererWorker *worker,
+				 gpointer data)
 {
-	/* Check for errors on the target window */
-	XSetErrorHandler(xerror);
+	gint *info = data;
 
-	/* Store the target window id */
-	g_debug("Setting xid: %x", (guint)xid);
-	worker->xid = xid;
+	worker->source.duration = info[0];
+	worker->source.seekability = info[1];
+}
 
-	/* Check if we should use it right away */
-	mafw_gst_renderer_worker_apply_xid(worker);
+/*
+ * Tells the @duration (in seconds, -1 if unknown) and @seekability the
+ * source gave for the media about to be played.  The worker updates the
+ * duration of the source if it finds out otherwise.
+ */
+void mafw_gst_renderer_worker_set_source_info(MafwGstRendererWorker *worker,
+					      gint duration,
+					      SeekabilityType seekability)
+{
+	gint *info;
+
+	info = g_new(gint, 2);
+	info[0] = duration;
+	info[1] = seekability;
+	_worker_command(worker, _set_source_info_cmd, info, g_free);
 }
 
 XID mafw_gst_renderer_worker_get_xid(MafwGstRendererWorker *worker)
 {
-	return worker->xid;
+	return worker->requested.xid;
 }
 
 gboolean mafw_gst_renderer_worker_get_seekable(MafwGstRendererWorker *worker)
 {
-	return worker->media.seekable;
+	SeekabilityType seekable;
+
+	g_mutex_lock(&worker->shared.lock);
+	seekable = worker->shared.seekable;
+	g_mutex_unlock(&worker->shared.lock);
+
+	return seekable;
+}
+
+/*
+ * Whether the media is a stream with no length that cannot seek: endless
+ * radio.
+ */
+gboolean mafw_gst_renderer_worker_is_endless(MafwGstRendererWorker *worker)
+{
+	gboolean endless;
+
+	g_mutex_lock(&worker->shared.lock);
+	endless = worker->shared.endless;
+	g_mutex_unlock(&worker->shared.lock);
+
+	return endless;
 }
 
 static void _play_pl_next(MafwGstRendererWorker *worker) {
@@ -2083,7 +4574,7 @@ static void _play_pl_next(MafwGstRendererWorker *worker) {
 
 	next = (gchar *) g_slist_nth_data(worker->pl.items,
 					  ++worker->pl.current);
-	mafw_gst_renderer_worker_stop(worker);
+	_stop(worker);
 	_reset_media_info(worker);
 
 	worker->media.location = g_strdup(next);
@@ -2110,6 +4601,11 @@ static void _do_play(MafwGstRendererWorker *worker)
 			gst_element_set_state(worker->pipeline,
 					      GST_STATE_PAUSED);
 			g_debug("setting pipeline to PAUSED");
+			/* Resume the position we left while prerolling */
+			if (worker->in_ready && worker->seek_position > 0) {
+				_seek_at_first_segment(worker,
+						       worker->seek_position);
+			}
 		} else {
 			_reset_volume_and_mute_to_pipeline(worker);
 			gst_element_set_state(worker->pipeline,
@@ -2123,14 +4619,21 @@ static void _do_play(MafwGstRendererWorker *worker)
 	}
 }
 
-void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker,
-				  const gchar *uri, GSList *plitems)
+static void _play_at(MafwGstRendererWorker *worker, const gchar *uri,
+		     GSList *plitems, gint position,
+		     const PausedPlay *paused)
 {
-	g_assert(uri || plitems);
-
-	mafw_gst_renderer_worker_stop(worker);
+	_stop(worker);
 	_reset_media_info(worker);
 	_reset_pl_info(worker);
+	worker->start_position = MAX(position, 0);
+	/* After _stop() reset them, before anything prerolls */
+	if (paused != NULL) {
+		worker->stay_paused = TRUE;
+		worker->streams.audio = paused->audio;
+		worker->streams.text = paused->text;
+		worker->release_paused = paused->release;
+	}
 	/* Check if the item to play is a single item or a playlist. */
 	if (plitems || uri_is_playlist(uri)){
 		gchar *item;
@@ -2142,7 +4645,7 @@ void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker,
 		}
 		else
 		{
-			worker->pl.items = _parse_playlist(uri);
+			worker->pl.items = _parse_playlist(worker, uri);
 		}
 		if (!worker->pl.items)
 		{
@@ -2173,15 +4676,12 @@ void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker,
 	_start_play(worker);
 }
 
-void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker,
-                                                gchar **uris)
+static void _play_alternatives(MafwGstRendererWorker *worker, gchar **uris)
 {
         gint i;
         gchar *item;
 
-        g_assert(uris && uris[0]);
-
-        mafw_gst_renderer_worker_stop(worker);
+        _stop(worker);
         _reset_media_info(worker);
         _reset_pl_info(worker);
 
@@ -2207,46 +4707,250 @@ void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker,
         _start_play(worker);
 }
 
+static void _play_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	PlayCommand *play = data;
+
+	g_atomic_int_set(&worker->media_generation, play->generation);
+	if (play->uris != NULL) {
+		_play_alternatives(worker, play->uris);
+	} else {
+		_play_at(worker, play->uri, play->plitems, play->position,
+			 play->paused);
+		/* The worker owns the playlist now */
+		play->plitems = NULL;
+	}
+}
+
+static void _play_command_free(gpointer data)
+{
+	PlayCommand *play = data;
+
+	g_free(play->uri);
+	g_strfreev(play->uris);
+	g_slist_free_full(play->plitems, g_free);
+	g_free(play->paused);
+	g_free(play);
+}
+
+/*
+ * Queues @play, after stopping whatever is playing: notifications about it
+ * that have not been delivered yet are dropped.
+ */
+static void _queue_play(MafwGstRendererWorker *worker, PlayCommand *play)
+{
+	play->generation = ++worker->generation;
+	worker->stay_paused_requested = FALSE;
+	_worker_command(worker, _play_cmd, play, _play_command_free);
+}
+
+void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker,
+				  const gchar *uri, GSList *plitems)
+{
+	mafw_gst_renderer_worker_play_at(worker, uri, plitems, 0);
+}
+
+/*
+ * Like mafw_gst_renderer_worker_play(), but starts at @position seconds.
+ * The position is reached while prerolling, so playback does not have to
+ * preroll at the beginning first and then again after a seek.  For
+ * playlists it applies to the first item only.
+ */
+void mafw_gst_renderer_worker_play_at(MafwGstRendererWorker *worker,
+				      const gchar *uri, GSList *plitems,
+				      gint position)
+{
+	PlayCommand *play;
+
+	g_assert(uri || plitems);
+
+	play = g_new0(PlayCommand, 1);
+	play->uri = g_strdup(uri);
+	play->plitems = plitems;
+	play->position = position;
+	_queue_play(worker, play);
+}
+
+/*
+ * Like mafw_gst_renderer_worker_play_at(), but the media stays paused
+ * once prerolled, with the @audio and @text streams selected (-1 leaves
+ * the choice to playbin).  With @release, it goes to READY right after.
+ * All of it is set up before the media starts to preroll.
+ */
+void mafw_gst_renderer_worker_preroll_at(MafwGstRendererWorker *worker,
+					 const gchar *uri, gint position,
+					 gint audio, gint text,
+					 gboolean release)
+{
+	PlayCommand *play;
+
+	g_assert(uri);
+
+	play = g_new0(PlayCommand, 1);
+	play->uri = g_strdup(uri);
+	play->position = position;
+	play->paused = g_new0(PausedPlay, 1);
+	play->paused->audio = audio;
+	play->paused->text = text;
+	play->paused->release = release;
+	_queue_play(worker, play);
+	worker->stay_paused_requested = TRUE;
+}
+
+void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker,
+                                                gchar **uris)
+{
+	PlayCommand *play;
+
+        g_assert(uris && uris[0]);
+
+	play = g_new0(PlayCommand, 1);
+	play->uris = g_strdupv(uris);
+	_queue_play(worker, play);
+}
+
+/*
+ * Runs in the reaper thread: brings an old pipeline down, which joins its
+ * streaming threads and frees the decoders.
+ */
+static void _reap_pipeline(gpointer data, gpointer user_data)
+{
+	GstElement *pipeline = data;
+	MafwGstRendererWorker *worker = user_data;
+	gint64 elapsed;
+
+	elapsed = g_get_monotonic_time();
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(GST_OBJECT(pipeline));
+	elapsed = g_get_monotonic_time() - elapsed;
+
+	G_LOCK(teardown);
+	worker->teardown.count++;
+	worker->teardown.total_usecs += elapsed;
+	if (elapsed > worker->teardown.max_usecs)
+		worker->teardown.max_usecs = elapsed;
+	G_UNLOCK(teardown);
+	g_atomic_int_add(&worker->teardown.pending, -1);
+
+	g_debug("pipeline destroyed in %" G_GINT64_FORMAT " us", elapsed);
+}
+
+/*
+ * Takes @sink out of the playbin it is in, so that it outlives it.  It
+ * is brought down first, as its streaming thread may still be pushing.
+ */
+static void _detach_sink(GstElement *sink)
+{
+	GstObject *parent;
+
+	gst_element_set_locked_state(sink, TRUE);
+	gst_element_set_state(sink, GST_STATE_NULL);
+	parent = gst_object_get_parent(GST_OBJECT(sink));
+	if (parent != NULL) {
+		gst_bin_remove(GST_BIN(parent), sink);
+		gst_object_unref(parent);
+	}
+	gst_element_set_locked_state(sink, FALSE);
+}
+
+/*
+ * Hands the pipeline over to the reaper thread, so stopping does not wait
+ * for it.  The sinks are taken out of it first and kept for the next
+ * pipeline, and nothing it still runs calls back into the worker.
+ */
+static void _destroy_pipeline(MafwGstRendererWorker *worker)
+{
+	g_signal_handlers_disconnect_by_data(worker->pipeline, worker);
+	g_object_set(worker->pipeline, "audio-sink", NULL,
+		     "video-sink", NULL, NULL);
+	if (worker->asink)
+		_detach_sink(worker->asink);
+	if (worker->vsink_bin)
+		_detach_sink(worker->vsink_bin);
+	else if (worker->vsink)
+		_detach_sink(worker->vsink);
+
+	if (worker->teardown.reaper == NULL) {
+		gst_element_set_state(worker->pipeline, GST_STATE_NULL);
+		gst_object_unref(GST_OBJECT(worker->pipeline));
+		worker->pipeline = NULL;
+		return;
+	}
+
+	g_atomic_int_inc(&worker->teardown.pending);
+	g_thread_pool_push(worker->teardown.reaper, worker->pipeline, NULL);
+	worker->pipeline = NULL;
+}
+
+/*
+ * Stops handling the messages of the pipeline and destroys it.
+ */
+static void _release_pipeline(MafwGstRendererWorker *worker)
+{
+	if (worker->async_bus_id) {
+		_worker_source_remove(worker, worker->async_bus_id);
+		worker->async_bus_id = 0;
+	}
+	gst_bus_set_sync_handler(worker->bus, NULL, NULL, NULL);
+	if (worker->bus) {
+		gst_object_unref(GST_OBJECT_CAST(worker->bus));
+		worker->bus = NULL;
+	}
+	_destroy_pipeline(worker);
+}
+
 /*
  * Currently, stop destroys the Gst pipeline and resets the worker into
  * default startup configuration.
  */
-void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker)
+static void _stop(MafwGstRendererWorker *worker)
 {
 	g_debug("worker stop");
-	g_assert(worker != NULL);
 
 	/* If location is NULL, this is a pre-created pipeline */
-	if (worker->async_bus_id && worker->pipeline && !worker->media.location)
+	if (worker->async_bus_id && worker->pipeline &&
+	    !worker->media.location) {
 		return;
+	}
 
 	if (worker->pipeline) {
 		g_debug("destroying pipeline");
-		if (worker->async_bus_id) {
-			g_source_remove(worker->async_bus_id);
-			worker->async_bus_id = 0;
-		}
-		gst_bus_set_sync_handler(worker->bus, NULL, NULL, NULL);
-		gst_element_set_state(worker->pipeline, GST_STATE_NULL);
-		if (worker->bus) {
-			gst_object_unref(GST_OBJECT_CAST(worker->bus));
-			worker->bus = NULL;
-		}
-		gst_object_unref(GST_OBJECT(worker->pipeline));
-		worker->pipeline = NULL;
+		_release_pipeline(worker);
 	}
 
 	/* Reset worker */
 	worker->report_statechanges = TRUE;
 	worker->state = GST_STATE_NULL;
+	g_atomic_int_set(&worker->output.playing, FALSE);
 	worker->prerolling = FALSE;
 	worker->is_live = FALSE;
+	worker->lean_audio = FALSE;
 	worker->buffering = FALSE;
 	worker->is_stream = FALSE;
 	worker->is_error = FALSE;
 	worker->eos = FALSE;
 	worker->seek_position = -1;
+	worker->start_position = 0;
+	worker->preroll_seek_done = FALSE;
+	g_atomic_int_set(&worker->start_seek.state, START_SEEK_NONE);
 	worker->stay_paused = FALSE;
+	worker->loop.armed = FALSE;
+	g_atomic_int_set(&worker->output.switching, FALSE);
+	_remove_output_switch_timeout(worker);
+	_gapless_cancel(worker);
+	worker->gapless.start = 0;
+	worker->gapless.stop = -1;
+	worker->first_audio.requested = 0;
+	g_atomic_int_set(&worker->first_audio.pending, FALSE);
+	worker->streams.audio = -1;
+	worker->streams.text = -1;
+	worker->release_paused = FALSE;
+	if (worker->reconnect.timeout != 0) {
+		_worker_source_remove(worker, worker->reconnect.timeout);
+		worker->reconnect.timeout = 0;
+	}
+	worker->reconnect.attempts = 0;
+	worker->reconnect.since = 0;
 	_remove_ready_timeout(worker);
 	_free_taglist(worker);
 	if (worker->current_metadata) {
@@ -2255,52 +4959,135 @@ void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker)
 	}
 
 	if (worker->duration_seek_timeout != 0) {
-		g_source_remove(worker->duration_seek_timeout);
+		_worker_source_remove(worker, worker->duration_seek_timeout);
 		worker->duration_seek_timeout = 0;
 	}
+	_remove_converter_audit_timeout(worker);
+	_output_stats_stop(worker);
+	_qos_reset(worker);
 
 	/* Reset media iformation */
 	_reset_media_info(worker);
 
 	/* We are not playing, so we can let the screen blank */
-	blanking_allow();
-	keypadlocking_allow();
+	_invoke_owner(worker, _allow_blanking_cb, NULL, NULL);
 
-	/* And now get a fresh pipeline ready */
-	_construct_pipeline(worker);
+	/* And now get a fresh pipeline ready, unless nothing was played
+	 * yet or the worker is going away */
+	if (worker->pipeline_built && !worker->exiting)
+		_construct_pipeline(worker);
 }
 
-void mafw_gst_renderer_worker_pause(MafwGstRendererWorker *worker)
+static void _stop_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	g_atomic_int_set(&worker->media_generation, GPOINTER_TO_UINT(data));
+	_stop(worker);
+}
+
+/*
+ * Stops for good before the worker goes away: no pipeline is built
+ * again, the one ready for the next media is handed to the reaper as
+ * well, and the sinks kept across pipelines are released.
+ */
+static void _exit_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	GstPad *pad;
+
+	g_atomic_int_set(&worker->media_generation, GPOINTER_TO_UINT(data));
+	worker->exiting = TRUE;
+	_stop(worker);
+	if (worker->pipeline != NULL)
+		_release_pipeline(worker);
+
+	if (worker->asink != NULL) {
+		pad = gst_element_get_static_pad(worker->asink, "sink");
+		gst_pad_remove_probe(pad, worker->output.probe);
+		gst_object_unref(pad);
+		gst_object_unref(worker->asink);
+		worker->asink = NULL;
+	}
+	if (worker->vsink_bin != NULL) {
+		gst_object_unref(worker->vsink_bin);
+		worker->vsink_bin = NULL;
+		worker->vscale_filter = NULL;
+	}
+	if (worker->vsink != NULL) {
+		gst_object_unref(worker->vsink);
+		worker->vsink = NULL;
+	}
+}
+
+/*
+ * Stops in the worker thread.  Notifications about what was playing that
+ * have not been delivered yet are dropped.
+ */
+void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker)
 {
 	g_assert(worker != NULL);
 
+	worker->stay_paused_requested = FALSE;
+	_worker_command(worker, _stop_cmd,
+			GUINT_TO_POINTER(++worker->generation), NULL);
+}
+
+/*
+ * Statistics about the pipelines destroyed in the background: how many are
+ * still pending, how many have been destroyed, and how long that took on
+ * average and at most.  Any of the out parameters may be NULL.
+ */
+void mafw_gst_renderer_worker_get_teardown_stats(MafwGstRendererWorker *worker,
+						 guint *pending, guint *count,
+						 gint64 *avg_usecs,
+						 gint64 *max_usecs)
+{
+	g_assert(worker != NULL);
+
+	G_LOCK(teardown);
+	if (pending)
+		*pending = g_atomic_int_get(&worker->teardown.pending);
+	if (count)
+		*count = worker->teardown.count;
+	if (avg_usecs)
+		*avg_usecs = worker->teardown.count ?
+			worker->teardown.total_usecs / worker->teardown.count :
+			0;
+	if (max_usecs)
+		*max_usecs = worker->teardown.max_usecs;
+	G_UNLOCK(teardown);
+}
+
+static void _pause_cmd(MafwGstRendererWorker *worker, gpointer data)
+{
+	if (worker->pipeline == NULL)
+		return;
+
 	if (worker->buffering && worker->state == GST_STATE_PAUSED &&
 	    !worker->prerolling) {
 		/* If we are buffering and get a pause, we have to
 		 * signal state change and stay_paused */
 		g_debug("Pausing while buffering, signalling state change");
 		worker->stay_paused = TRUE;
-		if (worker->notify_pause_handler) {
-			worker->notify_pause_handler(
-				worker,
-				worker->owner);
-		}
+		_notify_pause(worker);
 	} else {
 		worker->report_statechanges = TRUE;
 
 		if (gst_element_set_state(worker->pipeline, GST_STATE_PAUSED) ==
 		    GST_STATE_CHANGE_ASYNC)
 		{
-			/* XXX this blocks at most 2 seconds. */
-			gst_element_get_state(worker->pipeline, NULL, NULL,
-				      2 * GST_SECOND);
+			_wait_for_state_change(worker);
 		}
-		blanking_allow();
-		keypadlocking_allow();
+		_invoke_owner(worker, _allow_blanking_cb, NULL, NULL);
 	}
 }
 
-void mafw_gst_renderer_worker_resume(MafwGstRendererWorker *worker)
+void mafw_gst_renderer_worker_pause(MafwGstRendererWorker *worker)
+{
+	g_assert(worker != NULL);
+
+	_worker_command(worker, _pause_cmd, NULL, NULL);
+}
+
+static void _resume_cmd(MafwGstRendererWorker *worker, gpointer data)
 {
 	if (worker->mode == WORKER_MODE_PLAYLIST ||
             worker->mode == WORKER_MODE_REDUNDANT) {
@@ -2337,6 +5124,11 @@ void mafw_gst_renderer_worker_resume(MafwGstRendererWorker *worker)
 	}
 }
 
+void mafw_gst_renderer_worker_resume(MafwGstRendererWorker *worker)
+{
+	_worker_command(worker, _resume_cmd, NULL, NULL);
+}
+
 static void _volume_init_cb(MafwGstRendererWorkerVolume *wvolume,
 			    gpointer data)
 {
@@ -2362,7 +5154,6 @@ static void _volume_init_cb(MafwGstRendererWorkerVolume *wvolume,
 MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 {
         MafwGstRendererWorker *worker;
-	GMainContext *main_context;
 
 	worker = g_new0(MafwGstRendererWorker, 1);
 	worker->mode = WORKER_MODE_SINGLE_PLAY;
@@ -2373,9 +5164,17 @@ MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 	worker->report_statechanges = TRUE;
 	worker->state = GST_STATE_NULL;
 	worker->seek_position = -1;
+	worker->gapless.stop = -1;
+	worker->streams.audio = -1;
+	worker->streams.text = -1;
+	worker->source.duration = -1;
+	worker->source.seekability = SEEKABILITY_UNKNOWN;
 	worker->ready_timeout = 0;
 	worker->in_ready = FALSE;
 	worker->xid = 0;
+	worker->video_visible = TRUE;
+	worker->audio_only = FALSE;
+	worker->display_on = TRUE;
 	worker->vsink = NULL;
 	worker->asink = NULL;
 	worker->tag_list = NULL;
@@ -2383,6 +5182,7 @@ MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 
 #ifdef HAVE_GDKPIXBUF
 	worker->current_frame_on_pause = FALSE;
+	worker->frame_conv = NULL;
 	_init_tmp_files_pool(worker);
 #endif
 	worker->notify_seek_handler = NULL;
@@ -2391,10 +5191,36 @@ MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 	worker->notify_buffer_status_handler = NULL;
 	worker->notify_eos_handler = NULL;
 	worker->notify_error_handler = NULL;
-	Global_worker = worker;
-	main_context = g_main_context_default();
+	worker->pl_parser = NULL;
+	worker->prohibits_blanking = FALSE;
+	worker->prohibits_keypadlocking = FALSE;
+	G_LOCK(workers);
+	workers = g_slist_prepend(workers, worker);
+	G_UNLOCK(workers);
+
+	/* Bus handling runs in a thread of its own, so bursts of messages
+	 * and pipeline state changes do not hold up the owner's context */
+	g_rec_mutex_init(&worker->lock);
+	g_mutex_init(&worker->shared.lock);
+	worker->shared.seek_position = -1;
+	worker->requested.video_visible = TRUE;
+	worker->requested.loop_stop = -1;
+	worker->commands = g_async_queue_new();
+	worker->generation = 0;
+	worker->media_generation = 0;
+	worker->owner_calls = NULL;
+	worker->owner_context = g_main_context_ref_thread_default();
+	worker->owner_thread = g_thread_self();
+	worker->context = g_main_context_new();
+	worker->loop = g_main_loop_new(worker->context, FALSE);
+	worker->thread = g_thread_new("mafw-gst-renderer-worker",
+				      _worker_thread, worker);
+	/* Old pipelines are destroyed in the background */
+	worker->teardown.reaper = g_thread_pool_new(_reap_pipeline, worker,
+						    1, FALSE, NULL);
+
 	worker->wvolume = NULL;
-	mafw_gst_renderer_worker_volume_init(main_context,
+	mafw_gst_renderer_worker_volume_init(worker->owner_context,
 					     _volume_init_cb, worker,
 					     _volume_cb, worker,
 #ifdef MAFW_GST_RENDERER_ENABLE_MUTE
@@ -2403,19 +5229,87 @@ MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 					     NULL,
 #endif
 					     worker);
-	blanking_init();
-	_construct_pipeline(worker);
+	mafw_gst_renderer_decoder_ranking_init();
+	/* The pipeline is built on the first play.  Load the plugins it
+	 * will most likely need meanwhile. */
+	mafw_gst_renderer_warmup_start();
 
 	return worker;
 }
 
 void mafw_gst_renderer_worker_exit(MafwGstRendererWorker *worker)
 {
-	blanking_deinit();
+	GSList *item;
+
+	G_LOCK(workers);
+	workers = g_slist_remove(workers, worker);
+	G_UNLOCK(workers);
+
 #ifdef HAVE_GDKPIXBUF
 	_destroy_tmp_files_pool(worker);
+	bvw_frame_conv_free(worker->frame_conv);
+	worker->frame_conv = NULL;
 #endif
 	mafw_gst_renderer_worker_volume_destroy(worker->wvolume);
-        mafw_gst_renderer_worker_stop(worker);
+	worker->stay_paused_requested = FALSE;
+	_worker_command(worker, _exit_cmd,
+			GUINT_TO_POINTER(++worker->generation), NULL);
+
+	/* Quit from inside the loop once the stop is done, it might not be
+	 * running yet */
+	_worker_command(worker, _worker_thread_quit, NULL, NULL);
+	g_thread_join(worker->thread);
+	worker->thread = NULL;
+	g_async_queue_unref(worker->commands);
+	worker->commands = NULL;
+
+	/* Nothing queued for the owner gets delivered any more, so release
+	 * our share of blanking and keypad locking here */
+	G_LOCK(owner_calls);
+	for (item = worker->owner_calls; item != NULL; item = item->next)
+		g_source_destroy(item->data);
+	g_slist_free(worker->owner_calls);
+	worker->owner_calls = NULL;
+	G_UNLOCK(owner_calls);
+	_allow_blanking_cb(worker, NULL);
+	if (worker->blanking_initialized) {
+		blanking_deinit();
+		worker->blanking_initialized = FALSE;
+	}
+	if (worker->pl_parser != NULL) {
+		g_object_unref(worker->pl_parser);
+		worker->pl_parser = NULL;
+	}
+
+	/* Wait for the pipelines still being destroyed */
+	if (worker->teardown.reaper != NULL) {
+		g_thread_pool_free(worker->teardown.reaper, FALSE, TRUE);
+		worker->teardown.reaper = NULL;
+	}
+
+	if (worker->window.watch != NULL) {
+		g_source_destroy(worker->window.watch);
+		g_source_unref(worker->window.watch);
+		worker->window.watch = NULL;
+	}
+	if (worker->window.display != NULL) {
+		XCloseDisplay(worker->window.display);
+		worker->window.display = NULL;
+	}
+	g_free(worker->output.device);
+	worker->output.device = NULL;
+	g_free(worker->requested.device);
+	worker->requested.device = NULL;
+	if (worker->shared.pipeline != NULL) {
+		gst_object_unref(worker->shared.pipeline);
+		worker->shared.pipeline = NULL;
+	}
+
+	g_main_loop_unref(worker->loop);
+	g_main_context_unref(worker->context);
+
+	g_main_context_unref(worker->owner_context);
+	g_mutex_clear(&worker->shared.lock);
+	g_rec_mutex_clear(&worker->lock);
 }
 /* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
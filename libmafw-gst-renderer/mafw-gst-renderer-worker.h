@@ -27,7 +27,12 @@
 #include <X11/Xdefs.h>
 #include <glib-object.h>
 #include <gst/gst.h>
+#include <totem-pl-parser.h>
 #include "mafw-gst-renderer-worker-volume.h"
+#include "mafw-gst-renderer-gapless.h"
+#ifdef HAVE_GDKPIXBUF
+#include "gstscreenshot.h"
+#endif
 
 #define MAFW_GST_RENDERER_MAX_TMP_FILES 5
 
@@ -48,6 +53,15 @@ typedef enum {
         WORKER_MODE_REDUNDANT,
 } PlaybackMode;
 
+/* Audio output profiles, see output_profiles in the worker */
+typedef enum {
+	OUTPUT_PROFILE_AUDIO,
+	OUTPUT_PROFILE_VIDEO,
+	OUTPUT_PROFILE_POWER_SAVE,
+	OUTPUT_PROFILE_LIVE,
+	_LAST_OUTPUT_PROFILE
+} OutputProfile;
+
 typedef enum {
 	SEEKABILITY_UNKNOWN = -1,
 	SEEKABILITY_NO_SEEKABLE,
@@ -58,7 +72,8 @@ typedef enum {
  * media:        Information about currently selected media.
  *   location:           Current media location
  *   length_nanos:       Length of the media, in nanoseconds
- *   has_visual_content: the clip contains some visual content (video)
+ *   has_visual_content: the clip contains some visual content (video),
+ *                       set from a streaming thread, read atomically
  *   video_width:        If media contains video, this tells the video width
  *   video_height:       If media contains video, this tells the video height
  *   seekable:           Tells whether the media can be seeked
@@ -79,10 +94,154 @@ typedef enum {
  * async_bus_id:        ID handle for GstBus
  * buffer_probe_id:     ID of the video renderer buffer probe
  * seek_position:       Indicates the pos where to seek, in seconds
+ * start_position:      Position the current media starts at, in seconds
+ * preroll_seek_done:   The pending seek was issued while prerolling
+ * start_seek:          Seek issued at the first segment the audio sink gets
+ *                      {position in seconds, START_SEEK_* state}
+ * audit_timeout:       Timeout reporting the format converters in use
  * vsink:               Video sink element of the pipeline
+ * vsink_bin:           Bin scaling the video down before @vsink, if used
+ * vscale_filter:       Caps filter setting the size @vsink gets
  * asink:               Audio sink element of the pipeline
  * xid:                 XID for video playback
+ * qos:          Video degradation driven by the QoS of the video sink
+ *   level:              0 decodes and renders everything, every level
+ *                       above that skips more work
+ *   rendered:           Frames rendered by the sink so far
+ *   dropped:            Frames dropped by the sink so far
+ *   window_start:       When the current measuring window started
+ *   window_rendered:    @rendered at @window_start
+ *   window_dropped:     @dropped at @window_start
+ *   last_drop:          When the sink last reported a dropped frame
+ *   last_emit:          When the frame counters were last emitted
+ *   relax_timeout:      Timeout lowering @level once playback is smooth
+ * window:              The video window
+ *   display:            X connection following the window geometry
+ *   watch:              Source dispatching the events of @display
+ *   width:              Window width, 0 if unknown
+ *   height:             Window height, 0 if unknown
+ * video_visible:       Whether the client shows the video window
+ * audio_only:          Video decoding is disabled, as there is no window
+ *                      (or it is hidden)
+ * lean_audio:          The media is taken for music: no video sink is set
+ *                      up unless video shows up
+ * display_on:          Whether the screen is on
+ * loop:         Gapless looping of the media
+ *   enabled:            Whether to loop
+ *   start:              Where the loop starts, in nanoseconds
+ *   stop:               Where the loop ends, in nanoseconds, -1 for the end
+ *                       of the media
+ *   armed:              The pipeline plays in segment mode, towards @stop
+ * gapless:      Encoder delay and padding trimmed off the media
+ *   start:              Where the music starts, in nanoseconds
+ *   stop:               Where the music ends, in nanoseconds, -1 for the
+ *                       end of the media
+ *   probe:              The media being looked into in the background
+ * output:       Audio output profile
+ *   active:             Profile the audio sink runs with
+ *   probe:              Probe on the sink pad of the audio sink
+ *   sink_profile:       Profile last set by the audio sink probe
+ *   last_buffer:        When the audio sink last got a buffer, only used
+ *                       by the audio sink probe
+ *   playing:            The pipeline is PLAYING, for the audio sink probe
+ *   restarted:          The pipeline went to PLAYING, the audio sink probe
+ *                       is to forget @last_buffer
+ *   sink_buffer_time:   Buffer time the audio sink opened its stream with
+ *   extra_usecs:        Added to the buffer time of the profiles after
+ *                       underruns
+ *   last_underrun:      When the audio sink last ran dry
+ *   relax_timeout:      Timeout lowering @extra_usecs once playback is
+ *                       smooth
+ *   discontinuities:    Buffers the audio sink got after a gap in the data
+ *   since:              When the sink started playing with @active, 0 if
+ *                       it is not playing
+ *   sink_wakeups:       Wakeups of the streaming thread of the audio sink
+ *   sink_thread:        Streaming thread @sink_wakeups was last counted in
+ *   sink_thread_nvcsw:  Voluntary context switches of @sink_thread then
+ *   wakeups_since:      @sink_wakeups at @since
+ *   stats:              Playing time, sink thread wakeups and underruns per
+ *                       profile
+ *   device:             Pulse sink the audio goes to, NULL for the default
+ *   switching:          The stream is being moved to @device
+ *   switch_start:       When the move was asked for
+ *   switch_gap:         Longest wait for data in the sink during the move
+ *   switch_timeout:     Timeout giving up on the move
+ *   switch_latency:     How long the last move took, in microseconds, -1
+ *                       if it failed
+ *   switch_dropped:     Audio lost during the last move, in microseconds
+ * first_audio:  Time to first audio of the media
+ *   requested:          When it was asked to play, 0 once playing
+ *   warmup:             How far the plugin warm-up had gone by then
+ *   pending:            The audio sink has not rendered anything yet
+ *   played:             Some media has been played before
+ * streams:      Streams to select once the media is prerolled
+ *   audio:              Audio stream, -1 for the one playbin picks
+ *   text:               Subtitle stream, -1 for the one playbin picks
+ * release_paused:      Go to READY as soon as prerolled paused, instead of
+ *                      after a while paused
+ * source:       What the source told about the media
+ *   duration:           Duration in seconds, -1 if unknown
+ *   seekability:        Whether the source can seek in it
+ * reconnect:    Reopening an HTTP stream that dropped the connection
+ *   attempts:           Retries done since the stream last held up
+ *   timeout:            Timeout reopening the stream, while the buffered
+ *                       data plays out
+ *   since:              When the stream was last reopened
  * current_frame_on_pause: whether to emit current frame when pausing
+ * context:             Main context of the worker thread; bus messages and
+ *                      the worker timeouts are dispatched there
+ * owner_context:       Main context notifications are delivered in
+ * owner_thread:        Thread the owner calls the worker from
+ * loop:                Main loop running @context
+ * thread:              Worker thread
+ * lock:                Held by the worker thread while it runs commands,
+ *                      bus messages and timeouts; never held while waiting
+ *                      for the pipeline, never taken by the owner
+ * shared:       What the owner reads of the worker state, published by
+ *               the worker thread each time it lets go of @lock
+ *   lock:               Guards the fields below
+ *   pipeline:           @pipeline, referenced
+ *   has_media:          Whether some media is set
+ *   seek_position:      @seek_position
+ *   eos:                @eos
+ *   seekable:           @media.seekable
+ *   endless:            The media is a stream with no length that cannot
+ *                       seek: endless radio
+ *   active:             @output.active
+ *   since:              @output.since
+ *   wakeups_since:      @output.wakeups_since
+ *   stats:              Playing time and wakeups of @output.stats
+ *   switch_latency:     @output.switch_latency
+ *   switch_dropped:     @output.switch_dropped
+ * requested:    What the owner last set, for its getters; the worker
+ *               thread gets it along with the command
+ *   xid:                @xid
+ *   video_visible:      @video_visible
+ *   loop_enabled:       @loop.enabled
+ *   loop_start:         @loop.start
+ *   loop_stop:          @loop.stop
+ *   device:             @output.device
+ * commands:            Calls of the owner queued for the worker thread
+ * generation:          Bumped by the owner on stop and play, to drop the
+ *                      notifications of old media
+ * media_generation:    @generation the current media was played in
+ * owner_calls:         Notifications queued for @owner_context
+ * stay_paused_requested: @stay_paused as last set by the owner
+ * pl_parser:           Playlist parser, created on first use
+ * frame_conv:          Converter for thumbnails, created on first use
+ * prohibits_blanking:  Whether we hold a screen blanking prohibition
+ * prohibits_keypadlocking: Whether we hold a keypad locking prohibition
+ * blanking_initialized: Whether screen blanking control was set up, on the
+ *                      first video
+ * pipeline_built:      Whether a pipeline was ever built
+ * exiting:             The worker is going away, no pipeline is built any
+ *                      more
+ * teardown:     Pipelines being destroyed in the background
+ *   reaper:             Thread destroying old pipelines
+ *   pending:            Number of pipelines waiting to be destroyed
+ *   count:              Number of pipelines destroyed so far
+ *   total_usecs:        Time spent destroying them, in microseconds
+ *   max_usecs:          Longest time spent on one of them
  */
 struct _MafwGstRendererWorker {
 	struct {
@@ -131,8 +290,15 @@ struct _MafwGstRendererWorker {
 	gboolean report_statechanges;
 	guint async_bus_id;
 	gint seek_position;
+	gint start_position;
+	gboolean preroll_seek_done;
+	struct {
+		gint position;
+		gint state;
+	} start_seek;
 	guint ready_timeout;
 	guint duration_seek_timeout;
+	guint audit_timeout;
 	/* After some time PAUSED, we set the pipeline to READY in order to
 	 * save resources. This field states if we are in this special
 	 * situation.
@@ -149,9 +315,93 @@ struct _MafwGstRendererWorker {
 	 */
 	gboolean in_ready;
 	GstElement *vsink;
+	GstElement *vsink_bin;
+	GstElement *vscale_filter;
 	gboolean use_xv;
 	GstElement *asink;
 	XID xid;
+	struct {
+		guint level;
+		guint64 rendered;
+		guint64 dropped;
+		gint64 window_start;
+		guint64 window_rendered;
+		guint64 window_dropped;
+		gint64 last_drop;
+		gint64 last_emit;
+		guint relax_timeout;
+	} qos;
+	struct {
+		Display *display;
+		GSource *watch;
+		gint width;
+		gint height;
+	} window;
+	gboolean video_visible;
+	gboolean audio_only;
+	gboolean lean_audio;
+	gboolean display_on;
+	struct {
+		gboolean enabled;
+		gint64 start;
+		gint64 stop;
+		gboolean armed;
+	} loop;
+	struct {
+		gint64 start;
+		gint64 stop;
+		MafwGstRendererGaplessProbe *probe;
+	} gapless;
+	struct {
+		OutputProfile active;
+		gulong probe;
+		OutputProfile sink_profile;
+		gint64 last_buffer;
+		gint playing;
+		gint restarted;
+		gint64 sink_buffer_time;
+		gint extra_usecs;
+		gint64 last_underrun;
+		guint relax_timeout;
+		gint discontinuities;
+		gint64 since;
+		gint sink_wakeups;
+		GThread *sink_thread;
+		glong sink_thread_nvcsw;
+		glong wakeups_since;
+		struct {
+			gint64 usecs;
+			glong wakeups;
+			gint underruns;
+		} stats[_LAST_OUTPUT_PROFILE];
+		gchar *device;
+		gint switching;
+		gint64 switch_start;
+		gint64 switch_gap;
+		guint switch_timeout;
+		gint64 switch_latency;
+		gint64 switch_dropped;
+	} output;
+	struct {
+		gint64 requested;
+		const gchar *warmup;
+		gint pending;
+		gboolean played;
+	} first_audio;
+	struct {
+		gint audio;
+		gint text;
+	} streams;
+	gboolean release_paused;
+	struct {
+		gint duration;
+		SeekabilityType seekability;
+	} source;
+	struct {
+		gint attempts;
+		guint timeout;
+		gint64 since;
+	} reconnect;
 	GPtrArray *tag_list;
 	GHashTable *current_metadata;
 
@@ -159,7 +409,59 @@ struct _MafwGstRendererWorker {
 	gboolean current_frame_on_pause;
 	gchar *tmp_files_pool[MAFW_GST_RENDERER_MAX_TMP_FILES];
 	guint8 tmp_files_pool_index;
+	BvwFrameConv *frame_conv;
 #endif
+	TotemPlParser *pl_parser;
+	gboolean prohibits_blanking;
+	gboolean prohibits_keypadlocking;
+	gboolean blanking_initialized;
+	gboolean pipeline_built;
+	gboolean exiting;
+	struct {
+		GThreadPool *reaper;
+		gint pending;
+		guint count;
+		gint64 total_usecs;
+		gint64 max_usecs;
+	} teardown;
+
+	GMainContext *context;
+	GMainContext *owner_context;
+	GThread *owner_thread;
+	GMainLoop *loop;
+	GThread *thread;
+	GRecMutex lock;
+	struct {
+		GMutex lock;
+		GstElement *pipeline;
+		gboolean has_media;
+		gint seek_position;
+		gboolean eos;
+		SeekabilityType seekable;
+		gboolean endless;
+		OutputProfile active;
+		gint64 since;
+		glong wakeups_since;
+		struct {
+			gint64 usecs;
+			glong wakeups;
+		} stats[_LAST_OUTPUT_PROFILE];
+		gint64 switch_latency;
+		gint64 switch_dropped;
+	} shared;
+	struct {
+		XID xid;
+		gboolean video_visible;
+		gboolean loop_enabled;
+		gint64 loop_start;
+		gint64 loop_stop;
+		gchar *device;
+	} requested;
+	GAsyncQueue *commands;
+	guint generation;
+	guint media_generation;
+	GSList *owner_calls;
+	gboolean stay_paused_requested;
 
         /* Handlers for notifications */
         MafwGstRendererWorkerNotifySeekCb notify_seek_handler;
@@ -193,11 +495,61 @@ void mafw_gst_renderer_worker_set_position(MafwGstRendererWorker *worker,
 gint mafw_gst_renderer_worker_get_position(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_set_xid(MafwGstRendererWorker *worker, XID xid);
 XID mafw_gst_renderer_worker_get_xid(MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_set_video_visible(MafwGstRendererWorker *worker,
+						gboolean visible);
+gboolean mafw_gst_renderer_worker_get_video_visible(
+	MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_set_loop(MafwGstRendererWorker *worker,
+				       gboolean enabled, gint start_ms,
+				       gint end_ms);
+gboolean mafw_gst_renderer_worker_get_loop(MafwGstRendererWorker *worker,
+					   gint *start_ms, gint *end_ms);
+void mafw_gst_renderer_worker_set_display_on(MafwGstRendererWorker *worker,
+					     gboolean on);
+OutputProfile mafw_gst_renderer_worker_get_output_profile(
+	MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_get_output_stats(MafwGstRendererWorker *worker,
+					       OutputProfile profile,
+					       gint64 *playing_usecs,
+					       gdouble *wakeups_per_second,
+					       guint *underruns);
+guint mafw_gst_renderer_worker_get_audio_underruns(
+	MafwGstRendererWorker *worker);
+gint64 mafw_gst_renderer_worker_get_audio_buffer_time(
+	MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_set_audio_output(MafwGstRendererWorker *worker,
+					       const gchar *device);
+const gchar *mafw_gst_renderer_worker_get_audio_output(
+	MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_get_audio_output_switch(
+	MafwGstRendererWorker *worker, gint64 *latency_usecs,
+	gint64 *dropped_usecs);
+void mafw_gst_renderer_worker_get_streams(MafwGstRendererWorker *worker,
+					  gint *audio, gint *text);
+void mafw_gst_renderer_worker_set_stay_paused(MafwGstRendererWorker *worker,
+					      gboolean stay_paused);
+gboolean mafw_gst_renderer_worker_get_stay_paused(
+	MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_set_source_info(MafwGstRendererWorker *worker,
+					      gint duration,
+					      SeekabilityType seekability);
 gboolean mafw_gst_renderer_worker_get_seekable(MafwGstRendererWorker *worker);
+gboolean mafw_gst_renderer_worker_is_endless(MafwGstRendererWorker *worker);
 GHashTable *mafw_gst_renderer_worker_get_current_metadata(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker, const gchar *uri, GSList *plitems);
+void mafw_gst_renderer_worker_play_at(MafwGstRendererWorker *worker,
+				      const gchar *uri, GSList *plitems,
+				      gint position);
+void mafw_gst_renderer_worker_preroll_at(MafwGstRendererWorker *worker,
+					 const gchar *uri, gint position,
+					 gint audio, gint text,
+					 gboolean release);
 void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker, gchar **uris);
 void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker);
+void mafw_gst_renderer_worker_get_teardown_stats(MafwGstRendererWorker *worker,
+						 guint *pending, guint *count,
+						 gint64 *avg_usecs,
+						 gint64 *max_usecs);
 void mafw_gst_renderer_worker_pause(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_resume(MafwGstRendererWorker *worker);
 
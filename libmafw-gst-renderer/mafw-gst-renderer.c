@@ -30,6 +30,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <dbus/dbus.h>
+#include <mce/dbus-names.h>
 
 #include <libmafw/mafw.h>
 #include "mafw-gst-renderer.h"
@@ -175,10 +176,37 @@ static gboolean mafw_gst_renderer_initialize(MafwRegistry *registry,
 					   GError **error)
 {
 	MafwGstRenderer *self;
+	const gchar *instances_env;
+	gint instances = 1;
+	gint i;
 
 	g_assert(registry != NULL);
+	startup_trace("plugin loaded");
 	self = MAFW_GST_RENDERER(mafw_gst_renderer_new(registry));
 	mafw_registry_add_extension(registry, MAFW_EXTENSION(self));
+	mafw_gst_renderer_restore_snapshot(self);
+
+	/* Additional renderers (zones, outputs) share this process, its
+	 * GStreamer registry and the pulse connection */
+	instances_env = g_getenv(MAFW_GST_RENDERER_INSTANCES_ENV);
+	if (instances_env != NULL)
+		instances = CLAMP(atoi(instances_env), 1,
+				  MAFW_GST_RENDERER_MAX_INSTANCES);
+
+	for (i = 1; i < instances; i++) {
+		gchar *uuid, *name;
+
+		uuid = g_strdup_printf("%s-%d", MAFW_GST_RENDERER_UUID, i);
+		name = g_strdup_printf("%s-%d", MAFW_GST_RENDERER_NAME, i);
+		self = MAFW_GST_RENDERER(mafw_gst_renderer_new_full(registry,
+								    uuid,
+								    name));
+		mafw_registry_add_extension(registry, MAFW_EXTENSION(self));
+		mafw_gst_renderer_restore_snapshot(self);
+		g_free(uuid);
+		g_free(name);
+	}
+	startup_trace("renderers ready");
 
 	return TRUE;
 }
@@ -197,11 +225,6 @@ static void mafw_gst_renderer_class_init(MafwGstRendererClass *klass)
 {
 	GObjectClass *gclass = NULL;
 	MafwRendererClass *renderer_class = NULL;
-	const gchar *preloaded_plugins[] = {"playback", "uridecodebin",
-				"coreelements", "typefindfunctions",
-				"pulseaudio", NULL};
-	gint i = 0;
-	GObject *plugin;
 
 	gclass = G_OBJECT_CLASS(klass);
 	g_return_if_fail(gclass != NULL);
@@ -249,23 +272,80 @@ static void mafw_gst_renderer_class_init(MafwGstRendererClass *klass)
 
 	gst_init(NULL, NULL);
 	gst_pb_utils_init();
+	/* Common plugins are loaded by the warm-up thread, enabled or not */
+	startup_trace("GStreamer initialized");
+}
 
-	/* Pre-load some common plugins */
-	while (preloaded_plugins[i])
-	{
-		plugin = G_OBJECT(gst_plugin_load_by_name(preloaded_plugins[i]));
-		if (plugin)
-			g_object_unref(plugin);
-		else
-			g_debug("Can not load plugin: %s", preloaded_plugins[i]);
-		i++;
+static void _display_status_changed(MafwGstRenderer *renderer,
+				   const gchar *status)
+{
+	g_debug("display %s", status);
+	mafw_gst_renderer_worker_set_display_on(
+		renderer->worker, strcmp(status, MCE_DISPLAY_OFF_STRING) != 0);
+}
+
+static void _display_status_signal_cb(GDBusConnection *connection,
+				      const gchar *sender, const gchar *path,
+				      const gchar *interface,
+				      const gchar *signal,
+				      GVariant *parameters, gpointer user_data)
+{
+	const gchar *status;
+
+	g_variant_get(parameters, "(&s)", &status);
+	_display_status_changed(MAFW_GST_RENDERER(user_data), status);
+}
+
+static void _display_status_reply_cb(GObject *source, GAsyncResult *res,
+				     gpointer user_data)
+{
+	MafwGstRenderer *renderer = user_data;
+	GVariant *reply;
+	const gchar *status;
+
+	reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+					      NULL);
+	if (reply != NULL) {
+		if (renderer->worker != NULL) {
+			g_variant_get(reply, "(&s)", &status);
+			_display_status_changed(renderer, status);
+		}
+		g_variant_unref(reply);
 	}
+	g_object_unref(renderer);
+}
+
+/*
+ * Follows the display state, so that audio is buffered longer while the
+ * screen is off.
+ */
+static void _display_watch_init(MafwGstRenderer *renderer)
+{
+	GError *error = NULL;
+
+	renderer->system_bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (renderer->system_bus == NULL) {
+		g_warning("Could not follow the display state: %s",
+			  error->message);
+		g_error_free(error);
+		return;
+	}
+
+	renderer->display_watch = g_dbus_connection_signal_subscribe(
+		renderer->system_bus, NULL, MCE_SIGNAL_IF, MCE_DISPLAY_SIG,
+		MCE_SIGNAL_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+		_display_status_signal_cb, renderer, NULL);
+	g_dbus_connection_call(renderer->system_bus, MCE_SERVICE,
+			       MCE_REQUEST_PATH, MCE_REQUEST_IF,
+			       MCE_DISPLAY_STATUS_GET, NULL,
+			       G_VARIANT_TYPE("(s)"), G_DBUS_CALL_FLAGS_NONE,
+			       -1, NULL, _display_status_reply_cb,
+			       g_object_ref(renderer));
 }
 
 static void mafw_gst_renderer_init(MafwGstRenderer *self)
 {
 	MafwGstRenderer *renderer = NULL;
-	GError *error = NULL;
 
 	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
 
@@ -288,6 +368,44 @@ static void mafw_gst_renderer_init(MafwGstRenderer *self)
         mafw_extension_add_property(MAFW_EXTENSION(self),
                                     MAFW_PROPERTY_GST_RENDERER_TV_CONNECTED,
                                     G_TYPE_BOOLEAN);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_VIDEO_VISIBLE,
+				    G_TYPE_BOOLEAN);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_LOOP,
+				    G_TYPE_BOOLEAN);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_LOOP_START,
+				    G_TYPE_INT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_LOOP_END,
+				    G_TYPE_INT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_AUDIO_UNDERRUNS,
+				    G_TYPE_UINT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_AUDIO_BUFFER_TIME,
+				    G_TYPE_UINT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT,
+				    G_TYPE_STRING);
+	mafw_extension_add_property(
+		MAFW_EXTENSION(self),
+		MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT_SWITCH_LATENCY,
+		G_TYPE_INT);
+	mafw_extension_add_property(
+		MAFW_EXTENSION(self),
+		MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT_SWITCH_DROPPED,
+		G_TYPE_UINT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_TEARDOWNS_PENDING,
+				    G_TYPE_UINT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_TEARDOWN_MAX_TIME,
+				    G_TYPE_UINT);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_PLAY_AT,
+				    G_TYPE_INT);
  	MAFW_EXTENSION_SUPPORTS_TRANSPORT_ACTIONS(self);
 	renderer->media = g_new0(MafwGstRendererMedia, 1);
 	renderer->media->seekability = SEEKABILITY_UNKNOWN;
@@ -297,6 +415,8 @@ static void mafw_gst_renderer_init(MafwGstRenderer *self)
 	renderer->iterator = NULL;
 	renderer->seeking_to = -1;
         renderer->update_playcount_id = 0;
+	renderer->navigation_id = 0;
+	renderer->start_position = 0;
 
         self->worker = mafw_gst_renderer_worker_new(self);
 
@@ -326,9 +446,30 @@ static void mafw_gst_renderer_init(MafwGstRenderer *self)
 #ifdef HAVE_CONIC
 	renderer->connected = FALSE;
 	renderer->connection = NULL;
-
+	/* Right away: a stream played before the first connection event
+	 * would take its read errors for the network being down */
 	_connection_init(renderer);
 #endif
+	/* The rest is only needed to play, see
+	 * mafw_gst_renderer_setup_playback() */
+}
+
+/**
+ * mafw_gst_renderer_setup_playback:
+ * @renderer: a renderer.
+ *
+ * Sets up what is only needed while playing: memory card and display
+ * watches.  Done on the first play rather than at startup, the renderer
+ * is often restarted.
+ */
+void mafw_gst_renderer_setup_playback(MafwGstRenderer *renderer)
+{
+	GError *error = NULL;
+
+	if (renderer->playback_setup)
+		return;
+	renderer->playback_setup = TRUE;
+
 	renderer->gconf_client = gconf_client_get_default();
 	gconf_client_add_dir(renderer->gconf_client, GCONF_OSSO_AF,
 			     GCONF_CLIENT_PRELOAD_ONELEVEL, &error);
@@ -352,6 +493,9 @@ static void mafw_gst_renderer_init(MafwGstRenderer *self)
 	renderer->volume_monitor = g_volume_monitor_get();
 	g_signal_connect(renderer->volume_monitor, "mount-pre-unmount",
 			 G_CALLBACK(_volume_pre_unmount_cb), renderer);
+
+	_display_watch_init(renderer);
+	startup_trace("playback set up");
 }
 
 static void mafw_gst_renderer_dispose(GObject *object)
@@ -362,6 +506,26 @@ static void mafw_gst_renderer_dispose(GObject *object)
 
 	renderer = MAFW_GST_RENDERER(object);
 
+	mafw_gst_renderer_cancel_navigation(renderer);
+
+	if (renderer->restore_id != 0) {
+		g_source_remove(renderer->restore_id);
+		renderer->restore_id = 0;
+	}
+	if (renderer->snapshot_id != 0) {
+		g_source_remove(renderer->snapshot_id);
+		renderer->snapshot_id = 0;
+	}
+	mafw_gst_renderer_snapshot_free(renderer->restored);
+	renderer->restored = NULL;
+
+	if (renderer->system_bus != NULL) {
+		g_dbus_connection_signal_unsubscribe(renderer->system_bus,
+						     renderer->display_watch);
+		g_object_unref(renderer->system_bus);
+		renderer->system_bus = NULL;
+	}
+
 	if (renderer->worker != NULL) {
 		mafw_gst_renderer_worker_exit(renderer->worker);
 		renderer->seek_pending = FALSE;
@@ -369,6 +533,12 @@ static void mafw_gst_renderer_dispose(GObject *object)
 		renderer->worker = NULL;
 	}
 
+	if (renderer->stats_journal != NULL) {
+		mafw_gst_renderer_stats_journal_destroy(
+			renderer->stats_journal);
+		renderer->stats_journal = NULL;
+	}
+
 	if (renderer->registry != NULL) {
 		g_object_unref(renderer->registry);
 		renderer->registry = NULL;
@@ -438,6 +608,22 @@ static void mafw_gst_renderer_finalize(GObject *object)
  * Creates a new MafwGstRenderer object
  */
 GObject *mafw_gst_renderer_new(MafwRegistry* registry)
+{
+	return mafw_gst_renderer_new_full(registry, MAFW_GST_RENDERER_UUID,
+					  MAFW_GST_RENDERER_NAME);
+}
+
+/**
+ * mafw_gst_renderer_new_full:
+ * @registry: The registry that owns this renderer.
+ * @uuid: UUID of the renderer, unique in the process.
+ * @name: Name of the renderer.
+ *
+ * Creates a new MafwGstRenderer object.  Several renderers can live in the
+ * same process as long as their UUIDs differ.
+ */
+GObject *mafw_gst_renderer_new_full(MafwRegistry* registry, const gchar *uuid,
+				    const gchar *name)
 {
 	GObject* object;
 #if 0
@@ -450,12 +636,14 @@ GObject *mafw_gst_renderer_new(MafwRegistry* registry)
 #endif
 
 	object = g_object_new(MAFW_TYPE_GST_RENDERER,
-			      "uuid", MAFW_GST_RENDERER_UUID,
-			      "name", MAFW_GST_RENDERER_NAME,
+			      "uuid", uuid,
+			      "name", name,
 			      "plugin", MAFW_GST_RENDERER_PLUGIN_NAME,
 			      NULL);
 	g_assert(object != NULL);
 	MAFW_GST_RENDERER(object)->registry = g_object_ref(registry);
+	MAFW_GST_RENDERER(object)->stats_journal =
+		mafw_gst_renderer_stats_journal_new(registry, uuid);
 
 	/* Set default error policy */
 	MAFW_GST_RENDERER(object)->error_policy =
@@ -944,6 +1132,166 @@ static void _signal_transport_actions_property_changed(MafwGstRenderer * self)
 }
 
 
+/*----------------------------------------------------------------------------
+  Snapshot
+  ----------------------------------------------------------------------------*/
+
+/*
+ * Takes the snapshot of the playback context, from what the renderer and
+ * the worker have at hand.  Writing it is left to the saver thread.
+ */
+static void _save_snapshot(MafwGstRenderer *self)
+{
+	MafwGstRendererSnapshot snapshot;
+
+	if (self->worker == NULL)
+		return;
+
+	snapshot.state = self->current_state;
+	snapshot.object_id = self->media->object_id;
+	snapshot.uri = self->media->uri;
+	snapshot.position = self->current_state == Stopped ? 0 :
+		MAX(mafw_gst_renderer_worker_get_position(self->worker), 0);
+	snapshot.standalone =
+		self->playback_mode == MAFW_GST_RENDERER_MODE_STANDALONE;
+	snapshot.playlist_index = -1;
+	if (self->restored != NULL)
+		/* Still waiting for its playlist */
+		snapshot.playlist_index = self->restored->playlist_index;
+	else if (!snapshot.standalone && self->iterator != NULL &&
+		 self->media->object_id != NULL)
+		snapshot.playlist_index =
+			mafw_playlist_iterator_get_current_index(
+				self->iterator);
+	mafw_gst_renderer_worker_get_streams(self->worker,
+					     &snapshot.audio_stream,
+					     &snapshot.text_stream);
+
+	mafw_gst_renderer_snapshot_save(
+		mafw_extension_get_uuid(MAFW_EXTENSION(self)), &snapshot);
+}
+
+static gboolean _snapshot_timeout_cb(gpointer data)
+{
+	_save_snapshot(MAFW_GST_RENDERER(data));
+
+	return TRUE;
+}
+
+static gboolean _restore_snapshot_cb(gpointer data)
+{
+	MafwGstRenderer *self = MAFW_GST_RENDERER(data);
+	MafwGstRendererSnapshot *snapshot = self->restored;
+
+	self->restore_id = 0;
+
+	/* A client was faster */
+	if (snapshot == NULL || self->current_state != Stopped)
+		return FALSE;
+
+	g_debug("restoring %s at %d s", snapshot->object_id,
+		snapshot->position);
+	mafw_gst_renderer_set_playback_mode(
+		self, snapshot->standalone ? MAFW_GST_RENDERER_MODE_STANDALONE :
+		MAFW_GST_RENDERER_MODE_PLAYLIST);
+	mafw_gst_renderer_set_object(self, snapshot->object_id);
+
+	/* Nothing was playing, the media is only selected again */
+	if (snapshot->state != Stopped && snapshot->uri != NULL) {
+		self->media->uri = g_strdup(snapshot->uri);
+		mafw_gst_renderer_setup_playback(self);
+		mafw_gst_renderer_set_state(self, Transitioning);
+		/* Dropped at the next start if this one never prerolls: the
+		 * save once paused clears the mark */
+		mafw_gst_renderer_snapshot_mark_restoring(
+			mafw_extension_get_uuid(MAFW_EXTENSION(self)));
+		mafw_gst_renderer_worker_set_source_info(
+			self->worker, self->media->duration,
+			self->media->seekability);
+		/* Like a pause while transitioning */
+		mafw_gst_renderer_worker_preroll_at(
+			self->worker, snapshot->uri, snapshot->position,
+			snapshot->audio_stream, snapshot->text_stream,
+			mafw_gst_renderer_snapshot_get_restore() ==
+			MAFW_GST_RENDERER_SNAPSHOT_RESTORE_READY);
+	}
+
+	/* Playlists wait for the client to assign them again */
+	if (snapshot->standalone || snapshot->playlist_index < 0) {
+		mafw_gst_renderer_snapshot_free(snapshot);
+		self->restored = NULL;
+	}
+
+	return FALSE;
+}
+
+/**
+ * mafw_gst_renderer_restore_snapshot:
+ * @self: a renderer that has not played anything yet.
+ *
+ * Resumes the playback context the previous instance of the process
+ * saved, once the main loop runs: its media is prerolled paused at the
+ * position it had, so that clients only have to resume it.  When the
+ * playlist it was in is assigned again, the renderer moves to the same
+ * item.
+ */
+void mafw_gst_renderer_restore_snapshot(MafwGstRenderer *self)
+{
+	MafwGstRendererSnapshot *snapshot;
+
+	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
+
+	if (mafw_gst_renderer_snapshot_get_restore() ==
+	    MAFW_GST_RENDERER_SNAPSHOT_RESTORE_NONE)
+		return;
+
+	snapshot = mafw_gst_renderer_snapshot_load(
+		mafw_extension_get_uuid(MAFW_EXTENSION(self)));
+	if (snapshot == NULL || snapshot->object_id == NULL) {
+		mafw_gst_renderer_snapshot_free(snapshot);
+		return;
+	}
+
+	self->restored = snapshot;
+	self->restore_id = g_idle_add_full(G_PRIORITY_LOW,
+					   _restore_snapshot_cb, self, NULL);
+}
+
+/*
+ * Moves the iterator of the playlist just assigned to the item the
+ * restored snapshot was taken at, if it is still there.  Returns the
+ * position in that item, -1 if it is gone.
+ */
+static gint _restore_playlist_index(MafwGstRenderer *self)
+{
+	MafwGstRendererSnapshot *snapshot = self->restored;
+	const gchar *current;
+	gint position = -1;
+
+	self->restored = NULL;
+	if (self->restore_id != 0) {
+		g_source_remove(self->restore_id);
+		self->restore_id = 0;
+	}
+
+	if (snapshot->playlist_index >= 0 &&
+	    snapshot->playlist_index <
+	    mafw_playlist_iterator_get_size(self->iterator, NULL)) {
+		mafw_playlist_iterator_move_to_index(self->iterator,
+						     snapshot->playlist_index,
+						     NULL);
+		current = mafw_playlist_iterator_get_current_objectid(
+			self->iterator);
+		if (current != NULL && !strcmp(current, snapshot->object_id))
+			position = snapshot->position;
+		else
+			mafw_playlist_iterator_reset(self->iterator, NULL);
+	}
+	mafw_gst_renderer_snapshot_free(snapshot);
+
+	return position;
+}
+
 /*----------------------------------------------------------------------------
   State pattern support
   ----------------------------------------------------------------------------*/
@@ -955,6 +1303,22 @@ void mafw_gst_renderer_set_state(MafwGstRenderer *self, MafwPlayState state)
 	self->current_state = state;
 	_signal_state_changed(self);
 	_signal_transport_actions_property_changed(self);
+
+	/* Nothing is playing, good time to write the statistics back */
+	if (state == Stopped && self->stats_journal != NULL)
+		mafw_gst_renderer_stats_journal_flush(self->stats_journal);
+
+	/* A restarted process resumes from there */
+	_save_snapshot(self);
+	if (state == Playing && self->snapshot_id == 0) {
+		self->snapshot_id =
+			g_timeout_add_seconds(
+				MAFW_GST_RENDERER_SNAPSHOT_INTERVAL,
+				_snapshot_timeout_cb, self);
+	} else if (state != Playing && self->snapshot_id != 0) {
+		g_source_remove(self->snapshot_id);
+		self->snapshot_id = 0;
+	}
 }
 
 void mafw_gst_renderer_play(MafwRenderer *self, MafwRendererPlaybackCB callback,
@@ -969,9 +1333,53 @@ void mafw_gst_renderer_play(MafwRenderer *self, MafwRendererPlaybackCB callback,
 			 (renderer->current_state != _LastMafwPlayState) &&
 			 (renderer->states[renderer->current_state] != NULL));
 
+	/* A pending navigation is going to start playback anyway */
+	if (renderer->navigation_id != 0)
+		mafw_gst_renderer_flush_navigation(renderer, &error);
+	else
+		mafw_gst_renderer_state_play(
+			MAFW_GST_RENDERER_STATE(
+				renderer->states[renderer->current_state]),
+			&error);
+
+	if (callback != NULL)
+		callback(self, user_data, error);
+	if (error)
+		g_error_free(error);
+}
+
+/**
+ * mafw_gst_renderer_play_at:
+ * @self: a #MafwGstRenderer
+ * @seconds: position to start at
+ * @callback: function to call when done
+ * @user_data: data for @callback
+ *
+ * Like mafw_renderer_play(), but playback starts at @seconds.  The
+ * pipeline prerolls directly at that position, which is cheaper than
+ * calling mafw_renderer_set_position() once playing.
+ */
+void mafw_gst_renderer_play_at(MafwRenderer *self, gint seconds,
+			       MafwRendererPlaybackCB callback,
+			       gpointer user_data)
+{
+	MafwGstRenderer *renderer = (MafwGstRenderer*) self;
+	GError *error = NULL;
+
+	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
+
+	g_return_if_fail((renderer->states != 0) &&
+			 (renderer->current_state != _LastMafwPlayState) &&
+			 (renderer->states[renderer->current_state] != NULL));
+
+	/* Playback is (re)started right here, whatever was selected */
+	mafw_gst_renderer_cancel_navigation(renderer);
+	renderer->start_position = MAX(seconds, 0);
 	mafw_gst_renderer_state_play(
 		MAFW_GST_RENDERER_STATE(renderer->states[renderer->current_state]),
 		&error);
+	if (error != NULL)
+		renderer->start_position = 0;
 
 	if (callback != NULL)
 		callback(self, user_data, error);
@@ -994,6 +1402,8 @@ void mafw_gst_renderer_play_object(MafwRenderer *self,
 			 (renderer->current_state != _LastMafwPlayState) &&
 			 (renderer->states[renderer->current_state] != NULL));
 
+	/* The object replaces whatever the navigation selected */
+	mafw_gst_renderer_cancel_navigation(renderer);
 	mafw_gst_renderer_state_play_object(
 		MAFW_GST_RENDERER_STATE(renderer->states[renderer->current_state]),
 		object_id,
@@ -1018,6 +1428,7 @@ void mafw_gst_renderer_stop(MafwRenderer *self, MafwRendererPlaybackCB callback,
 			 (renderer->states[renderer->current_state] != NULL));
 
 	renderer->play_failed_count = 0;
+	mafw_gst_renderer_cancel_navigation(renderer);
 	mafw_gst_renderer_state_stop(
 		MAFW_GST_RENDERER_STATE(renderer->states[renderer->current_state]),
 		&error);
@@ -1041,9 +1452,12 @@ void mafw_gst_renderer_pause(MafwRenderer *self, MafwRendererPlaybackCB callback
 			 (renderer->current_state != _LastMafwPlayState) &&
 			 (renderer->states[renderer->current_state] != NULL));
 
-	mafw_gst_renderer_state_pause(
-		MAFW_GST_RENDERER_STATE(renderer->states[renderer->current_state]),
-		&error);
+	mafw_gst_renderer_flush_navigation(renderer, &error);
+	if (error == NULL)
+		mafw_gst_renderer_state_pause(
+			MAFW_GST_RENDERER_STATE(
+				renderer->states[renderer->current_state]),
+			&error);
 
 	if (callback != NULL)
 		callback(self, user_data, error);
@@ -1063,9 +1477,12 @@ void mafw_gst_renderer_resume(MafwRenderer *self, MafwRendererPlaybackCB callbac
 			 (renderer->current_state != _LastMafwPlayState) &&
 			 (renderer->states[renderer->current_state] != NULL));
 
-	mafw_gst_renderer_state_resume(
-		MAFW_GST_RENDERER_STATE (renderer->states[renderer->current_state]),
-		&error);
+	mafw_gst_renderer_flush_navigation(renderer, &error);
+	if (error == NULL)
+		mafw_gst_renderer_state_resume(
+			MAFW_GST_RENDERER_STATE(
+				renderer->states[renderer->current_state]),
+			&error);
 
 	if (callback != NULL)
 		callback(self, user_data, error);
@@ -1183,11 +1600,14 @@ void mafw_gst_renderer_set_position(MafwRenderer *self, MafwRendererSeekMode mod
 			 (renderer->current_state != _LastMafwPlayState) &&
 			 (renderer->states[renderer->current_state] != NULL));
 
-	mafw_gst_renderer_state_set_position(
-		MAFW_GST_RENDERER_STATE (renderer->states[renderer->current_state]),
-		mode,
-		seconds,
-		&error);
+	mafw_gst_renderer_flush_navigation(renderer, &error);
+	if (error == NULL)
+		mafw_gst_renderer_state_set_position(
+			MAFW_GST_RENDERER_STATE(
+				renderer->states[renderer->current_state]),
+			mode,
+			seconds,
+			&error);
 
 	if (callback != NULL)
 		callback(self, seconds, user_data, error);
@@ -1195,6 +1615,106 @@ void mafw_gst_renderer_set_position(MafwRenderer *self, MafwRendererSeekMode mod
 		g_error_free(error);
 }
 
+/*----------------------------------------------------------------------------
+  Navigation coalescing
+  ----------------------------------------------------------------------------*/
+
+/*
+ * Plays the navigation target.  Failures go to @error, or are emitted as
+ * an error if it is NULL: when the delay ran out, nobody is waiting for
+ * the outcome any more.
+ */
+static void _navigation_play(MafwGstRenderer *renderer, GError **error)
+{
+	GError *play_error = NULL;
+
+	g_debug("starting playback of navigation target");
+
+	mafw_gst_renderer_state_play(
+		MAFW_GST_RENDERER_STATE(renderer->states[renderer->current_state]),
+		&play_error);
+
+	if (play_error == NULL)
+		return;
+
+	if (error != NULL) {
+		g_propagate_error(error, play_error);
+	} else {
+		g_signal_emit_by_name(MAFW_EXTENSION(renderer), "error",
+				      play_error->domain,
+				      play_error->code,
+				      play_error->message);
+		g_error_free(play_error);
+	}
+}
+
+static gboolean _navigation_timeout_cb(gpointer data)
+{
+	MafwGstRenderer *renderer = MAFW_GST_RENDERER(data);
+
+	renderer->navigation_id = 0;
+	_navigation_play(renderer, NULL);
+
+	return FALSE;
+}
+
+/**
+ * mafw_gst_renderer_schedule_navigation_play:
+ * @self: a #MafwGstRenderer
+ *
+ * Starts playback of the current playlist item after a short delay.
+ * Every next/previous/goto_index request within the delay restarts it,
+ * so a burst of requests only prerolls the item selected last.  The
+ * iterator itself is moved immediately by the caller.
+ */
+void mafw_gst_renderer_schedule_navigation_play(MafwGstRenderer *self)
+{
+	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
+
+	if (self->navigation_id != 0)
+		g_source_remove(self->navigation_id);
+	self->navigation_id =
+		g_timeout_add(MAFW_GST_RENDERER_NAVIGATION_DELAY,
+			      _navigation_timeout_cb, self);
+}
+
+/**
+ * mafw_gst_renderer_flush_navigation:
+ * @self: a #MafwGstRenderer
+ * @error: location for the error starting playback, or %NULL to emit it
+ *
+ * Starts the pending navigation playback right away, if any.  Used
+ * before requests that need to act on the selected item.
+ */
+void mafw_gst_renderer_flush_navigation(MafwGstRenderer *self,
+					GError **error)
+{
+	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
+
+	if (self->navigation_id == 0)
+		return;
+
+	g_source_remove(self->navigation_id);
+	self->navigation_id = 0;
+	_navigation_play(self, error);
+}
+
+/**
+ * mafw_gst_renderer_cancel_navigation:
+ * @self: a #MafwGstRenderer
+ *
+ * Drops the pending navigation playback, if any.
+ */
+void mafw_gst_renderer_cancel_navigation(MafwGstRenderer *self)
+{
+	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
+
+	if (self->navigation_id != 0) {
+		g_source_remove(self->navigation_id);
+		self->navigation_id = 0;
+	}
+}
+
 gboolean mafw_gst_renderer_manage_error_idle(gpointer data)
 {
         MafwGstRendererErrorClosure *mec = (MafwGstRendererErrorClosure *) data;
@@ -1214,6 +1734,14 @@ static void _run_error_policy(MafwGstRenderer *self, const GError *in_err,
 
         gboolean play_next = FALSE;
 
+	/* The client moved on already: play what it selected rather than
+	 * moving once more */
+	if (self->navigation_id != 0) {
+		mafw_gst_renderer_flush_navigation(self, NULL);
+		if (out_err) *out_err = g_error_copy(in_err);
+		return;
+	}
+
         /* Check what to do on error */
 	if (in_err->code == MAFW_EXTENSION_ERROR_OUT_OF_MEMORY) {
                 play_next = FALSE;
@@ -1287,128 +1815,6 @@ static void _run_error_policy(MafwGstRenderer *self, const GError *in_err,
 	}
 }
 
-static void _metadata_set_cb(MafwSource *self, const gchar *object_id,
-				const gchar **failed_keys, gpointer user_data,
-				const GError *error)
-{
-	if (error != NULL) {
-		g_debug("Ignoring error received when setting metadata: "
-			"%s (%d): %s", g_quark_to_string(error->domain),
-			error->code, error->message);
-	} else {
-		g_debug("Metadata set correctly");
-	}
-}
-
-/**
- * _update_playcount_metadata_cb:
- * @cb_source:   The #MafwSource that sent the metadata results
- * @cb_object_id: The object ID, whose metadata results were received
- * @cb_metadata: GHashTable containing metadata key-value pairs
- * @cb_user_data: Optional user data pointer (self)
- * @cb_error:    Set if any errors occurred during metadata browsing
- *
- * Receives the results of a metadata request about the playcount. It increases
- * it, or sets to 1, and sets the metadata to that.
- */
-static void _update_playcount_metadata_cb (MafwSource *cb_source,
-					   const gchar *cb_object_id,
-					   GHashTable *cb_metadata,
-					   gpointer cb_user_data,
-					   const GError *cb_error)
-{
-	GValue *curval = NULL;
-	gint curplaycount = -1;
-	GHashTable *mdata = cb_user_data;
-
-	if (cb_error == NULL) {
-		if (cb_metadata)
-			curval = mafw_metadata_first(cb_metadata,
-				MAFW_METADATA_KEY_PLAY_COUNT);
-		if (curval && !G_VALUE_HOLDS(curval, G_TYPE_INT))
-			goto set_data;
-		if (curval)
-		{
-			curplaycount = g_value_get_int(curval);
-			curplaycount++;
-		}
-		else
-		{ /* Playing at first time, or not supported... */
-			curplaycount = 1;
-		}
-		if (!mdata)
-			mdata = mafw_metadata_new();
-		mafw_metadata_add_int(mdata,
-					MAFW_METADATA_KEY_PLAY_COUNT,
-					curplaycount);
-
-	} else {
-		g_warning("_playcount_metadata received an error: "
-			  "%s (%d): %s", g_quark_to_string(cb_error->domain),
-			  cb_error->code, cb_error->message);
-		if (mdata)
-			g_hash_table_unref(mdata);
-		return;
-	}
-set_data:
-	
-	if (mdata)
-	{
-		mafw_source_set_metadata(cb_source, cb_object_id, mdata,
-						_metadata_set_cb, NULL);
-		g_hash_table_unref(mdata);
-	}
-}
-
-/**
- * mafw_gst_renderer_add_lastplayed:
- * @mdata:   Exisiting mdata, or NULL
- *
- * Sets the MAFW_METADATA_KEY_LAST_PLAYED metadata in the given metadata-table,
- * or creates a new metadata-table, and sets the current time there.
- */
-static GHashTable *mafw_gst_renderer_add_lastplayed(GHashTable *mdata)
-{
-	GHashTable *metadata;
-
-	if (!mdata)
-		metadata = mafw_metadata_new();
-	else
-		metadata = mdata;
-
-	mafw_metadata_add_int64(metadata, MAFW_METADATA_KEY_LAST_PLAYED,
-				g_get_real_time() / 1000LL);
-	return metadata;
-}
-
-/**
- * mafw_gst_renderer_increase_playcount:
- * @self:   Gst renderer
- * @object_id: The object ID of the touched object
- * @mdat: Existing metadatas to add the playcount to, or NULL
- *
- * Increases the playcount of the given object.
- */
-static void mafw_gst_renderer_increase_playcount(MafwGstRenderer* self,
-					const gchar *object_id, GHashTable *mdat)
-{
-	MafwSource* source;
-
-	g_assert(self != NULL);
-	source = _get_source(self, object_id);
-	if (source != NULL)
-	{
-		static const gchar * const keys[] =
-			{ MAFW_METADATA_KEY_PLAY_COUNT, NULL };
-
-		mafw_source_get_metadata(source, object_id,
-					 keys,
-					 _update_playcount_metadata_cb,
-					 mdat);
-
- 	}
-}
-
 /**
  * mafw_gst_renderer_update_stats:
  * @data: user data
@@ -1421,11 +1827,11 @@ gboolean mafw_gst_renderer_update_stats(gpointer data)
 
         /* Update stats only for audio content */
         if (renderer->media->object_id &&
-            !renderer->worker->media.has_visual_content) {
-		GHashTable *mdata = mafw_gst_renderer_add_lastplayed(NULL);
-		mafw_gst_renderer_increase_playcount(renderer,
-                                                     renderer->media->object_id,
-                                                     mdata);
+            !g_atomic_int_get(
+		    &renderer->worker->media.has_visual_content)) {
+		mafw_gst_renderer_stats_journal_add_play(
+			renderer->stats_journal, renderer->media->object_id,
+			g_get_real_time() / 1000LL);
 	}
         renderer->update_playcount_id = 0;
         return FALSE;
@@ -1434,22 +1840,15 @@ gboolean mafw_gst_renderer_update_stats(gpointer data)
 void mafw_gst_renderer_update_source_duration(MafwGstRenderer *renderer,
 					      gint duration)
 {
-	GHashTable *metadata;
-	MafwSource* source;
-
-	source = _get_source(renderer, renderer->media->object_id);
-	g_return_if_fail(source != NULL);
+	g_return_if_fail(renderer->media->object_id != NULL);
 
 	renderer->media->duration = duration;
 
 	g_debug("updated source duration to %d", duration);
 
-	metadata = mafw_metadata_new();
-	mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_DURATION, duration);
-
-	mafw_source_set_metadata(source, renderer->media->object_id, metadata,
-				 _metadata_set_cb, NULL);
-	g_hash_table_unref(metadata);
+	/* Written to the source together with the play statistics */
+	mafw_gst_renderer_stats_journal_add_duration(
+		renderer->stats_journal, renderer->media->object_id, duration);
 }
 
 /**
@@ -1588,6 +1987,10 @@ static void _notify_seek(MafwGstRendererWorker *worker, gpointer owner)
 	mafw_gst_renderer_state_notify_seek(renderer->states[renderer->current_state],
 					  &error);
 
+	/* Paused, the position only moves with seeks */
+	if (renderer->current_state == Paused)
+		_save_snapshot(renderer);
+
 	if (error != NULL) {
 		g_signal_emit_by_name(MAFW_EXTENSION(renderer), "error",
 				      error->domain, error->code,
@@ -1892,6 +2295,7 @@ gboolean mafw_gst_renderer_assign_playlist(MafwRenderer *self,
 					   GError **error)
 {
 	MafwGstRenderer* renderer = (MafwGstRenderer*) self;
+	gint position = -1;
 
 	g_return_val_if_fail(MAFW_IS_GST_RENDERER(self), FALSE);
 
@@ -1952,14 +2356,31 @@ gboolean mafw_gst_renderer_assign_playlist(MafwRenderer *self,
 		}
 	}
 
+	/* Back to where the previous instance of the process was */
+	if (renderer->restored != NULL && renderer->iterator != NULL)
+		position = _restore_playlist_index(renderer);
+
 	/* Set the new media and signal playlist changed signal */
 	_signal_playlist_changed(renderer);
+
+	/* The restored media is prerolled already */
+	if (position >= 0 && renderer->current_state != Stopped &&
+	    renderer->media->object_id != NULL &&
+	    !g_strcmp0(renderer->media->object_id,
+		       mafw_playlist_iterator_get_current_objectid(
+			       renderer->iterator)))
+		return TRUE;
+
 	mafw_gst_renderer_set_media_playlist(renderer);
 
 
 	/* Stop playback */
 	mafw_gst_renderer_stop(MAFW_RENDERER(renderer), NULL , NULL);
 
+	/* Not restored yet, the next play starts there */
+	if (position > 0)
+		renderer->start_position = position;
+
 	return TRUE;
 }
 
@@ -2090,6 +2511,94 @@ static void mafw_gst_renderer_get_property(MafwExtension *self,
                 g_value_init(value, G_TYPE_BOOLEAN);
                 g_value_set_boolean(value, renderer->tv_connected);
         }
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_VIDEO_VISIBLE)) {
+		gboolean visible;
+		visible = mafw_gst_renderer_worker_get_video_visible(
+			renderer->worker);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_BOOLEAN);
+		g_value_set_boolean(value, visible);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP)) {
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_BOOLEAN);
+		g_value_set_boolean(value,
+				    mafw_gst_renderer_worker_get_loop(
+					    renderer->worker, NULL, NULL));
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP_START) ||
+		 !strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP_END)) {
+		gint start, end;
+		mafw_gst_renderer_worker_get_loop(renderer->worker, &start,
+						  &end);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_INT);
+		g_value_set_int(value,
+				!strcmp(key,
+					MAFW_PROPERTY_GST_RENDERER_LOOP_START) ?
+				start : end);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_AUDIO_UNDERRUNS)) {
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value,
+				 mafw_gst_renderer_worker_get_audio_underruns(
+					 renderer->worker));
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_AUDIO_BUFFER_TIME)) {
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value,
+				 mafw_gst_renderer_worker_get_audio_buffer_time(
+					 renderer->worker) / 1000);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT)) {
+		const gchar *device;
+
+		device = mafw_gst_renderer_worker_get_audio_output(
+			renderer->worker);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_STRING);
+		g_value_set_string(value, device ? device : "");
+	}
+	else if (!strcmp(key,
+			 MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT_SWITCH_LATENCY)) {
+		gint64 latency;
+
+		mafw_gst_renderer_worker_get_audio_output_switch(
+			renderer->worker, &latency, NULL);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_INT);
+		g_value_set_int(value, latency < 0 ? -1 : latency / 1000);
+	}
+	else if (!strcmp(key,
+			 MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT_SWITCH_DROPPED)) {
+		gint64 dropped;
+
+		mafw_gst_renderer_worker_get_audio_output_switch(
+			renderer->worker, NULL, &dropped);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value, dropped / 1000);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_TEARDOWNS_PENDING)) {
+		guint pending;
+
+		mafw_gst_renderer_worker_get_teardown_stats(
+			renderer->worker, &pending, NULL, NULL, NULL);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value, pending);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_TEARDOWN_MAX_TIME)) {
+		gint64 max_usecs;
+
+		mafw_gst_renderer_worker_get_teardown_stats(
+			renderer->worker, NULL, NULL, NULL, &max_usecs);
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value, max_usecs / 1000);
+	}
 	else if (!strcmp(key,
 			 MAFW_PROPERTY_RENDERER_TRANSPORT_ACTIONS)){
 		/* Delegate in the state. */
@@ -2116,6 +2625,16 @@ static void mafw_gst_renderer_get_property(MafwExtension *self,
 	callback(self, key, value, user_data, error);
 }
 
+/* Clients setting the play-at property get the errors as signals */
+static void _play_at_property_cb(MafwRenderer *self, gpointer user_data,
+				 const GError *error)
+{
+	if (error != NULL)
+		g_signal_emit_by_name(MAFW_EXTENSION(self), "error",
+				      error->domain, error->code,
+				      error->message);
+}
+
 static void mafw_gst_renderer_set_property(MafwExtension *self,
 					 const gchar *key,
 					 const GValue *value)
@@ -2156,6 +2675,40 @@ static void mafw_gst_renderer_set_property(MafwExtension *self,
 									   current_frame_on_pause);
 	}
 #endif
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_VIDEO_VISIBLE)) {
+		/* Video is only decoded while the client shows it */
+		gboolean visible = g_value_get_boolean(value);
+		mafw_gst_renderer_worker_set_video_visible(renderer->worker,
+							   visible);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP) ||
+		 !strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP_START) ||
+		 !strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP_END)) {
+		gboolean loop;
+		gint start, end;
+
+		loop = mafw_gst_renderer_worker_get_loop(renderer->worker,
+							 &start, &end);
+		if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP))
+			loop = g_value_get_boolean(value);
+		else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_LOOP_START))
+			start = g_value_get_int(value);
+		else
+			end = g_value_get_int(value);
+		mafw_gst_renderer_worker_set_loop(renderer->worker, loop,
+						  start, end);
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT)) {
+		mafw_gst_renderer_worker_set_audio_output(
+			renderer->worker, g_value_get_string(value));
+	}
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_PLAY_AT)) {
+		/* An action rather than a state, nothing to notify */
+		mafw_gst_renderer_play_at(MAFW_RENDERER(self),
+					  g_value_get_int(value),
+					  _play_at_property_cb, NULL);
+		return;
+	}
 	else return;
 
 	/* FIXME I'm not sure when to emit property-changed signals.
@@ -33,6 +33,8 @@
 
 #include "mafw-gst-renderer-utils.h"
 #include "mafw-gst-renderer-worker.h"
+#include "mafw-gst-renderer-stats-journal.h"
+#include "mafw-gst-renderer-snapshot.h"
 #include "mafw-playlist-iterator.h"
 /* Solving the cyclic dependencies */
 typedef struct _MafwGstRenderer MafwGstRenderer;
@@ -73,6 +75,41 @@ typedef enum {
 #endif
 
 #define MAFW_PROPERTY_GST_RENDERER_TV_CONNECTED "tv-connected"
+#define MAFW_PROPERTY_GST_RENDERER_VIDEO_VISIBLE "video-visible"
+/* Loop the media without gaps, between loop-start and loop-end (in
+ * milliseconds, 0 for the end of the media) */
+#define MAFW_PROPERTY_GST_RENDERER_LOOP "loop"
+#define MAFW_PROPERTY_GST_RENDERER_LOOP_START "loop-start"
+#define MAFW_PROPERTY_GST_RENDERER_LOOP_END "loop-end"
+/* Read-only: times the audio output ran dry, and the buffer time (in
+ * milliseconds) it currently runs with */
+#define MAFW_PROPERTY_GST_RENDERER_AUDIO_UNDERRUNS "audio-underruns"
+#define MAFW_PROPERTY_GST_RENDERER_AUDIO_BUFFER_TIME "audio-buffer-time"
+/* Pulse sink to play the audio on, empty for the default one.  Setting it
+ * while playing moves the stream over.  Read-only: how long the last move
+ * took (in milliseconds, -1 if it failed) and how much audio it lost */
+#define MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT "audio-output"
+#define MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT_SWITCH_LATENCY \
+	"audio-output-switch-latency"
+#define MAFW_PROPERTY_GST_RENDERER_AUDIO_OUTPUT_SWITCH_DROPPED \
+	"audio-output-switch-dropped"
+/* Read-only: old pipelines still being destroyed in the background, and
+ * the longest any of them took (in milliseconds) */
+#define MAFW_PROPERTY_GST_RENDERER_TEARDOWNS_PENDING "teardowns-pending"
+#define MAFW_PROPERTY_GST_RENDERER_TEARDOWN_MAX_TIME "teardown-max-time"
+/* Write-only: setting it plays the current media from that many seconds
+ * on, see mafw_gst_renderer_play_at() */
+#define MAFW_PROPERTY_GST_RENDERER_PLAY_AT "play-at"
+
+/* Video frames rendered and dropped by the sink so far */
+#define MAFW_METADATA_KEY_GST_RENDERER_RENDERED_FRAMES "rendered-frames"
+#define MAFW_METADATA_KEY_GST_RENDERER_DROPPED_FRAMES "dropped-frames"
+/* Threading chosen for the video decoder */
+#define MAFW_METADATA_KEY_GST_RENDERER_DECODER_THREADS "decoder-threads"
+#define MAFW_METADATA_KEY_GST_RENDERER_DECODER_THREAD_TYPE \
+	"decoder-thread-type"
+/* Format converters in the pipeline, whether they convert and their cost */
+#define MAFW_METADATA_KEY_GST_RENDERER_CONVERTERS "converters"
 
 /*----------------------------------------------------------------------------
   GObject type conversion macros
@@ -100,6 +137,15 @@ typedef enum {
 #define MAFW_GST_RENDERER_NAME "Mafw-Gst-Renderer"
 /* Gst renderer UUID */
 #define MAFW_GST_RENDERER_UUID "gstrenderer"
+/* Environment variable with the number of renderers the plugin creates */
+#define MAFW_GST_RENDERER_INSTANCES_ENV "MAFW_GST_RENDERER_INSTANCES"
+/* Upper limit for the number of renderers the plugin creates */
+#define MAFW_GST_RENDERER_MAX_INSTANCES 8
+/* Time (in milliseconds) to wait for further next/previous/goto_index
+   requests before starting playback of the selected item */
+#define MAFW_GST_RENDERER_NAVIGATION_DELAY 150
+/* Seconds between two snapshots of the position while playing */
+#define MAFW_GST_RENDERER_SNAPSHOT_INTERVAL 30
 
 /*----------------------------------------------------------------------------
   Type definitions
@@ -142,6 +188,18 @@ struct _MafwGstRendererClass {
  * states:            State array
  * error_policy:      error policy
  * tv_connected:      if TV-out cable is connected
+ * stats_journal:     Play statistics and durations not written to the
+ *                    sources yet
+ * navigation_id:     Timeout starting playback after a burst of
+ *                    next/previous/goto_index requests
+ * start_position:    Position (in seconds) the next resolved media starts at
+ * system_bus:        System bus connection, to follow the display state
+ * display_watch:     Subscription to the display state changes of MCE
+ * playback_setup:    The watches only needed to play are set up
+ * restored:          Snapshot the previous instance of the process left,
+ *                    until the playlist it was taken in is assigned again
+ * restore_id:        Idle source restoring @restored
+ * snapshot_id:       Timeout saving the position while playing
  */
 struct _MafwGstRenderer{
 	MafwRenderer parent;
@@ -168,6 +226,9 @@ struct _MafwGstRenderer{
  	MafwGstRendererState **states;
 	MafwRendererErrorPolicy error_policy;
         gboolean tv_connected;
+	MafwGstRendererStatsJournal *stats_journal;
+	guint navigation_id;
+	gint start_position;
 
 #ifdef HAVE_CONIC
 	gboolean connected;
@@ -175,6 +236,12 @@ struct _MafwGstRenderer{
 #endif
 	GConfClient *gconf_client;
 	GVolumeMonitor *volume_monitor;
+	GDBusConnection *system_bus;
+	guint display_watch;
+	gboolean playback_setup;
+	MafwGstRendererSnapshot *restored;
+	guint restore_id;
+	guint snapshot_id;
 };
 
 typedef struct {
@@ -186,6 +253,8 @@ G_BEGIN_DECLS
 
 GType mafw_gst_renderer_get_type(void);
 GObject *mafw_gst_renderer_new(MafwRegistry *registry);
+GObject *mafw_gst_renderer_new_full(MafwRegistry *registry, const gchar *uuid,
+                                    const gchar *name);
 GQuark mafw_gst_renderer_error_quark(void);
 
 /*----------------------------------------------------------------------------
@@ -275,6 +344,8 @@ void mafw_gst_renderer_get_current_metadata(MafwRenderer *self,
   ----------------------------------------------------------------------------*/
 
 void mafw_gst_renderer_set_state(MafwGstRenderer *self, MafwPlayState state);
+void mafw_gst_renderer_setup_playback(MafwGstRenderer *renderer);
+void mafw_gst_renderer_restore_snapshot(MafwGstRenderer *self);
 
 gboolean mafw_gst_renderer_manage_error_idle(gpointer data);
 
@@ -289,6 +360,15 @@ MafwGstRendererPlaybackMode mafw_gst_renderer_get_playback_mode(
 void mafw_gst_renderer_update_source_duration(MafwGstRenderer *renderer,
 					      gint duration);
 
+void mafw_gst_renderer_play_at(MafwRenderer *self, gint seconds,
+			       MafwRendererPlaybackCB callback,
+			       gpointer user_data);
+
+void mafw_gst_renderer_schedule_navigation_play(MafwGstRenderer *self);
+void mafw_gst_renderer_flush_navigation(MafwGstRenderer *self,
+					GError **error);
+void mafw_gst_renderer_cancel_navigation(MafwGstRenderer *self);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,129 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * bench-video-scaling.c
+ *
+ * CPU time the video sink costs with and without the scaler the renderer
+ * puts in front of glimagesink when the window is much smaller than the
+ * video.  The same frames are rendered both ways, as fast as possible.
+ *
+ * Usage: bench-video-scaling [sink [frames]]
+ */
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#define VIDEO_CAPS "video/x-raw,format=I420,width=1920,height=1080"
+/* What the renderer gives the sink for a 400 pixel wide window */
+#define WINDOW_CAPS "video/x-raw,width=400,height=224"
+
+static gint64 _cpu_usecs(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		G_USEC_PER_SEC +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/*
+ * Runs @description to the end.  Returns the CPU time it took, in
+ * microseconds, or -1 on error.
+ */
+static gint64 _run(const gchar *description)
+{
+	GstElement *pipeline;
+	GstMessage *msg;
+	GError *error = NULL;
+	gint64 start, cpu = -1;
+
+	pipeline = gst_parse_launch(description, &error);
+	if (pipeline == NULL) {
+		g_printerr("%s: %s\n", description, error->message);
+		g_error_free(error);
+		return -1;
+	}
+
+	start = _cpu_usecs();
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	msg = gst_bus_timed_pop_filtered(GST_ELEMENT_BUS(pipeline),
+					 GST_CLOCK_TIME_NONE,
+					 GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+		cpu = _cpu_usecs() - start;
+	} else {
+		gst_message_parse_error(msg, &error, NULL);
+		g_printerr("%s: %s\n", description, error->message);
+		g_error_free(error);
+	}
+	gst_message_unref(msg);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(pipeline);
+
+	return cpu;
+}
+
+gint main(gint argc, gchar **argv)
+{
+	const gchar *sink;
+	gint frames;
+	gchar *full, *scaled;
+	gint64 full_cpu, scaled_cpu;
+
+	gst_init(&argc, &argv);
+
+	sink = argc > 1 ? argv[1] : "glimagesink";
+	frames = argc > 2 ? atoi(argv[2]) : 300;
+
+	full = g_strdup_printf("videotestsrc num-buffers=%d ! " VIDEO_CAPS
+			       " ! %s sync=false", frames, sink);
+	scaled = g_strdup_printf("videotestsrc num-buffers=%d ! " VIDEO_CAPS
+				 " ! videoscale ! capsfilter caps=\""
+				 WINDOW_CAPS "\" ! %s sync=false",
+				 frames, sink);
+
+	full_cpu = _run(full);
+	scaled_cpu = _run(scaled);
+	g_free(full);
+	g_free(scaled);
+	if (full_cpu < 0 || scaled_cpu < 0)
+		return 1;
+
+	g_print("%s, %d frames of 1920x1080\n", sink, frames);
+	g_print("  full size:       %.2f ms/frame\n",
+		(gdouble)full_cpu / 1000 / frames);
+	g_print("  scaled to 400px: %.2f ms/frame (%+.0f%%)\n",
+		(gdouble)scaled_cpu / 1000 / frames,
+		100.0 * (scaled_cpu - full_cpu) / full_cpu);
+
+	return 0;
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
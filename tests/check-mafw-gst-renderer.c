@@ -32,10 +32,13 @@
  */
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
 
 #include <check.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sqlite3.h>
 #include <gst/tag/tag.h>
 
@@ -45,6 +48,8 @@
 #include "config.h"
 
 #include "mafw-gst-renderer.h"
+#include "mafw-gst-renderer-decoder-ranking.h"
+#include "mafw-gst-renderer-gapless.h"
 #include "mafw-mock-playlist.h"
 #include "mafw-mock-pulseaudio.h"
 
@@ -75,6 +80,7 @@ typedef struct {
 	gint err_code;
 	gchar *err_msg;
 	gint seek_position;
+	gint position;
 	gboolean error_signal_expected;
 	GError *error_signal_received;
 	const gchar *property_expected;
@@ -97,6 +103,11 @@ typedef struct {
 	gfloat value;
 } BufferingInfo;
 
+typedef struct {
+	gboolean started;
+	gint early;
+} EarlyBuffersInfo;
+
 static gint wait_tout_val;
 
 /* Globals. */
@@ -282,6 +293,7 @@ static void  get_position_cb(MafwRenderer *self, gint position,
 
 	g_debug("get position cb: %d", position);
 
+	c->position = position;
 	if (error != NULL) {
 		c->error = TRUE;
 		c->err_code = error->code;
@@ -523,6 +535,44 @@ static void fx_teardown_dummy_gst_renderer(void)
 	g_object_unref(g_gst_renderer);
 }
 
+/* Cache and configuration home of the tests of a test case */
+static gchar *g_tmp_home;
+
+/* Keeps what the renderer caches and reads out of the user's home.  Runs
+ * before the tests of the case are forked, so they all get it. */
+static void fx_setup_tmp_home(void)
+{
+	g_tmp_home = g_dir_make_tmp("check-mafw-gst-renderer-XXXXXX", NULL);
+	ck_assert_msg(g_tmp_home != NULL, "Could not create a temporary home");
+	g_setenv("XDG_CACHE_HOME", g_tmp_home, TRUE);
+	g_setenv("XDG_CONFIG_HOME", g_tmp_home, TRUE);
+}
+
+static void remove_tree(const gchar *path)
+{
+	GDir *dir;
+	const gchar *name;
+
+	dir = g_dir_open(path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name(dir)) != NULL) {
+			gchar *child = g_build_filename(path, name, NULL);
+
+			remove_tree(child);
+			g_free(child);
+		}
+		g_dir_close(dir);
+	}
+	g_remove(path);
+}
+
+static void fx_teardown_tmp_home(void)
+{
+	remove_tree(g_tmp_home);
+	g_free(g_tmp_home);
+	g_tmp_home = NULL;
+}
+
 /*----------------------------------------------------------------------------
   Mockups
   ----------------------------------------------------------------------------*/
@@ -599,6 +649,26 @@ void gst_video_overlay_set_window_handle(GstVideoOverlay * overlay,
 {
 }
 
+/* Counts the buffers from the first half second of the media the audio
+ * sink gets, once the next media started */
+static GstPadProbeReturn early_buffers_cb(GstPad *pad, GstPadProbeInfo *info,
+					  gpointer user_data)
+{
+	EarlyBuffersInfo *e = user_data;
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+		if (e->started && GST_BUFFER_PTS_IS_VALID(buffer) &&
+		    GST_BUFFER_PTS(buffer) < GST_SECOND / 2)
+			g_atomic_int_inc(&e->early);
+	} else if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) ==
+		   GST_EVENT_STREAM_START) {
+		e->started = TRUE;
+	}
+	return GST_PAD_PROBE_OK;
+}
+
 /*----------------------------------------------------------------------------
   Test cases
   ----------------------------------------------------------------------------*/
@@ -608,6 +678,9 @@ START_TEST(test_basic_playback)
 	RendererInfo s;
 	CallbackInfo c;     
 	MetadataChangedInfo m;
+	EarlyBuffersInfo e = { FALSE, 0 };
+	GstPad *asink_pad;
+	gulong probe;
 #if 0
 	GstBus *bus = NULL;
 	GstMessage *message = NULL;
@@ -762,6 +835,50 @@ START_TEST(test_basic_playback)
 		ck_abort_msg(state_err_msg, "mafw_renderer_resume", "Playing", s.state);
 	}
 
+	/* --- Play at --- */
+
+	/* The media prerolls at the position asked for: nothing from its
+	 * start reaches the audio sink */
+	asink_pad = gst_element_get_static_pad(
+		MAFW_GST_RENDERER(g_gst_renderer)->worker->asink, "sink");
+	ck_assert_msg(asink_pad != NULL, "No audio sink");
+	probe = gst_pad_add_probe(asink_pad, GST_PAD_PROBE_TYPE_BUFFER |
+				  GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+				  early_buffers_cb, &e, NULL);
+
+	g_debug("play at...");
+	mafw_extension_set_property_int(MAFW_EXTENSION(g_gst_renderer),
+					MAFW_PROPERTY_GST_RENDERER_PLAY_AT, 1);
+
+	if (wait_for_state(&s, Transitioning, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "play-at", "Transitioning",
+			     s.state);
+	}
+
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "play-at", "Playing", s.state);
+	}
+
+	reset_callback_info(&c);
+
+	mafw_renderer_get_position(g_gst_renderer, get_position_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			ck_abort_msg(callback_err_msg, "get_position",
+				     c.err_code, c.err_msg);
+	} else {
+		ck_abort_msg("%s", no_callback_msg);
+	}
+	ck_assert_msg(c.position >= 1, "play-at started at %d s",
+		      c.position);
+
+	gst_pad_remove_probe(asink_pad, probe);
+	gst_object_unref(asink_pad);
+	ck_assert_msg(g_atomic_int_get(&e.early) == 0,
+		      "play-at prerolled the start first: %d buffers",
+		      e.early);
+
 	/* --- Stop --- */
 
 	reset_callback_info(&c);
@@ -1251,6 +1368,159 @@ START_TEST(test_playlist_playback)
 }
 END_TEST
 
+static gint transitions;
+
+static void count_transitions_cb(MafwRenderer *s, MafwPlayState state,
+				 gpointer user_data)
+{
+	if (state == Transitioning)
+		transitions++;
+}
+
+START_TEST(test_navigation_coalescing)
+{
+	MafwPlaylist *playlist = NULL;
+	gint i = 0;
+	gint initial_index;
+	RendererInfo s = {0, };
+	CallbackInfo c = {0, };
+	gchar *cur_item_oid = NULL;
+	GstBus *bus;
+
+	g_signal_connect(g_gst_renderer, "error",
+			 G_CALLBACK(error_cb),
+			 &c);
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(state_changed_cb),
+			 &s);
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(count_transitions_cb),
+			 NULL);
+	g_signal_connect(g_gst_renderer, "media-changed",
+			 G_CALLBACK(media_changed_cb),
+			 &s);
+
+	/* --- Create and assign a playlist --- */
+
+	playlist = MAFW_PLAYLIST(mafw_mock_playlist_new());
+	cur_item_oid = get_sample_clip_objectid(SAMPLE_AUDIO_CLIP);
+	for (i=0; i<10; i++) {
+		mafw_playlist_insert_item(
+			playlist, i, cur_item_oid, NULL);
+	}
+	g_free(cur_item_oid);
+
+	if (!mafw_renderer_assign_playlist(g_gst_renderer, playlist, NULL))
+	{
+		ck_abort_msg("Assign playlist failed");
+	}
+
+	wait_for_state(&s, Stopped, wait_tout_val);
+
+	/* --- Play --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_play(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			ck_abort_msg(callback_err_msg, "playing", c.err_code,
+				     c.err_msg);
+	} else {
+		ck_abort_msg("%s", no_callback_msg);
+	}
+
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "mafw_renderer_play", "Playing",
+			     s.state);
+	}
+
+	/* --- A burst of next only plays the last one --- */
+
+	initial_index = s.index;
+	transitions = 0;
+
+	for (i=0; i<3; i++) {
+		reset_callback_info(&c);
+
+		mafw_renderer_next(g_gst_renderer, playback_cb, &c);
+
+		if (wait_for_callback(&c, wait_tout_val)) {
+			if (c.error)
+				ck_abort_msg(callback_err_msg, "moving to next",
+					     c.err_code, c.err_msg);
+		} else {
+			ck_abort_msg("%s", no_callback_msg);
+		}
+	}
+
+	ck_assert_msg(s.index == initial_index + 3, index_err_msg, s.index,
+		      initial_index + 3);
+
+	wait_until_timeout_finishes(2 * MAFW_GST_RENDERER_NAVIGATION_DELAY);
+
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "mafw_renderer_next", "Playing",
+			     s.state);
+	}
+
+	ck_assert_msg(transitions == 1, "%d transitions instead of 1",
+		      transitions);
+
+	/* --- EOS within the delay does not move once more --- */
+
+	initial_index = s.index;
+	transitions = 0;
+
+	reset_callback_info(&c);
+
+	mafw_renderer_next(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			ck_abort_msg(callback_err_msg, "moving to next",
+				     c.err_code, c.err_msg);
+	} else {
+		ck_abort_msg("%s", no_callback_msg);
+	}
+
+	bus = MAFW_GST_RENDERER(g_gst_renderer)->worker->bus;
+	ck_assert_msg(bus != NULL, "No GstBus");
+	gst_bus_post(bus, gst_message_new_eos(NULL));
+
+	wait_until_timeout_finishes(2 * MAFW_GST_RENDERER_NAVIGATION_DELAY);
+
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "EOS", "Playing", s.state);
+	}
+
+	ck_assert_msg(s.index == initial_index + 1, index_err_msg, s.index,
+		      initial_index + 1);
+	ck_assert_msg(transitions == 1, "%d transitions instead of 1",
+		      transitions);
+
+	/* --- Stop --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_stop(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			ck_abort_msg(callback_err_msg, "stopping", c.err_code,
+				     c.err_msg);
+	} else {
+		ck_abort_msg("%s", no_callback_msg);
+	}
+
+	if (wait_for_state(&s, Stopped, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "mafw_renderer_stop", "Stopped",
+			     s.state);
+	}
+}
+END_TEST
+
 
 START_TEST(test_repeat_mode_playback)
 {
@@ -1699,6 +1969,7 @@ static gboolean get_mdata_called;	/* Whether get_metadata was called or not */
 static gint reference_pcount;		/* Reference playcount, what should come in set_metadata */
 static gboolean set_for_playcount;	/* TRUE, when the set_metadata is called to modify the playcount */
 static gboolean set_for_lastplayed;	/* TRUE, when the set_metadata is called to modify the last-played */
+static GError *set_md_err;		/* Error value for the metadata set result */
 
 static void get_metadata(MafwSource *self,
 			     const gchar *object_id,
@@ -1743,6 +2014,8 @@ static void set_metadata(MafwSource *self, const gchar *object_id,
 		ck_assert(G_VALUE_HOLDS(curval, G_TYPE_INT64));
 	}
 	set_mdata_called = TRUE;
+	if (callback != NULL)
+		callback(self, object_id, NULL, user_data, set_md_err);
 }
 
 static void mock_source_class_init(MockSourceClass *klass)
@@ -1796,6 +2069,7 @@ START_TEST(test_update_stats)
                     "Wrong object id mocksource::test");
 	renderer->media->object_id = g_strdup("mocksource::test");
 	mafw_gst_renderer_update_stats(renderer);
+	mafw_gst_renderer_stats_journal_flush(renderer->stats_journal);
         g_error_free(get_md_err);
 	ck_assert(!set_mdata_called);
 	ck_assert(get_mdata_called);
@@ -1807,6 +2081,7 @@ START_TEST(test_update_stats)
 	set_for_playcount = TRUE;
 	get_md_err = NULL;
 	mafw_gst_renderer_update_stats(renderer);
+	mafw_gst_renderer_stats_journal_flush(renderer->stats_journal);
 	ck_assert(set_mdata_called);
 	ck_assert(get_mdata_called);
 	
@@ -1817,6 +2092,7 @@ START_TEST(test_update_stats)
 	set_for_playcount = TRUE;
 	get_md_ht = mafw_metadata_new();
 	mafw_gst_renderer_update_stats(renderer);
+	mafw_gst_renderer_stats_journal_flush(renderer->stats_journal);
 	ck_assert(set_mdata_called);
 	ck_assert(get_mdata_called);
 	
@@ -1830,8 +2106,73 @@ START_TEST(test_update_stats)
 						1);
 	reference_pcount = 2;
 	mafw_gst_renderer_update_stats(renderer);
+	mafw_gst_renderer_stats_journal_flush(renderer->stats_journal);
+	ck_assert(set_mdata_called);
+	ck_assert(get_mdata_called);
+}
+END_TEST
+
+START_TEST(test_stats_journal)
+{
+	MafwGstRendererStatsJournal *journal;
+	MafwRegistry *registry;
+	MafwSource *src;
+
+	registry = MAFW_REGISTRY(mafw_registry_get_instance());
+	ck_assert_msg(registry != NULL,
+		      "Error: cannot get MAFW registry");
+
+	/* Plays of the same object are merged.  The source is not loaded
+	   yet, so they are kept, and saved for the next instance */
+	journal = mafw_gst_renderer_stats_journal_new(registry,
+						      "check-journal");
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 0);
+	mafw_gst_renderer_stats_journal_add_play(journal, "mocksource::test",
+						 1000);
+	mafw_gst_renderer_stats_journal_add_play(journal, "mocksource::test",
+						 2000);
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 1);
+	mafw_gst_renderer_stats_journal_flush(journal);
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 1);
+	mafw_gst_renderer_stats_journal_destroy(journal);
+
+	/* Restored by the next instance */
+	src = MAFW_SOURCE(mock_source_new());
+	mafw_registry_add_extension(registry, MAFW_EXTENSION(src));
+	journal = mafw_gst_renderer_stats_journal_new(registry,
+						      "check-journal");
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 1);
+
+	/* A failed write is kept for the next flush */
+	get_md_ht = NULL;
+	get_md_err = NULL;
+	get_mdata_called = FALSE;
+	set_mdata_called = FALSE;
+	set_for_playcount = TRUE;
+	set_for_lastplayed = TRUE;
+	reference_pcount = 2;
+	g_set_error(&set_md_err, MAFW_EXTENSION_ERROR,
+		    MAFW_EXTENSION_ERROR_FAILED, "Source busy");
+	mafw_gst_renderer_stats_journal_flush(journal);
+	ck_assert(get_mdata_called);
 	ck_assert(set_mdata_called);
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 1);
+	g_clear_error(&set_md_err);
+
+	/* Both plays go in a single update */
+	get_mdata_called = FALSE;
+	set_mdata_called = FALSE;
+	mafw_gst_renderer_stats_journal_flush(journal);
 	ck_assert(get_mdata_called);
+	ck_assert(set_mdata_called);
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 0);
+	mafw_gst_renderer_stats_journal_destroy(journal);
+
+	/* Nothing is left over for the next instance */
+	journal = mafw_gst_renderer_stats_journal_new(registry,
+						      "check-journal");
+	ck_assert(mafw_gst_renderer_stats_journal_get_pending(journal) == 0);
+	mafw_gst_renderer_stats_journal_destroy(journal);
 }
 END_TEST
 
@@ -4078,6 +4419,565 @@ START_TEST(test_buffering)
 }
 END_TEST
 
+static void append_factory(GValueArray *factories, const gchar *name)
+{
+	GValue value = G_VALUE_INIT;
+
+	g_value_init(&value, GST_TYPE_ELEMENT_FACTORY);
+	g_value_take_object(&value, gst_element_factory_find(name));
+	g_value_array_append(factories, &value);
+	g_value_unset(&value);
+}
+
+START_TEST(test_decoder_ranking)
+{
+	GValueArray *factories, *sorted;
+	GstElementFactory *fakesink;
+	GstCaps *caps;
+	guint rank;
+	const gchar *expected[] = { "tee", "fakesink", "queue", "identity" };
+	guint i;
+	gchar *path;
+
+	/* identity, fakesink and queue (which failed) were measured for
+	   audio/x-mafw-test.  The test case has no renderer, so this
+	   process reads the configuration first. */
+	path = g_build_filename(g_get_user_config_dir(), "mafw-gst-renderer",
+				NULL);
+	g_mkdir_with_parents(path, 0700);
+	g_free(path);
+	path = g_build_filename(g_get_user_config_dir(), "mafw-gst-renderer",
+				"decoders.conf", NULL);
+	ck_assert(g_file_set_contents(path, "[ranking]\nself-tune=true\n",
+				      -1, NULL));
+	g_free(path);
+	path = g_build_filename(g_get_user_cache_dir(), "mafw-gst-renderer",
+				NULL);
+	g_mkdir_with_parents(path, 0700);
+	g_free(path);
+	path = g_build_filename(g_get_user_cache_dir(), "mafw-gst-renderer",
+				"decoder-ranking", NULL);
+	ck_assert(g_file_set_contents(path,
+				      "[audio/x-mafw-test]\n"
+				      "identity=500\nfakesink=100\nqueue=0\n",
+				      -1, NULL));
+	g_free(path);
+	gst_init(NULL, NULL);
+	mafw_gst_renderer_decoder_ranking_init();
+
+	factories = g_value_array_new(4);
+	append_factory(factories, "tee");
+	append_factory(factories, "queue");
+	append_factory(factories, "identity");
+	append_factory(factories, "fakesink");
+	fakesink = gst_element_factory_find("fakesink");
+	rank = gst_plugin_feature_get_rank(GST_PLUGIN_FEATURE(fakesink));
+
+	/* The fastest goes ahead of the other measured ones, what was not
+	   measured keeps its place */
+	caps = gst_caps_new_empty_simple("audio/x-mafw-test");
+	sorted = mafw_gst_renderer_decoder_ranking_sort(caps, factories);
+	ck_assert_msg(sorted != NULL, "Measured decoders were not sorted");
+	ck_assert_int_eq(sorted->n_values, factories->n_values);
+	for (i = 0; i < G_N_ELEMENTS(expected); i++) {
+		GstObject *factory = g_value_get_object(
+			g_value_array_get_nth(sorted, i));
+
+		ck_assert_str_eq(GST_OBJECT_NAME(factory), expected[i]);
+	}
+	g_value_array_free(sorted);
+	gst_caps_unref(caps);
+
+	/* The registry is left alone */
+	ck_assert_int_eq(gst_plugin_feature_get_rank(
+				 GST_PLUGIN_FEATURE(fakesink)), rank);
+	gst_object_unref(fakesink);
+
+	/* Nothing measured, nothing changes */
+	caps = gst_caps_new_empty_simple("audio/x-mafw-unknown");
+	ck_assert(mafw_gst_renderer_decoder_ranking_sort(caps,
+							 factories) == NULL);
+	gst_caps_unref(caps);
+
+	g_value_array_free(factories);
+}
+END_TEST
+
+/* The album test_gapless_album plays: one sine cut into tracks */
+#define ALBUM_RATE 44100
+#define ALBUM_TRACKS 3
+#define ALBUM_TRACK_SAMPLES 57330
+#define ALBUM_AMPLITUDE 16000.0
+#define ALBUM_FREQ 440.0
+/* What LAME puts in front of the first sample */
+#define LAME_ENCODER_DELAY 576
+#define MP3_FRAME_SAMPLES 1152
+
+typedef struct {
+	GMutex lock;
+	GCond cond;
+	gboolean done;
+	gint64 start;
+	gint64 stop;
+} GaplessWait;
+
+static gint16 album_sample(gint n)
+{
+	return (gint16) (ALBUM_AMPLITUDE *
+			 sin(2 * G_PI * ALBUM_FREQ * n / ALBUM_RATE));
+}
+
+/*
+ * Runs @description, feeding @n @samples to its "src" appsrc, or pulling
+ * what its "sink" appsink gets between @start and @stop into @out.
+ * Returns FALSE if the elements are missing.
+ */
+static gboolean run_album_pipeline(const gchar *description,
+				   const gint16 *samples, gsize n,
+				   GArray *out, gint64 start, gint64 stop)
+{
+	GstElement *pipeline, *element;
+	GstMessage *msg;
+	GstSample *sample;
+	GstFlowReturn flow;
+
+	pipeline = gst_parse_launch(description, NULL);
+	if (pipeline == NULL)
+		return FALSE;
+
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	if (samples != NULL) {
+		GstBuffer *buffer;
+
+		element = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+		buffer = gst_buffer_new_wrapped(
+			g_memdup(samples, n * sizeof(gint16)),
+			n * sizeof(gint16));
+		GST_BUFFER_PTS(buffer) = 0;
+		GST_BUFFER_DURATION(buffer) =
+			gst_util_uint64_scale_int(n, GST_SECOND, ALBUM_RATE);
+		g_signal_emit_by_name(element, "push-buffer", buffer, &flow);
+		g_signal_emit_by_name(element, "end-of-stream", &flow);
+		gst_buffer_unref(buffer);
+		gst_object_unref(element);
+	} else {
+		element = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+		for (;;) {
+			GstBuffer *buffer;
+			GstMapInfo map;
+			gint64 time;
+			gsize i;
+
+			g_signal_emit_by_name(element, "pull-sample", &sample);
+			if (sample == NULL)
+				break;
+			buffer = gst_sample_get_buffer(sample);
+			gst_buffer_map(buffer, &map, GST_MAP_READ);
+			/* Cut what the renderer cuts off */
+			for (i = 0; i < map.size / sizeof(gint16); i++) {
+				time = GST_BUFFER_PTS(buffer) +
+					gst_util_uint64_scale_int(
+						i, GST_SECOND, ALBUM_RATE);
+				if (time >= start && (stop < 0 || time < stop))
+					g_array_append_val(
+						out, ((gint16 *) map.data)[i]);
+			}
+			gst_buffer_unmap(buffer, &map);
+			gst_sample_unref(sample);
+		}
+		gst_object_unref(element);
+	}
+
+	msg = gst_bus_timed_pop_filtered(GST_ELEMENT_BUS(pipeline),
+					 10 * GST_SECOND,
+					 GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	ck_assert_msg(msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS,
+		      "%s failed", description);
+	gst_message_unref(msg);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(pipeline);
+
+	return TRUE;
+}
+
+/*
+ * Puts the LAME Info frame in front of the MP3 in @path, as lame does
+ * when it writes the file itself: its delay and padding are what the
+ * renderer trims.
+ */
+static void tag_album_track(const gchar *path)
+{
+	gchar *mp3;
+	gsize len, i, frames = 0, padding;
+	guchar *info, *p;
+	gsize frame_size;
+	GString *tagged;
+
+	ck_assert(g_file_get_contents(path, &mp3, &len, NULL));
+	/* 128 kbit/s mono MPEG-1 layer III frames, all the same size
+	   but for the padding bit */
+	for (i = 0; i + 4 <= len;) {
+		const guchar *h = (const guchar *) mp3 + i;
+
+		ck_assert(h[0] == 0xff && (h[1] & 0xe0) == 0xe0);
+		frames++;
+		i += 144 * 128000 / ALBUM_RATE + ((h[2] >> 1) & 1);
+	}
+	padding = frames * MP3_FRAME_SAMPLES - LAME_ENCODER_DELAY -
+		ALBUM_TRACK_SAMPLES;
+
+	frame_size = 144 * 128000 / ALBUM_RATE;
+	info = g_malloc0(frame_size);
+	memcpy(info, mp3, 4);
+	info[2] &= ~0x02;
+	p = info + 4 + 17;
+	memcpy(p, "Info", 4);
+	GST_WRITE_UINT32_BE(p + 4, 1);
+	GST_WRITE_UINT32_BE(p + 8, frames);
+	p += 12;
+	memcpy(p, "LAME3.100", 9);
+	p[21] = LAME_ENCODER_DELAY >> 4;
+	p[22] = ((LAME_ENCODER_DELAY & 0x0f) << 4) | (padding >> 8);
+	p[23] = padding & 0xff;
+
+	tagged = g_string_new_len((const gchar *) info, frame_size);
+	g_string_append_len(tagged, mp3, len);
+	ck_assert(g_file_set_contents(path, tagged->str, tagged->len, NULL));
+	g_string_free(tagged, TRUE);
+	g_free(info);
+	g_free(mp3);
+}
+
+static void gapless_found_cb(gint64 start, gint64 stop, gpointer data)
+{
+	GaplessWait *wait = data;
+
+	g_mutex_lock(&wait->lock);
+	wait->start = start;
+	wait->stop = stop;
+	wait->done = TRUE;
+	g_cond_signal(&wait->cond);
+	g_mutex_unlock(&wait->lock);
+}
+
+START_TEST(test_gapless_album)
+{
+	gint16 *album;
+	GArray *played;
+	gchar *dir;
+	gint track, n;
+	gdouble error, worst = 0;
+
+	/* One sine wave across the whole album */
+	album = g_new(gint16, ALBUM_TRACKS * ALBUM_TRACK_SAMPLES);
+	for (n = 0; n < ALBUM_TRACKS * ALBUM_TRACK_SAMPLES; n++)
+		album[n] = album_sample(n);
+
+	dir = g_dir_make_tmp("gapless-album-XXXXXX", NULL);
+	played = g_array_new(FALSE, FALSE, sizeof(gint16));
+	for (track = 0; track < ALBUM_TRACKS; track++) {
+		MafwGstRendererGaplessProbe *probe;
+		GaplessWait wait = { 0 };
+		gchar *path, *uri, *description;
+		gint64 start, stop;
+
+		path = g_strdup_printf("%s/%02d.mp3", dir, track + 1);
+		description = g_strdup_printf(
+			"appsrc name=src format=time caps=\"audio/x-raw,"
+			"format=S16LE,layout=interleaved,channels=1,rate=%d\" "
+			"! lamemp3enc target=bitrate cbr=true bitrate=128 "
+			"! filesink location=%s", ALBUM_RATE, path);
+		if (!run_album_pipeline(description,
+					album + track * ALBUM_TRACK_SAMPLES,
+					ALBUM_TRACK_SAMPLES, NULL, 0, -1)) {
+			g_message("No MP3 encoder, skipping the gapless test");
+			g_free(description);
+			g_free(path);
+			break;
+		}
+		g_free(description);
+		tag_album_track(path);
+
+		/* The renderer trims what the file tells */
+		uri = g_filename_to_uri(path, NULL, NULL);
+		g_mutex_init(&wait.lock);
+		g_cond_init(&wait.cond);
+		probe = mafw_gst_renderer_gapless_lookup(uri, &start, &stop,
+							 gapless_found_cb,
+							 &wait, NULL);
+		if (probe != NULL) {
+			gint64 end = g_get_monotonic_time() +
+				5 * G_USEC_PER_SEC;
+
+			g_mutex_lock(&wait.lock);
+			while (!wait.done &&
+			       g_cond_wait_until(&wait.cond, &wait.lock, end))
+				;
+			g_mutex_unlock(&wait.lock);
+			ck_assert_msg(wait.done, "%s was not looked into", uri);
+			mafw_gst_renderer_gapless_cancel(probe);
+			start = wait.start;
+			stop = wait.stop;
+		}
+		g_mutex_clear(&wait.lock);
+		g_cond_clear(&wait.cond);
+		g_free(uri);
+
+		description = g_strdup_printf(
+			"filesrc location=%s ! decodebin ! audioconvert "
+			"! audioresample ! audio/x-raw,format=S16LE,"
+			"channels=1,rate=%d ! appsink name=sink sync=false",
+			path, ALBUM_RATE);
+		ck_assert(run_album_pipeline(description, NULL, 0, played,
+					     start, stop));
+		g_free(description);
+		g_unlink(path);
+		g_free(path);
+	}
+
+	/* No silence, nothing missing: the tracks join into the sine */
+	if (track == ALBUM_TRACKS) {
+		ck_assert_msg(ABS((gint) played->len -
+				  ALBUM_TRACKS * ALBUM_TRACK_SAMPLES) <= 64,
+			      "%u samples played instead of %d", played->len,
+			      ALBUM_TRACKS * ALBUM_TRACK_SAMPLES);
+		for (n = 0; n + ALBUM_RATE / 100 <= (gint) played->len;
+		     n += ALBUM_RATE / 100) {
+			gint i;
+
+			error = 0;
+			for (i = n; i < n + ALBUM_RATE / 100; i++) {
+				gdouble diff = g_array_index(played, gint16, i) -
+					album[i];
+
+				error += diff * diff;
+			}
+			error = sqrt(error / (ALBUM_RATE / 100));
+			worst = MAX(worst, error);
+		}
+		ck_assert_msg(worst < ALBUM_AMPLITUDE / 4,
+			      "The album does not play as one sine: %.0f off",
+			      worst);
+	}
+
+	g_array_free(played, TRUE);
+	g_rmdir(dir);
+	g_free(dir);
+	g_free(album);
+}
+END_TEST
+
+/* A local HTTP server serving one clip, the way radio and media servers
+ * do: HTTP/1.0, the end of the data is where the connection closes. */
+typedef struct {
+	GSocketService *service;
+	guint16 port;
+	gchar *body;
+	gsize length;
+	/* Whether the length is given in the response */
+	gboolean content_length;
+	/* The first connection is dropped after that many bytes, if set */
+	gsize drop_at;
+	gint connections;
+} HttpServer;
+
+static gboolean http_run_cb(GThreadedSocketService *service,
+			    GSocketConnection *connection,
+			    GObject *source_object, gpointer user_data)
+{
+	HttpServer *server = user_data;
+	GDataInputStream *in;
+	GOutputStream *out;
+	gchar *line, *head;
+	gsize length;
+
+	/* Nothing in the request matters */
+	in = g_data_input_stream_new(
+		g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+	g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(in),
+						    FALSE);
+	while ((line = g_data_input_stream_read_line(in, NULL, NULL,
+						     NULL)) != NULL &&
+	       line[0] != '\r' && line[0] != '\0')
+		g_free(line);
+	g_free(line);
+	g_object_unref(in);
+
+	length = server->length;
+	if (g_atomic_int_add(&server->connections, 1) == 0 &&
+	    server->drop_at > 0)
+		length = server->drop_at;
+
+	if (server->content_length)
+		head = g_strdup_printf("HTTP/1.0 200 OK\r\n"
+				       "Content-Type: audio/x-wav\r\n"
+				       "Content-Length: %" G_GSIZE_FORMAT
+				       "\r\n\r\n", server->length);
+	else
+		head = g_strdup("HTTP/1.0 200 OK\r\n"
+				"Content-Type: audio/x-wav\r\n\r\n");
+	out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+	if (g_output_stream_write_all(out, head, strlen(head), NULL, NULL,
+				      NULL))
+		g_output_stream_write_all(out, server->body, length, NULL,
+					  NULL, NULL);
+	g_free(head);
+	g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+
+	return TRUE;
+}
+
+static void http_server_start(HttpServer *server, const gchar *clip)
+{
+	GSocketAddress *address, *effective = NULL;
+	gchar *uri, *path;
+	GError *error = NULL;
+
+	uri = get_sample_clip_path(clip);
+	path = g_filename_from_uri(uri, NULL, NULL);
+	ck_assert_msg(g_file_get_contents(path, &server->body,
+					  &server->length, NULL),
+		      "Cannot read %s", path);
+	g_free(path);
+	g_free(uri);
+
+	server->service = g_threaded_socket_service_new(2);
+	address = g_inet_socket_address_new_from_string("127.0.0.1", 0);
+	if (!g_socket_listener_add_address(G_SOCKET_LISTENER(server->service),
+					   address, G_SOCKET_TYPE_STREAM,
+					   G_SOCKET_PROTOCOL_TCP, NULL,
+					   &effective, &error))
+		ck_abort_msg("Cannot listen: %s", error->message);
+	server->port = g_inet_socket_address_get_port(
+		G_INET_SOCKET_ADDRESS(effective));
+	g_object_unref(effective);
+	g_object_unref(address);
+
+	g_signal_connect(server->service, "run", G_CALLBACK(http_run_cb),
+			 server);
+	g_socket_service_start(server->service);
+}
+
+static void http_server_stop(HttpServer *server)
+{
+	g_socket_service_stop(server->service);
+	g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+	g_object_unref(server->service);
+	g_free(server->body);
+}
+
+/* Makes a streaming WAV of the clip served: one that does not tell how
+ * long it is. */
+static void http_server_hide_length(HttpServer *server)
+{
+	gsize offset = 12;
+
+	memset(server->body + 4, 0xff, 4);
+	while (offset + 8 <= server->length) {
+		guint32 size = GST_READ_UINT32_LE(server->body + offset + 4);
+
+		if (memcmp(server->body + offset, "data", 4) == 0) {
+			memset(server->body + offset + 4, 0xff, 4);
+			break;
+		}
+		offset += 8 + size + (size & 1);
+	}
+}
+
+static void play_http(HttpServer *server, RendererInfo *s, CallbackInfo *c)
+{
+	gchar *uri, *objectid;
+
+	uri = g_strdup_printf("http://127.0.0.1:%u/" SAMPLE_AUDIO_CLIP,
+			      server->port);
+	objectid = mafw_source_create_objectid(uri);
+	g_free(uri);
+
+	reset_callback_info(c);
+	g_debug("play_object... %s", objectid);
+	mafw_renderer_play_object(g_gst_renderer, objectid, playback_cb, c);
+	g_free(objectid);
+
+	if (wait_for_callback(c, wait_tout_val)) {
+		if (c->error)
+			ck_abort_msg(callback_err_msg, "playing an object",
+				     c->err_code, c->err_msg);
+	} else {
+		ck_abort_msg("%s", no_callback_msg);
+	}
+
+	if (wait_for_state(s, Playing, wait_tout_val) == FALSE) {
+		ck_abort_msg(state_err_msg, "mafw_renderer_play_object",
+			     "Playing", s->state);
+	}
+}
+
+START_TEST(test_http_reconnect)
+{
+	RendererInfo s;
+	CallbackInfo c;
+	HttpServer server;
+
+	/* Initialize callback info */
+	c.err_msg = NULL;
+	c.error_signal_expected = FALSE;
+	c.error_signal_received = NULL;
+	c.property_expected = NULL;
+	c.property_received = NULL;
+
+	/* Connect to renderer signals */
+	g_signal_connect(g_gst_renderer, "error",
+			 G_CALLBACK(error_cb),
+			 &c);
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(state_changed_cb),
+			 &s);
+
+	mafw_renderer_get_status(g_gst_renderer, status_cb, &s);
+
+	/* --- Connection dropped early --- */
+
+	/* Cut off a tenth into the clip, well before its end: the stream
+	 * is played to the end after connecting again, and no error is
+	 * told */
+	memset(&server, 0, sizeof(server));
+	http_server_start(&server, SAMPLE_AUDIO_CLIP);
+	server.drop_at = server.length / 10;
+	play_http(&server, &s, &c);
+
+	if (wait_for_state(&s, Stopped, 2 * EOS_TIMEOUT) == FALSE) {
+		ck_abort_msg(state_err_msg, "reconnecting", "Stopped",
+			     s.state);
+	}
+	ck_assert_msg(g_atomic_int_get(&server.connections) == 2,
+		      "%d connections instead of 2", server.connections);
+	http_server_stop(&server);
+
+	/* --- Finite stream of unknown duration --- */
+
+	/* Played through once, its end is not taken for a dropped
+	 * connection */
+	memset(&server, 0, sizeof(server));
+	http_server_start(&server, SAMPLE_AUDIO_CLIP);
+	http_server_hide_length(&server);
+	server.content_length = TRUE;
+	play_http(&server, &s, &c);
+
+	if (wait_for_state(&s, Stopped, EOS_TIMEOUT) == FALSE) {
+		ck_abort_msg(state_err_msg, "playing to the end", "Stopped",
+			     s.state);
+	}
+	/* A reconnection would come in a second */
+	wait_until_timeout_finishes(2000);
+	ck_assert_msg(g_atomic_int_get(&server.connections) == 1,
+		      "%d connections instead of 1", server.connections);
+	ck_assert_msg(s.state == Stopped, "Playing the stream again");
+	http_server_stop(&server);
+
+	reset_callback_info(&c);
+}
+END_TEST
+
 /*----------------------------------------------------------------------------
   Suit creation
   ----------------------------------------------------------------------------*/
@@ -4106,13 +5006,17 @@ SRunner * configure_tests(void)
 	TCase *tc1 = tcase_create("Playback");
 
 	/* Create unit tests for test case "Playback" */
+	tcase_add_unchecked_fixture(tc1, fx_setup_tmp_home,
+				    fx_teardown_tmp_home);
 	tcase_add_checked_fixture(tc1, fx_setup_dummy_gst_renderer,
 				  fx_teardown_dummy_gst_renderer);
 if (1)	tcase_add_test(tc1, test_basic_playback);
 if (1)	tcase_add_test(tc1, test_playlist_playback);
+if (1)	tcase_add_test(tc1, test_navigation_coalescing);
 if (1)	tcase_add_test(tc1, test_repeat_mode_playback);
 if (1)	tcase_add_test(tc1, test_gst_renderer_mode);
 if (1)	tcase_add_test(tc1, test_update_stats);
+if (1)	tcase_add_test(tc1, test_stats_journal);
 if (1)  tcase_add_test(tc1, test_play_state);
 if (1)  tcase_add_test(tc1, test_pause_state);
 if (1)  tcase_add_test(tc1, test_stop_state);
@@ -4123,11 +5027,23 @@ if (1)  tcase_add_test(tc1, test_video);
 if (1)  tcase_add_test(tc1, test_media_art);
 if (1)  tcase_add_test(tc1, test_properties_management);
 if (1)  tcase_add_test(tc1, test_buffering);
+if (1)  tcase_add_test(tc1, test_gapless_album);
+if (1)  tcase_add_test(tc1, test_http_reconnect);
 
 	tcase_set_timeout(tc1, 0);
 
 	suite_add_tcase(s, tc1);
 
+	/* Without a renderer: the ranking configuration is read once per
+	   process */
+	TCase *tc2 = tcase_create("Decoder ranking");
+
+	tcase_add_unchecked_fixture(tc2, fx_setup_tmp_home,
+				    fx_teardown_tmp_home);
+if (1)  tcase_add_test(tc2, test_decoder_ranking);
+
+	suite_add_tcase(s, tc2);
+
 	/* Create srunner object with the test suite */
 	sr = srunner_create(s);
 